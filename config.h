@@ -0,0 +1,61 @@
+/* generated by configure.sh */
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+extern int luaopen_astra(lua_State *);
+extern int luaopen_log(lua_State *);
+extern int luaopen_timer(lua_State *);
+extern int luaopen_utils(lua_State *);
+extern int luaopen_json(lua_State *);
+extern int luaopen_base64(lua_State *);
+extern int luaopen_sha1(lua_State *);
+extern int luaopen_md5(lua_State *);
+extern int luaopen_str2hex(lua_State *);
+extern int luaopen_pidfile(lua_State *);
+extern int luaopen_dvb_input(lua_State *);
+extern int luaopen_dvbls(lua_State *);
+extern int luaopen_ddci(lua_State *);
+extern int luaopen_file_input(lua_State *);
+extern int luaopen_file_output(lua_State *);
+extern int luaopen_http_server(lua_State *);
+extern int luaopen_http_request(lua_State *);
+extern int luaopen_analyze(lua_State *);
+extern int luaopen_channel(lua_State *);
+extern int luaopen_mpts_demux(lua_State *);
+extern int luaopen_transmit(lua_State *);
+extern int luaopen_decrypt(lua_State *);
+extern int luaopen_newcamd(lua_State *);
+extern int luaopen_udp_input(lua_State *);
+extern int luaopen_udp_output(lua_State *);
+
+int (*astra_mods[])(lua_State *) =
+{
+    luaopen_astra,
+    luaopen_log,
+    luaopen_timer,
+    luaopen_utils,
+    luaopen_json,
+    luaopen_base64,
+    luaopen_sha1,
+    luaopen_md5,
+    luaopen_str2hex,
+    luaopen_pidfile,
+    luaopen_dvb_input,
+    luaopen_dvbls,
+    luaopen_ddci,
+    luaopen_file_input,
+    luaopen_file_output,
+    luaopen_http_server,
+    luaopen_http_request,
+    luaopen_analyze,
+    luaopen_channel,
+    luaopen_mpts_demux,
+    luaopen_transmit,
+    luaopen_decrypt,
+    luaopen_newcamd,
+    luaopen_udp_input,
+    luaopen_udp_output,
+    NULL
+};
+
+#endif /* _CONFIG_H_ */
@@ -0,0 +1,157 @@
+/*
+ * Astra Module: crc32b benchmark
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks all CRC32 implementations available on this CPU against the
+ * byte-by-byte reference and prints the throughput.
+ *
+ * Build (from the source root):
+ *   gcc -std=gnu99 -O2 -I. -o crc32_bench contrib/crc32_bench.c
+ *
+ * Usage:
+ *   ./crc32_bench [MB]
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "modules/astra/crc32b.c"
+
+typedef uint32_t (*crc32_impl_t)(uint32_t crc, const uint8_t *buffer, size_t size);
+
+static struct
+{
+    const char *name;
+    crc32_impl_t func;
+} impl_list[] =
+{
+    { "byte", crc32_byte },
+    { "slice16", crc32_slice16 },
+#ifdef CRC32_CLMUL
+    { "pclmul", crc32_clmul },
+#endif
+#ifdef CRC32_PMULL
+    { "pmull", crc32_pmull },
+#endif
+};
+
+#define IMPL_COUNT (sizeof(impl_list) / sizeof(impl_list[0]))
+#define DATA_SIZE (64 * 1024)
+
+static bool is_supported(crc32_impl_t func)
+{
+#if defined(CRC32_CLMUL)
+    if(func == crc32_clmul)
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#elif defined(CRC32_PMULL)
+    if(func == crc32_pmull)
+        return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#endif
+    return true;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static int check(uint8_t *data)
+{
+    int errors = 0;
+
+    // CRC-32/MPEG-2 check value
+    if(crc32b((const uint8_t *)"123456789", 9) != 0x0376E6E7)
+    {
+        printf("crc32b: wrong check value\n");
+        ++errors;
+    }
+
+    for(size_t i = 0; i < IMPL_COUNT; ++i)
+    {
+        if(!is_supported(impl_list[i].func))
+            continue;
+
+        for(size_t size = 1; size <= 4096; ++size)
+        {
+            const size_t offset = rand() % 16;
+            const uint32_t crc = 0xFFFFFFFF;
+            const uint32_t r = crc32_byte(crc, &data[offset], size);
+            const uint32_t v = impl_list[i].func(crc, &data[offset], size);
+            if(r != v)
+            {
+                printf("%s: size:%zu offset:%zu 0x%08X != 0x%08X\n"
+                       , impl_list[i].name, size, offset, v, r);
+                ++errors;
+                break;
+            }
+        }
+    }
+
+    return errors;
+}
+
+static void bench(const uint8_t *data, size_t size, size_t total)
+{
+    printf("%5zu bytes:", size);
+    for(size_t i = 0; i < IMPL_COUNT; ++i)
+    {
+        if(!is_supported(impl_list[i].func))
+            continue;
+
+        uint32_t sum = 0;
+        const size_t count = total / size;
+        const double start = now();
+        for(size_t j = 0; j < count; ++j)
+            sum ^= impl_list[i].func(0xFFFFFFFF, &data[(j * 64) % (DATA_SIZE - size)], size);
+        const double elapsed = now() - start;
+
+        printf("  %s %8.1f MB/s", impl_list[i].name, count * size / elapsed / 1000000.0);
+        if(sum == 0x12345678)
+            printf("!");
+    }
+    printf("\n");
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t total = 256;
+    if(argc > 1)
+        total = strtoul(argv[1], NULL, 10);
+    total *= 1024 * 1024;
+
+    uint8_t *data = malloc(DATA_SIZE);
+    srand(1);
+    for(size_t i = 0; i < DATA_SIZE; ++i)
+        data[i] = rand();
+
+    const int errors = check(data);
+    printf("equivalence check: %s\n", (errors) ? "FAILED" : "ok");
+
+    static const size_t sizes[] = { 12, 184, 1021, 4093 };
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        bench(data, sizes[i], total);
+
+    free(data);
+    return (errors) ? 1 : 0;
+}
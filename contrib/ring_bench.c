@@ -0,0 +1,137 @@
+/*
+ * Astra Core: ring microbenchmark
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Moves TS packets from the producer thread to the consumer thread
+ * through asc_ring_t and prints the throughput.
+ *
+ * Build (from the source root):
+ *   gcc -std=gnu99 -O2 -I. -o ring_bench contrib/ring_bench.c core/ring.c -lpthread
+ *
+ * Usage:
+ *   ./ring_bench [packets] [batch]
+ */
+
+#include <stdarg.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "core/ring.h"
+
+#define TS_PACKET_SIZE 188
+#define RING_SIZE 2048
+
+static asc_ring_t *ring;
+static size_t total = 50000000;
+static size_t batch = 7;
+static size_t wakeups = 0;
+
+void asc_log_error(const char *msg, ...)
+{
+    va_list ap;
+    va_start(ap, msg);
+    vfprintf(stderr, msg, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+static void * producer(void *arg)
+{
+    __uarg(arg);
+
+    uint8_t ts[64 * TS_PACKET_SIZE];
+    memset(ts, 0x47, sizeof(ts));
+
+    size_t sent = 0;
+    while(sent < total)
+    {
+        size_t count = total - sent;
+        if(count > batch)
+            count = batch;
+
+        const size_t r = asc_ring_push(ring, ts, count);
+        if(r == 0)
+            sched_yield();
+        sent += r;
+    }
+
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+int main(int argc, char const *argv[])
+{
+    if(argc > 1)
+        total = strtoul(argv[1], NULL, 10);
+    if(argc > 2)
+        batch = strtoul(argv[2], NULL, 10);
+    if(batch < 1 || batch > 64)
+        batch = 7;
+
+    ring = asc_ring_init(TS_PACKET_SIZE, RING_SIZE, true);
+
+    pthread_t thread;
+    const double start = now();
+    pthread_create(&thread, NULL, producer, NULL);
+
+    struct pollfd pfd = { .fd = asc_ring_fd(ring), .events = POLLIN };
+    size_t received = 0;
+    uint32_t check = 0;
+    while(received < total)
+    {
+        if(poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        ++wakeups;
+        asc_ring_wait_reset(ring);
+
+        const void *items;
+        size_t count;
+        while((count = asc_ring_peek(ring, &items)) > 0)
+        {
+            const uint8_t *ts = items;
+            for(size_t i = 0; i < count; ++i)
+                check += ts[i * TS_PACKET_SIZE];
+            asc_ring_release(ring, count);
+            received += count;
+        }
+    }
+
+    const double elapsed = now() - start;
+    pthread_join(thread, NULL);
+    asc_ring_destroy(ring);
+
+    printf("packets:  %zu (batch %zu)\n", total, batch);
+    printf("time:     %.3f s\n", elapsed);
+    printf("rate:     %.2f Mpps, %.2f Gbit/s\n"
+           , total / elapsed / 1000000.0
+           , total * TS_PACKET_SIZE * 8 / elapsed / 1000000000.0);
+    printf("wakeups:  %zu (%.1f packets per wakeup)\n"
+           , wakeups, (double)total / wakeups);
+    printf("checksum: %u\n", check);
+
+    return 0;
+}
@@ -23,12 +23,16 @@
 
 #include "assert.h"
 #include "base.h"
+#include "buffer.h"
 #include "event.h"
 #include "list.h"
 #include "log.h"
+#include "reactor.h"
+#include "ring.h"
 #include "socket.h"
 #include "thread.h"
 #include "timer.h"
+#include "uring.h"
 #include "utils.h"
 
 #endif /* _ASC_H_ */
@@ -0,0 +1,181 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assert.h"
+#include "buffer.h"
+
+#define MSG(_msg) "[core/buffer] " _msg
+
+#ifndef BUFFER_CACHE_LINE
+#   define BUFFER_CACHE_LINE 64
+#endif
+
+struct asc_buffer_pool_t
+{
+    size_t size;
+
+    // pool itself and each allocated buffer
+    uint32_t refcount;
+    bool is_destroyed;
+
+    char lock;
+    asc_buffer_t *free_list;
+    size_t free_count;
+    size_t cache_size;
+};
+
+/* header takes one cache line, data starts right after it */
+struct asc_buffer_t
+{
+    asc_buffer_pool_t *pool;
+    asc_buffer_t *next;
+    uint32_t refcount;
+} __attribute__(( __aligned__(BUFFER_CACHE_LINE) ));
+
+static inline void pool_lock(asc_buffer_pool_t *pool)
+{
+    while(__atomic_test_and_set(&pool->lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static inline void pool_unlock(asc_buffer_pool_t *pool)
+{
+    __atomic_clear(&pool->lock, __ATOMIC_RELEASE);
+}
+
+static void pool_release(asc_buffer_pool_t *pool)
+{
+    if(__atomic_sub_fetch(&pool->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    while(pool->free_list)
+    {
+        asc_buffer_t *buffer = pool->free_list;
+        pool->free_list = buffer->next;
+        free(buffer);
+    }
+    free(pool);
+}
+
+asc_buffer_pool_t * asc_buffer_pool_init(size_t size, size_t cache_size)
+{
+    asc_assert(size > 0, MSG("wrong buffer size"));
+
+    asc_buffer_pool_t *pool = calloc(1, sizeof(asc_buffer_pool_t));
+    asc_assert(pool != NULL, MSG("failed to allocate pool"));
+
+    pool->size = (size + BUFFER_CACHE_LINE - 1) & ~(size_t)(BUFFER_CACHE_LINE - 1);
+    pool->cache_size = cache_size;
+    pool->refcount = 1;
+
+    return pool;
+}
+
+void asc_buffer_pool_destroy(asc_buffer_pool_t *pool)
+{
+    if(!pool)
+        return;
+
+    pool_lock(pool);
+    pool->is_destroyed = true;
+    pool_unlock(pool);
+
+    pool_release(pool);
+}
+
+asc_buffer_t * asc_buffer_alloc(asc_buffer_pool_t *pool)
+{
+    pool_lock(pool);
+    asc_buffer_t *buffer = pool->free_list;
+    if(buffer)
+    {
+        pool->free_list = buffer->next;
+        --pool->free_count;
+    }
+    pool_unlock(pool);
+
+    if(!buffer)
+    {
+#ifndef _WIN32
+        if(posix_memalign((void **)&buffer, BUFFER_CACHE_LINE
+                          , sizeof(asc_buffer_t) + pool->size))
+        {
+            buffer = NULL;
+        }
+#else
+        buffer = malloc(sizeof(asc_buffer_t) + pool->size);
+#endif
+        asc_assert(buffer != NULL, MSG("failed to allocate buffer"));
+        buffer->pool = pool;
+    }
+
+    buffer->next = NULL;
+    buffer->refcount = 1;
+    __atomic_add_fetch(&pool->refcount, 1, __ATOMIC_RELAXED);
+
+    return buffer;
+}
+
+asc_buffer_t * asc_buffer_ref(asc_buffer_t *buffer)
+{
+    __atomic_add_fetch(&buffer->refcount, 1, __ATOMIC_RELAXED);
+    return buffer;
+}
+
+void asc_buffer_unref(asc_buffer_t *buffer)
+{
+    if(!buffer)
+        return;
+
+    if(__atomic_sub_fetch(&buffer->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    asc_buffer_pool_t *pool = buffer->pool;
+
+    pool_lock(pool);
+    const bool is_cached = (!pool->is_destroyed && pool->free_count < pool->cache_size);
+    if(is_cached)
+    {
+        buffer->next = pool->free_list;
+        pool->free_list = buffer;
+        ++pool->free_count;
+    }
+    pool_unlock(pool);
+
+    if(!is_cached)
+        free(buffer);
+
+    pool_release(pool);
+}
+
+uint8_t * asc_buffer_data(asc_buffer_t *buffer)
+{
+    return (uint8_t *)&buffer[1];
+}
+
+size_t asc_buffer_size(asc_buffer_t *buffer)
+{
+    return buffer->pool->size;
+}
+
+bool asc_buffer_is_shared(asc_buffer_t *buffer)
+{
+    return __atomic_load_n(&buffer->refcount, __ATOMIC_ACQUIRE) > 1;
+}
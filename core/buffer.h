@@ -0,0 +1,49 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BUFFER_H_
+#define _BUFFER_H_ 1
+
+#include "base.h"
+
+/*
+ * Pool of reference-counted buffers. Data of the buffer is aligned to
+ * the cache line. Buffer returns to the pool when the last reference is
+ * released, references may be released in any thread. The pool is freed
+ * by asc_buffer_pool_destroy() after all buffers are released.
+ * Buffer with more than one reference is shared and should not be
+ * modified: copy data before changing it.
+ */
+
+typedef struct asc_buffer_pool_t asc_buffer_pool_t;
+typedef struct asc_buffer_t asc_buffer_t;
+
+asc_buffer_pool_t * asc_buffer_pool_init(size_t size, size_t cache_size) __wur;
+void asc_buffer_pool_destroy(asc_buffer_pool_t *pool);
+
+asc_buffer_t * asc_buffer_alloc(asc_buffer_pool_t *pool) __wur;
+asc_buffer_t * asc_buffer_ref(asc_buffer_t *buffer);
+void asc_buffer_unref(asc_buffer_t *buffer);
+
+uint8_t * asc_buffer_data(asc_buffer_t *buffer) __wur;
+size_t asc_buffer_size(asc_buffer_t *buffer) __wur;
+bool asc_buffer_is_shared(asc_buffer_t *buffer) __wur;
+
+#endif /* _BUFFER_H_ */
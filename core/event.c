@@ -22,6 +22,8 @@
 #include "event.h"
 #include "list.h"
 #include "log.h"
+#include "timer.h"
+#include "utils.h"
 
 #ifdef _WIN32
 #   include <windows.h>
@@ -32,6 +34,11 @@
 #   define EV_LIST_SIZE 1024
 #endif
 
+/* upper limit for the wait time. actual value is a time to the next timer shot */
+#ifndef EV_TIMEOUT_MAX
+#   define EV_TIMEOUT_MAX 1000
+#endif
+
 #if defined(WITH_POLL)
 #   define EV_TYPE_POLL
 #   define MSG(_msg) "[core/event poll] " _msg
@@ -54,51 +61,1446 @@
 #       define EV_FLAGS (EPOLLERR | EPOLLRDHUP)
 #   endif
 #   define MSG(_msg) "[core/event epoll] " _msg
+#   ifdef HAVE_IO_URING
+#       define EV_TYPE_IO_URING
+#       include <poll.h>
+#       include <sys/mman.h>
+#       include <sys/socket.h>
+#       include <sys/uio.h>
+#       include <netinet/in.h>
+#       include <netinet/udp.h>
+#       include "uring.h"
+#   endif
+#endif
+
+#ifdef EV_TYPE_IO_URING
+typedef struct event_io_t event_io_t;
+#endif
+
+struct asc_event_t
+{
+    int fd;
+    event_callback_t on_read;
+    event_callback_t on_write;
+    event_callback_t on_error;
+    void *arg;
+
+#if defined(EV_TYPE_KQUEUE) || defined(EV_TYPE_EPOLL)
+    uint32_t id; // index in the slab
+    uint32_t seq; // generation. incremented when the event is closed
+    bool is_active;
+    asc_event_t *next_free;
+#endif
+
+#ifdef EV_TYPE_IO_URING
+    uint32_t mask; // armed poll mask
+    bool is_armed;
+    bool is_queued;
+    size_t queue_idx;
+    event_io_t *io; // data path of the socket. see asc_event_io_init()
+#endif
+};
+
+typedef struct
+{
+    event_callback_t callback;
+    void *arg;
+} event_flush_t;
+
+#define EV_FLUSH_MAX 16
+
+// callbacks to deliver data accumulated by modules during the loop iteration
+static __thread event_flush_t event_flush_list[EV_FLUSH_MAX];
+static __thread int event_flush_count = 0;
+
+#if defined(EV_TYPE_KQUEUE) || defined(EV_TYPE_EPOLL)
+
+/*
+ * ooooooooooo oooooooooo    ooooooo  ooooo       ooooo
+ *  888    88   888    888 o888   888o 888         888
+ *  888ooo8     888oooo88  888     888 888         888
+ *  888    oo   888        888o   o888 888      o  888      o
+ * o888ooo8888 o888o         88ooo88  o888ooooo88 o888ooooo88
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ * oooo   oooo ooooooo  ooooo  oooo ooooooooooo ooooo  oooo ooooooooooo
+ *  888  o88 o888   888o 888    88   888    88   888    88   888    88
+ *  888888   888     888 888    88   888ooo8     888    88   888ooo8
+ *  888  88o 888o  8o888 888    88   888    oo   888    88   888    oo
+ * o888o o888o 88ooo88    888oo88   o888ooo8888   888oo88   o888ooo8888
+ *                  88o8
+ */
+
+/* events are allocated in chunks and never moved or freed until
+ * asc_event_core_destroy(). the kernel refers to the event with the handle:
+ * index in the slab and generation. handles of closed events are stale */
+#ifndef EV_SLAB_CHUNK
+#   define EV_SLAB_CHUNK 256
+#endif
+
+/* the generation is stored in 28 bits. upper bits of the io_uring
+ * user_data are the operation type */
+#define EV_SEQ_MASK 0x0FFFFFFF
+
+#ifdef EV_TYPE_IO_URING
+#   define EV_URING_NOP UINT64_MAX
+#   define EV_URING_RECV (1ULL << 62)
+#   define EV_URING_SEND (2ULL << 62)
+#   define EV_URING_OP_MASK (3ULL << 62)
+
+/* buffer ring for the multishot receive. shared by all sockets of the loop */
+#   ifndef EV_URING_BUFFERS
+#       define EV_URING_BUFFERS 2048
+#   endif
+#   define EV_URING_BUFFER_SIZE 2048
+#   define EV_URING_BGID 0
+
+/* send queue of the socket */
+#   define EV_IO_TX_STREAM (64 * 1024)
+#   define EV_IO_TX_DGRAM (192 * 1024)
+#   define EV_IO_TX_SEGMENTS 128
+#   define EV_IO_GSO_SEGMENTS 64
+#   define EV_IO_GSO_SIZE 65000
+#endif
+
+typedef struct
+{
+    asc_event_t **slab;
+    uint32_t slab_count; // number of chunks
+    asc_event_t *slab_free;
+    size_t event_count;
+
+    int fd;
+    EV_OTYPE ed_list[EV_LIST_SIZE];
+#if defined(EV_TYPE_KQUEUE)
+    uint32_t ed_seq[EV_LIST_SIZE]; // udata has no room for the generation
+#endif
+
+#ifdef EV_TYPE_IO_URING
+    asc_uring_t *uring;
+
+    // events to arm on the next loop iteration
+    asc_event_t **queue;
+    size_t queue_count;
+    size_t queue_size;
+
+    struct io_uring_buf_ring *br;
+    uint8_t *br_data;
+    uint16_t br_tail;
+    size_t br_free; // buffers available to the kernel
+
+    event_io_t *io_list; // including closed sockets with requests in progress
+    size_t io_count;
+
+    // sockets with requests to submit on the next loop iteration
+    event_io_t **flush;
+    size_t flush_count;
+    size_t flush_size;
+
+    // sockets to dispatch without waiting for completions
+    event_io_t **ready;
+    size_t ready_count;
+    size_t ready_size;
+#endif
+} event_observer_t;
+
+// each event loop thread (see core/reactor.c) has its own observer
+static __thread event_observer_t event_observer;
+
+static asc_event_t * event_slab_alloc(void)
+{
+    if(!event_observer.slab_free)
+    {
+        const uint32_t base = event_observer.slab_count * EV_SLAB_CHUNK;
+        asc_event_t *chunk = calloc(EV_SLAB_CHUNK, sizeof(asc_event_t));
+        event_observer.slab = realloc(event_observer.slab
+                                      , (event_observer.slab_count + 1) * sizeof(asc_event_t *));
+        asc_assert(chunk && event_observer.slab, MSG("failed to allocate events"));
+        event_observer.slab[event_observer.slab_count++] = chunk;
+
+        for(int i = EV_SLAB_CHUNK - 1; i >= 0; --i)
+        {
+            chunk[i].id = base + i;
+            chunk[i].next_free = event_observer.slab_free;
+            event_observer.slab_free = &chunk[i];
+        }
+    }
+
+    asc_event_t *event = event_observer.slab_free;
+    event_observer.slab_free = event->next_free;
+
+    const uint32_t id = event->id;
+    const uint32_t seq = event->seq;
+    memset(event, 0, sizeof(asc_event_t));
+    event->id = id;
+    event->seq = seq;
+    event->is_active = true;
+
+    ++event_observer.event_count;
+    return event;
+}
+
+static void event_slab_free(asc_event_t *event)
+{
+    ++event->seq;
+    event->is_active = false;
+    event->next_free = event_observer.slab_free;
+    event_observer.slab_free = event;
+
+    --event_observer.event_count;
+}
+
+static inline asc_event_t * event_slab_get(uint32_t id)
+{
+    return &event_observer.slab[id / EV_SLAB_CHUNK][id % EV_SLAB_CHUNK];
+}
+
+static void event_slab_destroy(void)
+{
+    for(uint32_t i = 0; i < event_observer.slab_count; ++i)
+        free(event_observer.slab[i]);
+    free(event_observer.slab);
+
+    event_observer.slab = NULL;
+    event_observer.slab_count = 0;
+    event_observer.slab_free = NULL;
+    event_observer.event_count = 0;
+}
+
+static inline uint64_t event_handle(const asc_event_t *event)
+{
+    return event->id | ((uint64_t)(event->seq & EV_SEQ_MASK) << 32);
+}
+
+/* returns the event by the handle or NULL if the handle is stale */
+static inline asc_event_t * event_lookup(uint64_t handle)
+{
+    asc_event_t *event = event_slab_get(handle & 0xFFFFFFFF);
+    return ((event->seq & EV_SEQ_MASK) == (uint32_t)(handle >> 32)) ? event : NULL;
+}
+
+#ifdef EV_TYPE_IO_URING
+
+/*
+ * io_uring
+ *
+ * Sockets registered with asc_event_io_init() have the data path in the
+ * ring: multishot IORING_OP_RECV (IORING_OP_ACCEPT for the listening socket)
+ * receives into the buffer ring shared by the loop, multishot poll reports
+ * errors and connection only. Data to send is copied to the queue of the
+ * socket and submitted as IORING_OP_SEND/SENDMSG requests together with
+ * the wait for completions: one system call per loop iteration for all
+ * sockets. Callbacks are level-triggered as with epoll: on_read is called
+ * while received data is queued, on_write while the send queue has room.
+ *
+ * Other descriptors (files, dvr, pipes) use one-shot IORING_OP_POLL_ADD
+ * re-armed after each completion. Multishot poll is edge-triggered and
+ * IORING_POLL_ADD_LEVEL can't be combined with IORING_POLL_ADD_MULTI,
+ * but these readers take one chunk per callback and expect level events.
+ */
+
+typedef struct
+{
+    int value; // buffer id or accepted descriptor
+    uint32_t size;
+    uint32_t skip;
+} event_rx_t;
+
+typedef struct
+{
+    struct msghdr msg;
+    struct iovec iov;
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+} event_tx_t;
+
+struct event_io_t
+{
+    asc_event_t *event; // NULL if the event is closed
+    int fd;
+    event_io_type_t type;
+
+    bool is_connected;
+    bool is_recv; // multishot request is in progress
+    bool is_eof;
+    bool is_eof_done; // end of stream is reported to on_read
+    bool is_error_done; // error is reported to on_error
+    bool is_close; // close the descriptor when the send queue is empty
+    bool is_flush; // in the flush list
+    bool is_ready; // in the ready list
+    bool is_gso;
+    int error;
+    int tx_error; // send error of the datagram socket. reported once
+    int inflight; // requests in the kernel
+
+    // received data: ring of the buffer ids or accepted descriptors
+    event_rx_t *rx;
+    size_t rx_head;
+    size_t rx_count;
+    size_t rx_size;
+    uint64_t rx_read; // changed on each read. progress of the callback
+
+    // send queue. first tx_busy bytes are in the kernel
+    uint8_t *tx;
+    size_t tx_len;
+    size_t tx_busy;
+    int tx_inflight;
+
+    // datagram sizes and requests
+    uint16_t *tx_seg;
+    size_t tx_seg_count;
+    size_t tx_seg_busy;
+    event_tx_t *tx_req;
+
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+
+    event_io_t *prev;
+    event_io_t *next;
+};
+
+static struct io_uring_sqe * uring_get_sqe(void)
+{
+    struct io_uring_sqe *sqe = asc_uring_get_sqe(event_observer.uring);
+    if(!sqe)
+    {
+        // submission queue is full
+        asc_uring_submit(event_observer.uring, 0);
+        sqe = asc_uring_get_sqe(event_observer.uring);
+        asc_assert(sqe != NULL, MSG("io_uring submission queue is full"));
+    }
+    return sqe;
+}
+
+static inline uint8_t * uring_buffer(int bid)
+{
+    return &event_observer.br_data[bid * EV_URING_BUFFER_SIZE];
+}
+
+static void uring_buffer_put(int bid)
+{
+    struct io_uring_buf *buf
+        = &event_observer.br->bufs[event_observer.br_tail & (EV_URING_BUFFERS - 1)];
+    buf->addr = (uintptr_t)uring_buffer(bid);
+    buf->len = EV_URING_BUFFER_SIZE;
+    buf->bid = bid;
+
+    ++event_observer.br_tail;
+    __atomic_store_n(&event_observer.br->tail, event_observer.br_tail, __ATOMIC_RELEASE);
+    ++event_observer.br_free;
+}
+
+/* returns the buffer id selected by the kernel or -1 */
+static inline int uring_buffer_get(uint32_t flags)
+{
+    if(!(flags & IORING_CQE_F_BUFFER))
+        return -1;
+
+    --event_observer.br_free;
+    return flags >> IORING_CQE_BUFFER_SHIFT;
+}
+
+static bool uring_buffer_init(void)
+{
+    const size_t ring_size = EV_URING_BUFFERS * sizeof(struct io_uring_buf);
+    void *br = mmap(NULL, ring_size, PROT_READ | PROT_WRITE
+                    , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(br == MAP_FAILED)
+        return false;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)br;
+    reg.ring_entries = EV_URING_BUFFERS;
+    reg.bgid = EV_URING_BGID;
+    if(asc_uring_register(event_observer.uring, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        munmap(br, ring_size);
+        return false;
+    }
+
+    event_observer.br = br;
+    event_observer.br_data = malloc(EV_URING_BUFFERS * EV_URING_BUFFER_SIZE);
+    asc_assert(event_observer.br_data != NULL, MSG("failed to allocate buffers"));
+    for(int i = 0; i < EV_URING_BUFFERS; ++i)
+        uring_buffer_put(i);
+
+    return true;
+}
+
+static void uring_buffer_destroy(void)
+{
+    if(!event_observer.br)
+        return;
+
+    munmap(event_observer.br, EV_URING_BUFFERS * sizeof(struct io_uring_buf));
+    free(event_observer.br_data);
+    event_observer.br = NULL;
+    event_observer.br_data = NULL;
+    event_observer.br_tail = 0;
+    event_observer.br_free = 0;
+}
+
+/* multishot receive with the buffer ring. linux 6.0 and later */
+static bool uring_probe_recv(void)
+{
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) != 0)
+        return false;
+
+    bool is_ok = false;
+    bool is_more = false;
+    if(send(sv[1], "", 1, 0) == 1)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = EV_URING_BGID;
+        sqe->fd = sv[0];
+        sqe->user_data = EV_URING_RECV;
+        is_more = true;
+        asc_uring_submit(event_observer.uring, 0);
+    }
+
+    while(is_more)
+    {
+        if(asc_uring_wait(event_observer.uring, 1, EV_TIMEOUT_MAX) == -1 && errno != EINTR)
+            break;
+
+        struct io_uring_cqe *cqe;
+        while((cqe = asc_uring_peek_cqe(event_observer.uring)) != NULL)
+        {
+            const uint64_t data = cqe->user_data;
+            const int res = cqe->res;
+            const uint32_t flags = cqe->flags;
+            asc_uring_cqe_seen(event_observer.uring);
+
+            if(data != EV_URING_RECV)
+                continue;
+
+            const int bid = uring_buffer_get(flags);
+            if(bid != -1)
+                uring_buffer_put(bid);
+
+            if(!(flags & IORING_CQE_F_MORE))
+            {
+                is_more = false;
+                continue;
+            }
+            if(res == 1)
+                is_ok = true;
+
+            struct io_uring_sqe *sqe = uring_get_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = EV_URING_RECV;
+            sqe->user_data = EV_URING_NOP;
+            asc_uring_submit(event_observer.uring, 0);
+        }
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+    return is_ok;
+}
+
+static void uring_destroy(void)
+{
+    // the ring unregisters buffers on close
+    asc_uring_destroy(event_observer.uring);
+    event_observer.uring = NULL;
+    uring_buffer_destroy();
+
+    free(event_observer.queue);
+    event_observer.queue = NULL;
+    event_observer.queue_count = 0;
+    event_observer.queue_size = 0;
+
+    free(event_observer.flush);
+    event_observer.flush = NULL;
+    event_observer.flush_count = 0;
+    event_observer.flush_size = 0;
+
+    free(event_observer.ready);
+    event_observer.ready = NULL;
+    event_observer.ready_count = 0;
+    event_observer.ready_size = 0;
+}
+
+static bool uring_init(void)
+{
+    asc_uring_t *uring = asc_uring_init(EV_LIST_SIZE);
+    if(!uring)
+        return false;
+
+    const unsigned features = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if((asc_uring_features(uring) & features) != features)
+    {
+        asc_log_debug(MSG("io_uring is not supported by the kernel"));
+        asc_uring_destroy(uring);
+        return false;
+    }
+
+    event_observer.uring = uring;
+    if(!uring_buffer_init() || !uring_probe_recv())
+    {
+        asc_log_debug(MSG("io_uring multishot receive is not supported by the kernel"));
+        uring_destroy();
+        return false;
+    }
+
+    asc_log_debug(MSG("using io_uring"));
+    return true;
+}
+
+static void uring_push(event_io_t ***list, size_t *count, size_t *size, event_io_t *io)
+{
+    if(*count == *size)
+    {
+        *size = (*size) ? *size * 2 : 64;
+        *list = realloc(*list, *size * sizeof(event_io_t *));
+        asc_assert(*list != NULL, MSG("failed to allocate event queue"));
+    }
+    (*list)[(*count)++] = io;
+}
+
+static inline size_t uring_io_tx_size(const event_io_t *io)
+{
+    return (io->type == EVENT_IO_DGRAM) ? EV_IO_TX_DGRAM : EV_IO_TX_STREAM;
+}
+
+/* requests of the socket will be submitted on the next loop iteration */
+static void uring_io_flush_queue(event_io_t *io)
+{
+    if(io->is_flush)
+        return;
+
+    io->is_flush = true;
+    uring_push(&event_observer.flush, &event_observer.flush_count
+               , &event_observer.flush_size, io);
+}
+
+static bool uring_io_is_ready(const event_io_t *io, bool is_read)
+{
+    const asc_event_t *event = io->event;
+    if(!event)
+        return false;
+
+    if(is_read && event->on_read)
+    {
+        if(io->rx_count > 0)
+            return true;
+        if((io->is_eof || io->error) && !io->is_eof_done)
+            return true;
+    }
+
+    if(event->on_write && io->is_connected && io->type != EVENT_IO_LISTEN
+       && !io->error && io->tx_len < uring_io_tx_size(io))
+    {
+        return true;
+    }
+
+    if(event->on_error && io->error && !io->is_error_done)
+        return true;
+
+    return false;
+}
+
+/* socket will be dispatched without waiting for completions */
+static void uring_io_ready(event_io_t *io)
+{
+    if(io->is_ready || !uring_io_is_ready(io, true))
+        return;
+
+    io->is_ready = true;
+    uring_push(&event_observer.ready, &event_observer.ready_count
+               , &event_observer.ready_size, io);
+}
+
+static void uring_rx_push(event_io_t *io, int value, uint32_t size)
+{
+    if(io->rx_count == io->rx_size)
+    {
+        // unwrap the ring to the new array
+        const size_t rx_size = (io->rx_size) ? io->rx_size * 2 : 64;
+        event_rx_t *rx = malloc(rx_size * sizeof(event_rx_t));
+        asc_assert(rx != NULL, MSG("failed to allocate receive queue"));
+        for(size_t i = 0; i < io->rx_count; ++i)
+            rx[i] = io->rx[(io->rx_head + i) & (io->rx_size - 1)];
+
+        free(io->rx);
+        io->rx = rx;
+        io->rx_head = 0;
+        io->rx_size = rx_size;
+    }
+
+    event_rx_t *item = &io->rx[(io->rx_head + io->rx_count) & (io->rx_size - 1)];
+    item->value = value;
+    item->size = size;
+    item->skip = 0;
+    ++io->rx_count;
+}
+
+static void uring_rx_pop(event_io_t *io)
+{
+    const event_rx_t *item = &io->rx[io->rx_head];
+    if(io->type != EVENT_IO_LISTEN)
+        uring_buffer_put(item->value);
+
+    io->rx_head = (io->rx_head + 1) & (io->rx_size - 1);
+    --io->rx_count;
+}
+
+static void uring_io_release(event_io_t *io)
+{
+    if(io->event || io->inflight > 0 || io->is_flush || io->is_ready || io->tx_len > 0)
+        return;
+
+    if(io->is_close && io->fd != -1)
+        close(io->fd);
+
+    if(io->prev)
+        io->prev->next = io->next;
+    else
+        event_observer.io_list = io->next;
+    if(io->next)
+        io->next->prev = io->prev;
+    --event_observer.io_count;
+
+    free(io->rx);
+    free(io->tx);
+    free(io->tx_seg);
+    free(io->tx_req);
+    free(io);
+}
+
+static void uring_io_send_stream(event_io_t *io)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = io->fd;
+    sqe->addr = (uintptr_t)io->tx;
+    sqe->len = io->tx_len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = (uintptr_t)io | EV_URING_SEND;
+
+    io->tx_busy = io->tx_len;
+    io->tx_inflight = 1;
+    ++io->inflight;
+}
+
+static void uring_io_send_dgram(event_io_t *io)
+{
+    struct io_uring_sqe *sqe = NULL;
+    size_t skip = io->tx_busy;
+    size_t i = io->tx_seg_busy;
+    size_t r = 0;
+
+    while(i < io->tx_seg_count)
+    {
+        // datagrams of the same size are sent with one request.
+        // the last segment may be shorter
+        const size_t seg_size = io->tx_seg[i];
+        size_t size = seg_size;
+        size_t n = 1;
+        while(io->is_gso && n < EV_IO_GSO_SEGMENTS && i + n < io->tx_seg_count
+              && io->tx_seg[i + n - 1] == seg_size && io->tx_seg[i + n] <= seg_size
+              && size + io->tx_seg[i + n] <= EV_IO_GSO_SIZE)
+        {
+            size += io->tx_seg[i + n];
+            ++n;
+        }
+
+        event_tx_t *req = &io->tx_req[r++];
+        memset(&req->msg, 0, sizeof(req->msg));
+        req->iov.iov_base = &io->tx[skip];
+        req->iov.iov_len = size;
+        req->msg.msg_name = &io->addr;
+        req->msg.msg_namelen = io->addrlen;
+        req->msg.msg_iov = &req->iov;
+        req->msg.msg_iovlen = 1;
+#ifdef UDP_SEGMENT
+        if(n > 1)
+        {
+            memset(req->control, 0, sizeof(req->control));
+            req->msg.msg_control = req->control;
+            req->msg.msg_controllen = sizeof(req->control);
+            struct cmsghdr *cm = CMSG_FIRSTHDR(&req->msg);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            *(uint16_t *)CMSG_DATA(cm) = seg_size;
+        }
+#endif
+
+        // datagrams are sent in order
+        if(sqe)
+            sqe->flags |= IOSQE_IO_LINK;
+
+        sqe = uring_get_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = io->fd;
+        sqe->addr = (uintptr_t)&req->msg;
+        sqe->len = 1;
+        sqe->user_data = (uintptr_t)io | EV_URING_SEND;
+
+        ++io->tx_inflight;
+        ++io->inflight;
+        skip += size;
+        i += n;
+    }
+
+    io->tx_busy = skip;
+    io->tx_seg_busy = i;
+}
+
+static void uring_io_submit(event_io_t *io)
+{
+    asc_event_t *event = io->event;
+
+    if(event && event->on_read && !io->is_recv && !io->is_eof && !io->error
+       && (io->is_connected || io->type == EVENT_IO_LISTEN))
+    {
+        if(io->type != EVENT_IO_LISTEN && !event_observer.br_free)
+        {
+            // all buffers are in the receive queues
+            uring_io_flush_queue(io);
+        }
+        else
+        {
+            struct io_uring_sqe *sqe = uring_get_sqe();
+            if(io->type == EVENT_IO_LISTEN)
+            {
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            }
+            else
+            {
+                sqe->opcode = IORING_OP_RECV;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = EV_URING_BGID;
+            }
+            sqe->fd = io->fd;
+            sqe->user_data = (uintptr_t)io | EV_URING_RECV;
+
+            io->is_recv = true;
+            ++io->inflight;
+        }
+    }
+
+    if(io->tx_len > io->tx_busy && !io->tx_inflight)
+    {
+        if(io->type == EVENT_IO_DGRAM)
+            uring_io_send_dgram(io);
+        else if(io->is_connected)
+            uring_io_send_stream(io);
+    }
+
+    if(!event && io->is_close && io->fd != -1 && !io->tx_len)
+    {
+        close(io->fd);
+        io->fd = -1;
+    }
+}
+
+static void uring_io_flush(void)
+{
+    // requests queued by the submit are processed on the next iteration
+    const size_t count = event_observer.flush_count;
+    for(size_t i = 0; i < count; ++i)
+    {
+        event_io_t *io = event_observer.flush[i];
+        io->is_flush = false;
+        uring_io_submit(io);
+        uring_io_release(io);
+    }
+
+    event_observer.flush_count -= count;
+    memmove(event_observer.flush, &event_observer.flush[count]
+            , event_observer.flush_count * sizeof(event_io_t *));
+}
+
+static void uring_on_recv(event_io_t *io, int res, uint32_t flags)
+{
+    if(!(flags & IORING_CQE_F_MORE))
+    {
+        io->is_recv = false;
+        --io->inflight;
+    }
+
+    const int bid = uring_buffer_get(flags);
+
+    if(!io->event)
+    {
+        // socket is closed
+        if(bid != -1)
+            uring_buffer_put(bid);
+        else if(io->type == EVENT_IO_LISTEN && res >= 0)
+            close(res);
+        uring_io_release(io);
+        return;
+    }
+
+    if(io->type == EVENT_IO_LISTEN)
+    {
+        if(res >= 0)
+            uring_rx_push(io, res, 0);
+        else if(res != -ECANCELED)
+            asc_log_error(MSG("failed to accept connection [%s]"), strerror(-res));
+    }
+    else if(res > 0)
+    {
+        uring_rx_push(io, bid, res);
+    }
+    else
+    {
+        if(bid != -1)
+            uring_buffer_put(bid);
+
+        if(res == 0)
+        {
+            if(io->type != EVENT_IO_DGRAM)
+                io->is_eof = true;
+        }
+        else if(io->type != EVENT_IO_DGRAM && !io->error
+                && res != -ENOBUFS && res != -ECANCELED)
+        {
+            // errors of the datagram socket are transient, request is re-armed
+            io->error = -res;
+        }
+    }
+
+    if(!io->is_recv)
+        uring_io_flush_queue(io);
+    uring_io_ready(io);
+}
+
+static void uring_on_send(event_io_t *io, int res)
+{
+    --io->inflight;
+    --io->tx_inflight;
+
+    size_t done = 0;
+    if(io->type == EVENT_IO_DGRAM)
+    {
+        if(res < 0 && res != -ECANCELED)
+        {
+#ifdef UDP_SEGMENT
+            if(io->is_gso && (res == -EIO || res == -EINVAL
+                              || res == -EOPNOTSUPP || res == -ENOPROTOOPT))
+            {
+                asc_log_debug(MSG("UDP_SEGMENT is not supported, fallback to sendmsg()"));
+                io->is_gso = false;
+            }
+            else
+#endif
+                io->tx_error = -res;
+        }
+
+        if(io->tx_inflight > 0)
+            return;
+
+        // datagrams are sent or dropped
+        done = io->tx_busy;
+        io->tx_seg_count -= io->tx_seg_busy;
+        memmove(io->tx_seg, &io->tx_seg[io->tx_seg_busy]
+                , io->tx_seg_count * sizeof(uint16_t));
+        io->tx_seg_busy = 0;
+    }
+    else
+    {
+        if(res > 0)
+        {
+            done = res;
+        }
+        else
+        {
+            if(!io->error)
+                io->error = (res < 0) ? -res : EPIPE;
+            done = io->tx_len;
+        }
+    }
+
+    io->tx_len -= done;
+    memmove(io->tx, &io->tx[done], io->tx_len);
+    io->tx_busy = 0;
+
+    if(io->error)
+    {
+        io->tx_len = 0;
+        io->tx_seg_count = 0;
+        if(!io->event && io->is_close && io->fd != -1)
+        {
+            close(io->fd);
+            io->fd = -1;
+        }
+    }
+
+    if(io->tx_len > 0 || (!io->event && io->is_close))
+        uring_io_flush_queue(io);
+    uring_io_ready(io);
+    uring_io_release(io);
+}
+
+static void uring_io_dispatch(event_io_t *io, asc_event_t *event)
+{
+    bool is_stalled = false;
+
+    // callback may close the event. io stays allocated while it is in the ready list
+#define EV_ALIVE() (io->event == event)
+    while(event->on_read && io->rx_count > 0)
+    {
+        const uint64_t rx_read = io->rx_read;
+        event->on_read(event->arg);
+        if(!EV_ALIVE())
+            return;
+        if(io->rx_read == rx_read)
+        {
+            // data is left in the queue until the next completion
+            is_stalled = true;
+            break;
+        }
+    }
+
+    if(event->on_read && !io->rx_count && (io->is_eof || io->error) && !io->is_eof_done)
+    {
+        io->is_eof_done = true;
+        event->on_read(event->arg);
+        if(!EV_ALIVE())
+            return;
+    }
+
+    if(event->on_write && uring_io_is_ready(io, false) && !io->error)
+    {
+        event->on_write(event->arg);
+        if(!EV_ALIVE())
+            return;
+    }
+
+    if(event->on_error && io->error && !io->is_error_done)
+    {
+        io->is_error_done = true;
+        event->on_error(event->arg);
+        if(!EV_ALIVE())
+            return;
+    }
+#undef EV_ALIVE
+
+    io->is_ready = false;
+    if(uring_io_is_ready(io, !is_stalled))
+    {
+        io->is_ready = true;
+        uring_push(&event_observer.ready, &event_observer.ready_count
+                   , &event_observer.ready_size, io);
+    }
+}
+
+static void uring_dispatch(void)
+{
+    // sockets queued by the callbacks are dispatched on the next iteration
+    const size_t count = event_observer.ready_count;
+    for(size_t i = 0; i < count; ++i)
+    {
+        event_io_t *io = event_observer.ready[i];
+        if(io->event)
+        {
+            uring_io_dispatch(io, io->event);
+            if(io->is_ready && io->event)
+                continue;
+        }
+
+        io->is_ready = false;
+        uring_io_release(io);
+    }
+
+    event_observer.ready_count -= count;
+    memmove(event_observer.ready, &event_observer.ready[count]
+            , event_observer.ready_count * sizeof(event_io_t *));
+}
+
+/* the event is closed. with is_close the descriptor is closed when queued data is sent */
+static void uring_io_detach(event_io_t *io, bool is_close)
+{
+    asc_event_t *event = io->event;
+    io->event = NULL;
+    event->io = NULL;
+
+    if(io->is_recv)
+    {
+        struct io_uring_sqe *sqe = uring_get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t)io | EV_URING_RECV;
+        sqe->user_data = EV_URING_NOP;
+    }
+
+    while(io->rx_count > 0)
+    {
+        if(io->type == EVENT_IO_LISTEN)
+            close(io->rx[io->rx_head].value);
+        uring_rx_pop(io);
+    }
+
+    io->is_close = is_close;
+    if(!is_close || io->error)
+    {
+        // descriptor is closed by the caller. drop data not passed to the kernel
+        io->tx_len = io->tx_busy;
+        io->tx_seg_count = io->tx_seg_busy;
+    }
+
+    if(is_close && !io->tx_len)
+    {
+        close(io->fd);
+        io->fd = -1;
+    }
+    else if(io->tx_len > io->tx_busy)
+    {
+        uring_io_flush_queue(io);
+    }
+
+    uring_io_release(io);
+}
+
+static void uring_io_destroy(void)
+{
+    while(event_observer.io_list)
+    {
+        event_io_t *io = event_observer.io_list;
+        io->inflight = 0;
+        io->tx_len = 0;
+        io->is_flush = false;
+        io->is_ready = false;
+        uring_io_release(io);
+    }
+}
+
+static void uring_cancel(asc_event_t *event)
+{
+    if(!event->is_armed)
+        return;
+
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = event_handle(event);
+    sqe->user_data = EV_URING_NOP;
+
+    event->is_armed = false;
+    // completion of the removed request is stale
+    ++event->seq;
+}
+
+static void uring_queue(asc_event_t *event)
+{
+    if(event->is_queued)
+        return;
+
+    if(event_observer.queue_count == event_observer.queue_size)
+    {
+        event_observer.queue_size = (event_observer.queue_size)
+                                  ? event_observer.queue_size * 2
+                                  : 64;
+        event_observer.queue = realloc(event_observer.queue
+                                       , event_observer.queue_size * sizeof(asc_event_t *));
+        asc_assert(event_observer.queue != NULL, MSG("failed to allocate event queue"));
+    }
+
+    event->is_queued = true;
+    event->queue_idx = event_observer.queue_count;
+    event_observer.queue[event_observer.queue_count++] = event;
+}
+
+static inline uint32_t uring_mask(asc_event_t *event)
+{
+    uint32_t mask = POLLERR | POLLRDHUP;
+
+    const event_io_t *io = event->io;
+    if(io)
+    {
+        // data is received by the ring. poll waits for errors and connection
+        mask = POLLERR;
+        if(event->on_write && !io->is_connected && io->type == EVENT_IO_CONNECT)
+            mask |= POLLOUT;
+        return mask;
+    }
+
+    if(event->on_read)
+        mask |= POLLIN;
+    if(event->on_write)
+        mask |= POLLOUT;
+    return mask;
+}
+
+static void uring_arm(void)
+{
+    for(size_t i = 0; i < event_observer.queue_count; ++i)
+    {
+        asc_event_t *event = event_observer.queue[i];
+        if(!event)
+            continue;
+
+        event->is_queued = false;
+        if(event->is_armed)
+            continue;
+
+        uint32_t mask = uring_mask(event);
+#if __BYTE_ORDER == __BIG_ENDIAN
+        mask = (mask << 16) | (mask >> 16);
 #endif
 
-struct asc_event_t
+        struct io_uring_sqe *sqe = uring_get_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = event->fd;
+        sqe->poll32_events = mask;
+        sqe->len = (event->io) ? IORING_POLL_ADD_MULTI : 0;
+        sqe->user_data = event_handle(event);
+
+        event->is_armed = true;
+        event->mask = uring_mask(event);
+    }
+    event_observer.queue_count = 0;
+}
+
+static void uring_on_poll(uint64_t data, int res, uint32_t flags)
+{
+    asc_event_t *event = event_lookup(data);
+    if(!event)
+        return;
+
+    event->is_armed = (flags & IORING_CQE_F_MORE) != 0;
+
+    const bool is_rd = (res > 0) && (res & (POLLIN | POLLRDHUP | POLLHUP));
+    const bool is_wr = (res > 0) && (res & POLLOUT);
+    const bool is_er = (res < 0 && res != -ECANCELED) || (res > 0 && (res & POLLERR));
+
+    // slab chunks never move, but the event may be closed by the callback
+#define EV_ALIVE() (event_handle(event) == data)
+    event_io_t *io = event->io;
+    if(io)
+    {
+        // socket with the data path. poll reports connection and errors only
+        const bool is_connect = is_wr && !io->is_connected;
+        if(is_connect && !is_er)
+        {
+            io->is_connected = true;
+            uring_io_flush_queue(io);
+        }
+
+        if(is_connect && event->on_write)
+            event->on_write(event->arg);
+        if(EV_ALIVE() && event->on_error && is_er)
+            event->on_error(event->arg);
+        if(EV_ALIVE() && (!event->is_armed || event->mask != uring_mask(event)))
+        {
+            uring_cancel(event);
+            uring_queue(event);
+        }
+        return;
+    }
+
+    if(event->on_read && is_rd)
+        event->on_read(event->arg);
+    if(EV_ALIVE() && event->on_write && is_wr)
+        event->on_write(event->arg);
+    if(EV_ALIVE() && event->on_error && is_er)
+        event->on_error(event->arg);
+    if(EV_ALIVE() && !event->is_armed)
+        uring_queue(event);
+#undef EV_ALIVE
+}
+
+static void uring_loop(int timeout)
 {
-    int fd;
-    event_callback_t on_read;
-    event_callback_t on_write;
-    event_callback_t on_error;
-    void *arg;
-};
+    uring_arm();
+    uring_io_flush();
+
+    // sockets in the ready list have data to dispatch. don't wait
+    const int ret = (event_observer.ready_count > 0)
+                  ? asc_uring_submit(event_observer.uring, 0)
+                  : asc_uring_wait(event_observer.uring, 1, timeout);
+    asc_utime_update();
+    if(ret == -1)
+    {
+        asc_assert(errno == EINTR || errno == ETIME || errno == EBUSY
+                   , MSG("event observer critical error [%s]"), strerror(errno));
+    }
 
-#if defined(EV_TYPE_KQUEUE) || defined(EV_TYPE_EPOLL)
+    struct io_uring_cqe *cqe;
+    while((cqe = asc_uring_peek_cqe(event_observer.uring)) != NULL)
+    {
+        const uint64_t data = cqe->user_data;
+        const int res = cqe->res;
+        const uint32_t flags = cqe->flags;
+        asc_uring_cqe_seen(event_observer.uring);
 
-/*
- * ooooooooooo oooooooooo    ooooooo  ooooo       ooooo
- *  888    88   888    888 o888   888o 888         888
- *  888ooo8     888oooo88  888     888 888         888
- *  888    oo   888        888o   o888 888      o  888      o
- * o888ooo8888 o888o         88ooo88  o888ooooo88 o888ooooo88
- *
- * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
- *
- * oooo   oooo ooooooo  ooooo  oooo ooooooooooo ooooo  oooo ooooooooooo
- *  888  o88 o888   888o 888    88   888    88   888    88   888    88
- *  888888   888     888 888    88   888ooo8     888    88   888ooo8
- *  888  88o 888o  8o888 888    88   888    oo   888    88   888    oo
- * o888o o888o 88ooo88    888oo88   o888ooo8888   888oo88   o888ooo8888
- *                  88o8
- */
+        if(data == EV_URING_NOP)
+            continue;
 
-typedef struct
+        event_io_t *io = (event_io_t *)(uintptr_t)(data & ~EV_URING_OP_MASK);
+        switch(data & EV_URING_OP_MASK)
+        {
+            case EV_URING_RECV:
+                uring_on_recv(io, res, flags);
+                break;
+            case EV_URING_SEND:
+                uring_on_send(io, res);
+                break;
+            default:
+                uring_on_poll(data, res, flags);
+                break;
+        }
+    }
+
+    uring_dispatch();
+}
+
+static void uring_subscribe(asc_event_t *event)
 {
-    asc_list_t *event_list;
-    bool is_changed;
+    if(!event->is_armed || event->mask != uring_mask(event))
+    {
+        uring_cancel(event);
+        uring_queue(event);
+    }
 
-    int fd;
-    EV_OTYPE ed_list[EV_LIST_SIZE];
-} event_observer_t;
+    event_io_t *io = event->io;
+    if(io)
+    {
+        uring_io_flush_queue(io);
+        uring_io_ready(io);
+    }
+}
+
+bool asc_event_io_init(asc_event_t *event, event_io_type_t type)
+{
+    if(!event_observer.uring)
+        return false;
+
+    event_io_t *io = event->io;
+    if(!io)
+    {
+        io = calloc(1, sizeof(event_io_t));
+        asc_assert(io != NULL, MSG("failed to allocate socket"));
+        io->event = event;
+        io->fd = event->fd;
+
+        io->next = event_observer.io_list;
+        if(io->next)
+            io->next->prev = io;
+        event_observer.io_list = io;
+        ++event_observer.io_count;
+
+        event->io = io;
+    }
+
+    io->type = type;
+    io->is_connected = (type == EVENT_IO_DGRAM || type == EVENT_IO_STREAM);
+
+    // poll is re-armed as multishot
+    uring_cancel(event);
+    uring_queue(event);
+    uring_io_flush_queue(io);
+
+    return true;
+}
+
+void asc_event_io_close(asc_event_t *event)
+{
+    if(!event)
+        return;
+
+    uring_cancel(event);
+    if(event->is_queued)
+        event_observer.queue[event->queue_idx] = NULL;
+    uring_io_detach(event->io, true);
+
+    event_slab_free(event);
+}
+
+ssize_t asc_event_io_recv(asc_event_t *event, void *buffer, size_t size)
+{
+    event_io_t *io = event->io;
+    uint8_t *dst = buffer;
+    size_t skip = 0;
+
+    while(io->rx_count > 0 && skip < size)
+    {
+        event_rx_t *item = &io->rx[io->rx_head];
+        size_t len = item->size - item->skip;
+        if(len > size - skip)
+            len = size - skip;
+
+        memcpy(&dst[skip], &uring_buffer(item->value)[item->skip], len);
+        skip += len;
+        item->skip += len;
+
+        if(io->type == EVENT_IO_DGRAM)
+        {
+            // rest of the datagram is truncated
+            uring_rx_pop(io);
+            break;
+        }
+        if(item->skip == item->size)
+            uring_rx_pop(io);
+    }
+
+    if(skip > 0)
+    {
+        ++io->rx_read;
+        return skip;
+    }
+
+    if(io->error)
+    {
+        errno = io->error;
+        return -1;
+    }
+    if(io->is_eof)
+        return 0;
+
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t asc_event_io_recv_batch(asc_event_t *event, void *buffer, size_t size
+                                , size_t count, size_t *lens)
+{
+    event_io_t *io = event->io;
+    uint8_t *dst = buffer;
+
+    size_t i = 0;
+    for(; i < count && io->rx_count > 0; ++i)
+    {
+        const event_rx_t *item = &io->rx[io->rx_head];
+        const size_t len = (item->size < size) ? item->size : size;
+        memcpy(&dst[i * size], uring_buffer(item->value), len);
+        lens[i] = len;
+        uring_rx_pop(io);
+    }
+
+    if(i > 0)
+    {
+        ++io->rx_read;
+        return i;
+    }
+
+    if(io->error)
+    {
+        errno = io->error;
+        return -1;
+    }
+
+    return 0;
+}
+
+int asc_event_io_accept(asc_event_t *event)
+{
+    event_io_t *io = event->io;
+    if(!io->rx_count)
+    {
+        errno = (io->error) ? io->error : EAGAIN;
+        return -1;
+    }
+
+    const int fd = io->rx[io->rx_head].value;
+    uring_rx_pop(io);
+    ++io->rx_read;
+    return fd;
+}
+
+ssize_t asc_event_io_send(asc_event_t *event, const struct iovec *iov, int iovcnt)
+{
+    event_io_t *io = event->io;
+    if(io->error)
+    {
+        errno = io->error;
+        return -1;
+    }
+
+    if(!io->tx)
+    {
+        io->tx = malloc(EV_IO_TX_STREAM);
+        asc_assert(io->tx != NULL, MSG("failed to allocate send queue"));
+    }
+
+    // returns 0 if the queue is full
+    size_t total = 0;
+    for(int i = 0; i < iovcnt && io->tx_len < EV_IO_TX_STREAM; ++i)
+    {
+        size_t len = iov[i].iov_len;
+        if(len > EV_IO_TX_STREAM - io->tx_len)
+            len = EV_IO_TX_STREAM - io->tx_len;
+
+        memcpy(&io->tx[io->tx_len], iov[i].iov_base, len);
+        io->tx_len += len;
+        total += len;
+    }
+
+    if(total > 0)
+        uring_io_flush_queue(io);
+
+    return total;
+}
+
+ssize_t asc_event_io_sendto(asc_event_t *event, const struct iovec *iov, size_t count
+                            , const void *addr, size_t addrlen, bool is_gso)
+{
+    event_io_t *io = event->io;
+    if(io->tx_error)
+    {
+        errno = io->tx_error;
+        io->tx_error = 0;
+        return -1;
+    }
+
+    if(!io->tx)
+    {
+        io->tx = malloc(EV_IO_TX_DGRAM);
+        io->tx_seg = malloc(EV_IO_TX_SEGMENTS * sizeof(uint16_t));
+        io->tx_req = malloc(EV_IO_TX_SEGMENTS * sizeof(event_tx_t));
+        asc_assert(io->tx && io->tx_seg && io->tx_req, MSG("failed to allocate send queue"));
+        io->is_gso = is_gso;
+    }
+    if(!is_gso)
+        io->is_gso = false;
+
+    if(addrlen > sizeof(io->addr))
+        addrlen = sizeof(io->addr);
+    memcpy(&io->addr, addr, addrlen);
+    io->addrlen = addrlen;
+
+    // returns number of queued datagrams. 0 if the queue is full
+    size_t i = 0;
+    for(; i < count; ++i)
+    {
+        const size_t len = iov[i].iov_len;
+        if(io->tx_seg_count == EV_IO_TX_SEGMENTS || io->tx_len + len > EV_IO_TX_DGRAM)
+            break;
 
-static event_observer_t event_observer;
+        memcpy(&io->tx[io->tx_len], iov[i].iov_base, len);
+        io->tx_len += len;
+        io->tx_seg[io->tx_seg_count++] = len;
+    }
+
+    if(i > 0)
+        uring_io_flush_queue(io);
+
+    return i;
+}
+
+#endif /* EV_TYPE_IO_URING */
 
 void asc_event_core_init(void)
 {
     memset(&event_observer, 0, sizeof(event_observer));
-    event_observer.event_list = asc_list_init();
+
+#ifdef EV_TYPE_IO_URING
+    if(uring_init())
+        return;
+#endif
 
 #if defined(EV_TYPE_KQUEUE)
     event_observer.fd = kqueue();
@@ -113,44 +1515,73 @@ void asc_event_core_init(void)
 
 void asc_event_core_destroy(void)
 {
-    if(!event_observer.fd)
-        return;
+#ifdef EV_TYPE_IO_URING
+    if(!event_observer.uring)
+#endif
+    {
+        if(!event_observer.fd)
+            return;
 
-    close(event_observer.fd);
-    event_observer.fd = 0;
+        close(event_observer.fd);
+        event_observer.fd = 0;
+    }
 
-    asc_event_t *prev_event = NULL;
-    for(asc_list_first(event_observer.event_list)
-        ; !asc_list_eol(event_observer.event_list)
-        ; asc_list_first(event_observer.event_list))
+    for(uint32_t i = 0; i < event_observer.slab_count * EV_SLAB_CHUNK; ++i)
     {
-        asc_event_t *event = asc_list_data(event_observer.event_list);
-        asc_assert(event != prev_event
-                   , MSG("loop on asc_event_core_destroy() event:%p")
-                   , event);
+        asc_event_t *event = event_slab_get(i);
+        if(!event->is_active)
+            continue;
+
         if(event->on_error)
             event->on_error(event->arg);
-        prev_event = event;
+        asc_assert(!event->is_active
+                   , MSG("loop on asc_event_core_destroy() event:%p")
+                   , event);
     }
 
-    asc_list_destroy(event_observer.event_list);
-    event_observer.event_list = NULL;
+#ifdef EV_TYPE_IO_URING
+    if(event_observer.uring)
+    {
+        uring_destroy();
+        uring_io_destroy();
+    }
+#endif
+
+    event_slab_destroy();
 }
 
 void asc_event_core_loop(void)
 {
-    static struct timespec tv = { 0, 10000000 };
-    if(!asc_list_size(event_observer.event_list))
+    asc_event_core_flush();
+
+    const int timeout = asc_timer_core_timeout(EV_TIMEOUT_MAX);
+    struct timespec tv = { timeout / 1000, (timeout % 1000) * 1000000 };
+#ifdef EV_TYPE_IO_URING
+    // closed sockets may have data to send
+    if(!event_observer.event_count && !event_observer.io_count)
+#else
+    if(!event_observer.event_count)
+#endif
     {
         nanosleep(&tv, NULL);
+        asc_utime_update();
+        return;
+    }
+
+#ifdef EV_TYPE_IO_URING
+    if(event_observer.uring)
+    {
+        uring_loop(timeout);
         return;
     }
+#endif
 
 #if defined(EV_TYPE_KQUEUE)
     const int ret = kevent(event_observer.fd, NULL, 0, event_observer.ed_list, EV_LIST_SIZE, &tv);
 #else
-    const int ret = epoll_wait(event_observer.fd, event_observer.ed_list, EV_LIST_SIZE, 10);
+    const int ret = epoll_wait(event_observer.fd, event_observer.ed_list, EV_LIST_SIZE, timeout);
 #endif
+    asc_utime_update();
 
     if(ret == -1)
     {
@@ -158,39 +1589,42 @@ void asc_event_core_loop(void)
         return;
     }
 
-    event_observer.is_changed = false;
+#if defined(EV_TYPE_KQUEUE)
+    for(int i = 0; i < ret; ++i)
+    {
+        const asc_event_t *event = event_observer.ed_list[i].udata;
+        event_observer.ed_seq[i] = event->seq;
+    }
+#endif
+
+    // callbacks may close and open events. events closed in this batch
+    // have the stale handle and skipped, other events are dispatched
     for(int i = 0; i < ret; ++i)
     {
         EV_OTYPE *ed = &event_observer.ed_list[i];
 #if defined(EV_TYPE_KQUEUE)
         asc_event_t *event = ed->udata;
+        const uint64_t handle = event->id
+                              | ((uint64_t)(event_observer.ed_seq[i] & EV_SEQ_MASK) << 32);
         const bool is_rd = (ed->data > 0) && (ed->filter == EVFILT_READ);
         const bool is_wr = (ed->data > 0) && (ed->filter == EVFILT_WRITE);
         const bool is_er = (!is_rd && !is_wr && (ed->flags & ~EV_ADD));
 #else
-        asc_event_t *event = ed->data.ptr;
+        const uint64_t handle = ed->data.u64;
+        asc_event_t *event = event_slab_get(handle & 0xFFFFFFFF);
         const bool is_rd = ed->events & EPOLLIN;
         const bool is_wr = ed->events & EPOLLOUT;
         const bool is_er = ed->events & EPOLLERR;
 #endif
-        if(event->on_read && is_rd)
-        {
+
+#define EV_ALIVE() (event_handle(event) == handle)
+        if(EV_ALIVE() && event->on_read && is_rd)
             event->on_read(event->arg);
-            if(event_observer.is_changed)
-                break;
-        }
-        if(event->on_write && is_wr)
-        {
+        if(EV_ALIVE() && event->on_write && is_wr)
             event->on_write(event->arg);
-            if(event_observer.is_changed)
-                break;
-        }
-        if(event->on_error && is_er)
-        {
+        if(EV_ALIVE() && event->on_error && is_er)
             event->on_error(event->arg);
-            if(event_observer.is_changed)
-                break;
-        }
+#undef EV_ALIVE
     }
 }
 
@@ -233,7 +1667,15 @@ static void asc_event_subscribe(asc_event_t *event)
 
 #else /* EV_TYPE_EPOLL */
 
-    ed.data.ptr = event;
+#ifdef EV_TYPE_IO_URING
+    if(event_observer.uring)
+    {
+        uring_subscribe(event);
+        return;
+    }
+#endif
+
+    ed.data.u64 = event_handle(event);
     ed.events = EV_FLAGS;
     if(event->on_read)
         ed.events |= EPOLLIN;
@@ -247,20 +1689,24 @@ static void asc_event_subscribe(asc_event_t *event)
 
 asc_event_t * asc_event_init(int fd, void *arg)
 {
-    asc_event_t *event = calloc(1, sizeof(asc_event_t));
+    asc_event_t *event = event_slab_alloc();
     event->fd = fd;
     event->arg = arg;
 
 #if defined(EV_TYPE_EPOLL)
-    EV_OTYPE ed;
-    ed.data.ptr = event;
-    ed.events = EV_FLAGS;
-    const int ret = epoll_ctl(event_observer.fd, EPOLL_CTL_ADD, event->fd, &ed);
-    asc_assert(ret != -1, MSG("failed to attach fd=%d [%s]"), event->fd, strerror(errno));
+#ifdef EV_TYPE_IO_URING
+    if(event_observer.uring)
+        uring_queue(event);
+    else
+#endif
+    {
+        EV_OTYPE ed;
+        ed.data.u64 = event_handle(event);
+        ed.events = EV_FLAGS;
+        const int ret = epoll_ctl(event_observer.fd, EPOLL_CTL_ADD, event->fd, &ed);
+        asc_assert(ret != -1, MSG("failed to attach fd=%d [%s]"), event->fd, strerror(errno));
+    }
 #endif
-
-    asc_list_insert_tail(event_observer.event_list, event);
-    event_observer.is_changed = true;
 
     return event;
 }
@@ -286,13 +1732,21 @@ void asc_event_close(asc_event_t *event)
 
 #else /* EV_TYPE_EPOLL */
 
-    epoll_ctl(event_observer.fd, EPOLL_CTL_DEL, event->fd, NULL);
+#ifdef EV_TYPE_IO_URING
+    if(event_observer.uring)
+    {
+        uring_cancel(event);
+        if(event->is_queued)
+            event_observer.queue[event->queue_idx] = NULL;
+        if(event->io)
+            uring_io_detach(event->io, false);
+    }
+    else
+#endif
+        epoll_ctl(event_observer.fd, EPOLL_CTL_DEL, event->fd, NULL);
 #endif
 
-    event_observer.is_changed = true;
-    asc_list_remove_item(event_observer.event_list, event);
-
-    free(event);
+    event_slab_free(event);
 }
 
 #elif defined(EV_TYPE_POLL)
@@ -317,7 +1771,7 @@ typedef struct
 
 #define ED_SIZE (int)(sizeof(struct pollfd))
 
-static event_observer_t event_observer;
+static __thread event_observer_t event_observer;
 
 void asc_event_core_init(void)
 {
@@ -342,14 +1796,19 @@ void asc_event_core_destroy(void)
 
 void asc_event_core_loop(void)
 {
-    static struct timespec tv = { 0, 10000000 };
+    asc_event_core_flush();
+
+    const int timeout = asc_timer_core_timeout(EV_TIMEOUT_MAX);
     if(!event_observer.fd_count)
     {
+        struct timespec tv = { timeout / 1000, (timeout % 1000) * 1000000 };
         nanosleep(&tv, NULL);
+        asc_utime_update();
         return;
     }
 
-    int ret = poll(event_observer.fd_list, event_observer.fd_count, 10);
+    int ret = poll(event_observer.fd_list, event_observer.fd_count, timeout);
+    asc_utime_update();
     if(ret == -1)
     {
         asc_assert(errno == EINTR, MSG("event observer critical error [%s]"), strerror(errno));
@@ -470,7 +1929,7 @@ typedef struct
     fd_set emaster;
 } event_observer_t;
 
-static event_observer_t event_observer;
+static __thread event_observer_t event_observer;
 
 void asc_event_core_init(void)
 {
@@ -500,14 +1959,18 @@ void asc_event_core_destroy(void)
 
 void asc_event_core_loop(void)
 {
+    asc_event_core_flush();
+
+    const int timeout = asc_timer_core_timeout(EV_TIMEOUT_MAX);
     if(!asc_list_size(event_observer.event_list))
     {
 #ifdef _WIN32
-        Sleep(10);
+        Sleep(timeout);
 #else
-        static struct timespec tv = { .tv_sec = 0, .tv_nsec = 10000000 };
+        struct timespec tv = { .tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000 };
         nanosleep(&tv, NULL);
 #endif
+        asc_utime_update();
         return;
     }
 
@@ -518,8 +1981,9 @@ void asc_event_core_loop(void)
     memcpy(&wset, &event_observer.wmaster, sizeof(wset));
     memcpy(&eset, &event_observer.emaster, sizeof(eset));
 
-    static struct timeval timeout = { .tv_sec = 0, .tv_usec = 10000 };
-    const int ret = select(event_observer.max_fd + 1, &rset, &wset, &eset, &timeout);
+    struct timeval tv = { .tv_sec = timeout / 1000, .tv_usec = (timeout % 1000) * 1000 };
+    const int ret = select(event_observer.max_fd + 1, &rset, &wset, &eset, &tv);
+    asc_utime_update();
     if(ret == -1)
     {
 #ifdef _WIN32
@@ -632,6 +2096,72 @@ void asc_event_close(asc_event_t *event)
 
 #endif
 
+#ifndef EV_TYPE_IO_URING
+
+bool asc_event_io_init(asc_event_t *event, event_io_type_t type)
+{
+    __uarg(event);
+    __uarg(type);
+    return false;
+}
+
+void asc_event_io_close(asc_event_t *event)
+{
+    asc_event_close(event);
+}
+
+ssize_t asc_event_io_recv(asc_event_t *event, void *buffer, size_t size)
+{
+    __uarg(event);
+    __uarg(buffer);
+    __uarg(size);
+    errno = ENOTSUP;
+    return -1;
+}
+
+ssize_t asc_event_io_recv_batch(asc_event_t *event, void *buffer, size_t size
+                                , size_t count, size_t *lens)
+{
+    __uarg(event);
+    __uarg(buffer);
+    __uarg(size);
+    __uarg(count);
+    __uarg(lens);
+    errno = ENOTSUP;
+    return -1;
+}
+
+int asc_event_io_accept(asc_event_t *event)
+{
+    __uarg(event);
+    errno = ENOTSUP;
+    return -1;
+}
+
+ssize_t asc_event_io_send(asc_event_t *event, const struct iovec *iov, int iovcnt)
+{
+    __uarg(event);
+    __uarg(iov);
+    __uarg(iovcnt);
+    errno = ENOTSUP;
+    return -1;
+}
+
+ssize_t asc_event_io_sendto(asc_event_t *event, const struct iovec *iov, size_t count
+                            , const void *addr, size_t addrlen, bool is_gso)
+{
+    __uarg(event);
+    __uarg(iov);
+    __uarg(count);
+    __uarg(addr);
+    __uarg(addrlen);
+    __uarg(is_gso);
+    errno = ENOTSUP;
+    return -1;
+}
+
+#endif /* !EV_TYPE_IO_URING */
+
 /*
  *   oooooooo8   ooooooo  oooo     oooo oooo     oooo  ooooooo  oooo   oooo
  * o888     88 o888   888o 8888o   888   8888o   888 o888   888o 8888o  88
@@ -667,3 +2197,45 @@ void asc_event_set_on_error(asc_event_t *event, event_callback_t on_error)
     event->on_error = on_error;
     asc_event_subscribe(event);
 }
+
+/*
+ * ooooooooooo ooooo       ooooo  oooo  oooooooo8 ooooo ooooo
+ *  888    88   888         888    88  888         888   888
+ *  888ooo8     888         888    88   888oooooo  888ooo888
+ *  888         888      o  888    88          888 888   888
+ * o888o       o888ooooo88   888oo88   o88oooo888 o888o o888o
+ *
+ */
+
+void asc_event_core_flush(void)
+{
+    for(int i = 0; i < event_flush_count; ++i)
+        event_flush_list[i].callback(event_flush_list[i].arg);
+}
+
+void asc_event_flush_attach(event_callback_t callback, void *arg)
+{
+    for(int i = 0; i < event_flush_count; ++i)
+    {
+        if(event_flush_list[i].callback == callback && event_flush_list[i].arg == arg)
+            return;
+    }
+
+    asc_assert(event_flush_count < EV_FLUSH_MAX, "[core/event] flush list is full");
+    event_flush_list[event_flush_count].callback = callback;
+    event_flush_list[event_flush_count].arg = arg;
+    ++event_flush_count;
+}
+
+void asc_event_flush_detach(event_callback_t callback, void *arg)
+{
+    for(int i = 0; i < event_flush_count; ++i)
+    {
+        if(event_flush_list[i].callback == callback && event_flush_list[i].arg == arg)
+        {
+            --event_flush_count;
+            event_flush_list[i] = event_flush_list[event_flush_count];
+            return;
+        }
+    }
+}
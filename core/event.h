@@ -30,6 +30,11 @@ void asc_event_core_init(void);
 void asc_event_core_loop(void);
 void asc_event_core_destroy(void);
 
+/* called once per loop iteration, before waiting for events */
+void asc_event_core_flush(void);
+void asc_event_flush_attach(event_callback_t callback, void *arg);
+void asc_event_flush_detach(event_callback_t callback, void *arg);
+
 asc_event_t * asc_event_init(int fd, void *arg) __wur;
 void asc_event_set_on_read(asc_event_t *event, event_callback_t on_read);
 void asc_event_set_on_write(asc_event_t *event, event_callback_t on_write);
@@ -37,4 +42,34 @@ void asc_event_set_on_error(asc_event_t *event, event_callback_t on_error);
 
 void asc_event_close(asc_event_t *event);
 
+/*
+ * Data path of the event loop. With the io_uring backend data of the socket
+ * is received by the multishot requests into the buffer ring and queued data
+ * is sent with the wait for events. asc_event_io_init() returns false if
+ * the event loop has no data path, socket should be used directly.
+ */
+
+struct iovec;
+
+typedef enum
+{
+    EVENT_IO_DGRAM = 1,
+    EVENT_IO_STREAM,    /* connected stream socket */
+    EVENT_IO_CONNECT,   /* stream socket. connected on the write event */
+    EVENT_IO_LISTEN
+} event_io_type_t;
+
+bool asc_event_io_init(asc_event_t *event, event_io_type_t type) __wur;
+/* closes the event and the descriptor when queued data is sent */
+void asc_event_io_close(asc_event_t *event);
+
+ssize_t asc_event_io_recv(asc_event_t *event, void *buffer, size_t size) __wur;
+ssize_t asc_event_io_recv_batch(asc_event_t *event, void *buffer, size_t size
+                                , size_t count, size_t *lens) __wur;
+int asc_event_io_accept(asc_event_t *event) __wur;
+
+ssize_t asc_event_io_send(asc_event_t *event, const struct iovec *iov, int iovcnt) __wur;
+ssize_t asc_event_io_sendto(asc_event_t *event, const struct iovec *iov, size_t count
+                            , const void *addr, size_t addrlen, bool is_gso) __wur;
+
 #endif /* _EVENT_H_ */
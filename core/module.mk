@@ -1,5 +1,5 @@
 
-SOURCES="event.c list.c log.c socket.c thread.c timer.c utils.c"
+SOURCES="buffer.c event.c list.c log.c reactor.c ring.c socket.c thread.c timer.c uring.c utils.c"
 
 clock_gettime_test_c()
 {
@@ -21,3 +21,24 @@ if check_clock_gettime ; then
     CFLAGS="-DHAVE_CLOCK_GETTIME=1"
     LDFLAGS="-lrt"
 fi
+
+io_uring_test_c()
+{
+    cat <<EOF
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+int main(void) {
+    struct io_uring_params p;
+    return __NR_io_uring_setup + IORING_OP_WRITEV + IORING_OFF_SQES + sizeof(p);
+}
+EOF
+}
+
+check_io_uring()
+{
+    io_uring_test_c | $APP_C -Werror $CFLAGS $APP_CFLAGS -o /dev/null -x c - >/dev/null 2>&1
+}
+
+if check_io_uring ; then
+    CFLAGS="$CFLAGS -DHAVE_IO_URING=1"
+fi
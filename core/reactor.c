@@ -0,0 +1,331 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assert.h"
+#include "reactor.h"
+#include "event.h"
+#include "log.h"
+#include "thread.h"
+#include "timer.h"
+
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <pthread.h>
+#endif
+
+#define MSG(_msg) "[core/reactor] " _msg
+
+#ifndef _WIN32
+
+typedef struct reactor_call_t reactor_call_t;
+struct reactor_call_t
+{
+    reactor_callback_t callback;
+    void *arg;
+
+    bool is_wait;
+    bool is_done;
+
+    reactor_call_t *next;
+};
+
+struct asc_reactor_t
+{
+    int id;
+
+    asc_thread_t *thread;
+    bool is_started;
+    bool is_stopped;
+
+    int wake_fd[2];
+    asc_event_t *wake_event;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    reactor_call_t *queue_head;
+    reactor_call_t *queue_tail;
+};
+
+static asc_reactor_t *reactor_list[ASC_REACTOR_MAX];
+static __thread asc_reactor_t *reactor_current = NULL;
+
+static void reactor_on_wake(void *arg)
+{
+    asc_reactor_t *reactor = arg;
+
+    uint8_t buffer[64];
+    while(read(reactor->wake_fd[0], buffer, sizeof(buffer)) == sizeof(buffer))
+        ;
+
+    // deliver pending data before the stream tree is changed by the calls
+    asc_event_core_flush();
+
+    pthread_mutex_lock(&reactor->lock);
+    reactor_call_t *call = reactor->queue_head;
+    reactor->queue_head = NULL;
+    reactor->queue_tail = NULL;
+    pthread_mutex_unlock(&reactor->lock);
+
+    while(call)
+    {
+        reactor_call_t *next = call->next;
+        call->callback(call->arg);
+
+        if(call->is_wait)
+        {
+            pthread_mutex_lock(&reactor->lock);
+            call->is_done = true;
+            pthread_cond_broadcast(&reactor->cond);
+            pthread_mutex_unlock(&reactor->lock);
+        }
+        else
+            free(call);
+
+        call = next;
+    }
+}
+
+static void reactor_open(asc_reactor_t *reactor)
+{
+    reactor_current = reactor;
+
+    reactor->wake_event = asc_event_init(reactor->wake_fd[0], reactor);
+    asc_event_set_on_read(reactor->wake_event, reactor_on_wake);
+}
+
+static void reactor_close(asc_reactor_t *reactor)
+{
+    asc_event_close(reactor->wake_event);
+    reactor->wake_event = NULL;
+
+    reactor_current = NULL;
+}
+
+static void reactor_stop(void *arg)
+{
+    asc_reactor_t *reactor = arg;
+    reactor->is_stopped = true;
+}
+
+static void reactor_thread_loop(void *arg)
+{
+    asc_reactor_t *reactor = arg;
+
+    asc_timer_core_init();
+    asc_event_core_init();
+    reactor_open(reactor);
+
+    pthread_mutex_lock(&reactor->lock);
+    reactor->is_started = true;
+    pthread_cond_broadcast(&reactor->cond);
+    pthread_mutex_unlock(&reactor->lock);
+
+    while(!reactor->is_stopped)
+    {
+        asc_event_core_loop();
+        asc_timer_core_loop();
+    }
+
+    reactor_close(reactor);
+    asc_event_core_destroy();
+    asc_timer_core_destroy();
+}
+
+static asc_reactor_t * reactor_init(int id)
+{
+    asc_reactor_t *reactor = calloc(1, sizeof(asc_reactor_t));
+    reactor->id = id;
+
+    const int ret = pipe(reactor->wake_fd);
+    asc_assert(ret == 0, MSG("failed to open pipe [%s]"), strerror(errno));
+    fcntl(reactor->wake_fd[0], F_SETFL, fcntl(reactor->wake_fd[0], F_GETFL) | O_NONBLOCK);
+    fcntl(reactor->wake_fd[1], F_SETFL, fcntl(reactor->wake_fd[1], F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_init(&reactor->lock, NULL);
+    pthread_cond_init(&reactor->cond, NULL);
+
+    return reactor;
+}
+
+static void reactor_destroy(asc_reactor_t *reactor)
+{
+    close(reactor->wake_fd[0]);
+    close(reactor->wake_fd[1]);
+
+    pthread_mutex_destroy(&reactor->lock);
+    pthread_cond_destroy(&reactor->cond);
+
+    free(reactor);
+}
+
+void asc_reactor_core_init(void)
+{
+    memset(reactor_list, 0, sizeof(reactor_list));
+
+    // main loop is a reactor with id 0
+    asc_reactor_t *reactor = reactor_init(0);
+    reactor->is_started = true;
+    reactor_open(reactor);
+    reactor_list[0] = reactor;
+}
+
+void asc_reactor_core_destroy(void)
+{
+    for(int i = 1; i < ASC_REACTOR_MAX; ++i)
+    {
+        asc_reactor_t *reactor = reactor_list[i];
+        if(!reactor)
+            continue;
+
+        asc_reactor_call(reactor, reactor_stop, reactor);
+        asc_thread_destroy(&reactor->thread);
+        reactor_destroy(reactor);
+        reactor_list[i] = NULL;
+    }
+
+    asc_reactor_t *reactor = reactor_list[0];
+    if(reactor)
+    {
+        reactor_on_wake(reactor);
+        reactor_close(reactor);
+        reactor_destroy(reactor);
+        reactor_list[0] = NULL;
+    }
+}
+
+asc_reactor_t * asc_reactor_get(int id)
+{
+    asc_assert(id >= 0 && id < ASC_REACTOR_MAX
+               , MSG("reactor id must be in range 0..%d"), ASC_REACTOR_MAX - 1);
+
+    asc_reactor_t *reactor = reactor_list[id];
+    if(reactor)
+        return reactor;
+
+    reactor = reactor_init(id);
+    reactor_list[id] = reactor;
+
+    asc_thread_init(&reactor->thread, reactor_thread_loop, reactor);
+
+    pthread_mutex_lock(&reactor->lock);
+    while(!reactor->is_started)
+        pthread_cond_wait(&reactor->cond, &reactor->lock);
+    pthread_mutex_unlock(&reactor->lock);
+
+    asc_log_debug(MSG("reactor %d started"), id);
+
+    return reactor;
+}
+
+asc_reactor_t * asc_reactor_current(void)
+{
+    return (reactor_current) ? reactor_current : reactor_list[0];
+}
+
+static void reactor_push(asc_reactor_t *reactor, reactor_call_t *call)
+{
+    pthread_mutex_lock(&reactor->lock);
+    const bool is_empty = (reactor->queue_head == NULL);
+    if(is_empty)
+        reactor->queue_head = call;
+    else
+        reactor->queue_tail->next = call;
+    reactor->queue_tail = call;
+    pthread_mutex_unlock(&reactor->lock);
+
+    // wake up the reactor only on empty queue
+    if(is_empty && write(reactor->wake_fd[1], "", 1) == -1 && errno != EAGAIN)
+        asc_log_error(MSG("failed to wake reactor %d [%s]"), reactor->id, strerror(errno));
+}
+
+void asc_reactor_call(asc_reactor_t *reactor, reactor_callback_t callback, void *arg)
+{
+    if(!reactor)
+        reactor = reactor_list[0];
+
+    reactor_call_t *call = calloc(1, sizeof(reactor_call_t));
+    call->callback = callback;
+    call->arg = arg;
+
+    reactor_push(reactor, call);
+}
+
+void asc_reactor_call_wait(asc_reactor_t *reactor, reactor_callback_t callback, void *arg)
+{
+    if(!reactor)
+        reactor = reactor_list[0];
+
+    if(reactor == asc_reactor_current())
+    {
+        callback(arg);
+        return;
+    }
+
+    reactor_call_t call;
+    memset(&call, 0, sizeof(call));
+    call.callback = callback;
+    call.arg = arg;
+    call.is_wait = true;
+
+    reactor_push(reactor, &call);
+
+    pthread_mutex_lock(&reactor->lock);
+    while(!call.is_done)
+        pthread_cond_wait(&reactor->cond, &reactor->lock);
+    pthread_mutex_unlock(&reactor->lock);
+}
+
+#else /* _WIN32 */
+
+void asc_reactor_core_init(void)
+{
+    ;
+}
+
+void asc_reactor_core_destroy(void)
+{
+    ;
+}
+
+asc_reactor_t * asc_reactor_get(int id)
+{
+    if(id != 0)
+        asc_log_warning(MSG("reactors are not supported. use main loop"));
+    return NULL;
+}
+
+asc_reactor_t * asc_reactor_current(void)
+{
+    return NULL;
+}
+
+void asc_reactor_call(asc_reactor_t *reactor, reactor_callback_t callback, void *arg)
+{
+    __uarg(reactor);
+    callback(arg);
+}
+
+void asc_reactor_call_wait(asc_reactor_t *reactor, reactor_callback_t callback, void *arg)
+{
+    __uarg(reactor);
+    callback(arg);
+}
+
+#endif /* ! _WIN32 */
@@ -0,0 +1,50 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_ 1
+
+#include "base.h"
+
+/*
+ * Reactor is an additional event loop running in its own thread with its own
+ * event observer and timers. Events and timers created inside the reactor
+ * thread belong to that reactor. Other threads talk to it only through
+ * asc_reactor_call() and asc_reactor_call_wait().
+ * NULL reactor is the main loop.
+ */
+
+#ifndef ASC_REACTOR_MAX
+#   define ASC_REACTOR_MAX 64
+#endif
+
+typedef struct asc_reactor_t asc_reactor_t;
+typedef void (*reactor_callback_t)(void *);
+
+void asc_reactor_core_init(void);
+void asc_reactor_core_destroy(void);
+
+asc_reactor_t * asc_reactor_get(int id) __wur;
+asc_reactor_t * asc_reactor_current(void) __wur;
+
+void asc_reactor_call(asc_reactor_t *reactor, reactor_callback_t callback, void *arg);
+void asc_reactor_call_wait(asc_reactor_t *reactor, reactor_callback_t callback, void *arg);
+
+#endif /* _REACTOR_H_ */
@@ -0,0 +1,272 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assert.h"
+#include "ring.h"
+#include "log.h"
+
+#include <fcntl.h>
+#if defined(__linux)
+#   include <sys/eventfd.h>
+#   define RING_EVENTFD
+#endif
+
+#define MSG(_msg) "[core/ring] " _msg
+
+#ifndef RING_CACHE_LINE
+#   define RING_CACHE_LINE 64
+#endif
+
+struct asc_ring_t
+{
+    uint8_t *buffer;
+    size_t item_size;
+    size_t mask;
+
+    bool is_event;
+    int fd[2]; // [0] - read, [1] - write. same descriptor for eventfd
+
+    // producer
+    size_t head __attribute__(( __aligned__(RING_CACHE_LINE) ));
+    size_t tail_cache;
+
+    // consumer
+    size_t tail __attribute__(( __aligned__(RING_CACHE_LINE) ));
+    size_t head_cache;
+};
+
+asc_ring_t * asc_ring_init(size_t item_size, size_t item_count, bool is_event)
+{
+    asc_assert(item_size > 0 && item_count > 0, MSG("wrong ring size"));
+
+    size_t size = 1;
+    while(size < item_count)
+        size <<= 1;
+
+    asc_ring_t *ring = NULL;
+#ifndef _WIN32
+    if(posix_memalign((void **)&ring, RING_CACHE_LINE, sizeof(asc_ring_t)))
+        ring = NULL;
+#else
+    ring = malloc(sizeof(asc_ring_t));
+#endif
+    asc_assert(ring != NULL, MSG("failed to allocate ring"));
+    memset(ring, 0, sizeof(asc_ring_t));
+
+    ring->item_size = item_size;
+    ring->mask = size - 1;
+    ring->buffer = malloc(item_size * size);
+    asc_assert(ring->buffer != NULL, MSG("failed to allocate ring buffer"));
+
+    ring->is_event = is_event;
+    if(is_event)
+    {
+#ifdef RING_EVENTFD
+        ring->fd[0] = eventfd(0, EFD_NONBLOCK);
+        ring->fd[1] = ring->fd[0];
+        asc_assert(ring->fd[0] != -1, MSG("failed to open eventfd [%s]"), strerror(errno));
+#else
+        const int ret = pipe(ring->fd);
+        asc_assert(ret == 0, MSG("failed to open pipe [%s]"), strerror(errno));
+        fcntl(ring->fd[0], F_SETFL, fcntl(ring->fd[0], F_GETFL) | O_NONBLOCK);
+        fcntl(ring->fd[1], F_SETFL, fcntl(ring->fd[1], F_GETFL) | O_NONBLOCK);
+#endif
+    }
+
+    return ring;
+}
+
+void asc_ring_destroy(asc_ring_t *ring)
+{
+    if(!ring)
+        return;
+
+    if(ring->is_event)
+    {
+        close(ring->fd[0]);
+        if(ring->fd[1] != ring->fd[0])
+            close(ring->fd[1]);
+    }
+
+    free(ring->buffer);
+    free(ring);
+}
+
+int asc_ring_fd(asc_ring_t *ring)
+{
+    return ring->fd[0];
+}
+
+size_t asc_ring_size(asc_ring_t *ring)
+{
+    return ring->mask + 1;
+}
+
+/*
+ * oooooooooo oooooooooo    ooooooo  ooooooooo  ooooo  oooo  oooooooo8 ooooooooooo
+ *  888    888 888    888 o888   888o 888    88o 888    88 o888     88 88  888  88
+ *  888oooo88  888oooo88  888     888 888    888 888    88 888             888
+ *  888        888  88o   888o   o888 888    888 888    88 888o     oo     888
+ * o888o      o888o  88o8   88ooo88  o888ooo88    888oo88   888oooo88     o888o
+ *
+ */
+
+static void ring_wake(asc_ring_t *ring)
+{
+#ifdef RING_EVENTFD
+    const uint64_t value = 1;
+#else
+    const uint8_t value = 1;
+#endif
+    if(write(ring->fd[1], &value, sizeof(value)) == -1 && errno != EAGAIN)
+        asc_log_error(MSG("failed to wake consumer [%s]"), strerror(errno));
+}
+
+size_t asc_ring_push(asc_ring_t *ring, const void *items, size_t count)
+{
+    const size_t size = ring->mask + 1;
+    const size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    if(size - (head - ring->tail_cache) < count)
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    const size_t space = size - (head - ring->tail_cache);
+    if(count > space)
+        count = space;
+    if(!count)
+        return 0;
+
+    const size_t idx = head & ring->mask;
+    const size_t part = (count > size - idx) ? (size - idx) : count;
+    memcpy(&ring->buffer[idx * ring->item_size], items, part * ring->item_size);
+    if(part < count)
+    {
+        memcpy(ring->buffer
+               , (const uint8_t *)items + part * ring->item_size
+               , (count - part) * ring->item_size);
+    }
+
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+
+    if(ring->is_event)
+    {
+        // pairs with the fence in asc_ring_peek(). wake the consumer only if
+        // the ring was empty before this push
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        if(ring->tail_cache == head)
+            ring_wake(ring);
+    }
+
+    return count;
+}
+
+/*
+ *   oooooooo8   ooooooo  oooo   oooo  oooooooo8 ooooo  oooo oooo     oooo ooooooooooo oooooooooo
+ * o888     88 o888   888o 8888o  88  888         888    88   8888o   888   888    88   888    888
+ * 888         888     888 88 888o88   888oooooo  888    88   88 888o8 88   888ooo8     888oooo88
+ * 888o     oo 888o   o888 88   8888          888 888    88   88  888  88   888    oo   888  88o
+ *  888oooo88    88ooo88  o88o    88  o88oooo888   888oo88   o88o  8  o88o o888ooo8888 o888o  88o8
+ *
+ */
+
+size_t asc_ring_count(asc_ring_t *ring)
+{
+    ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return ring->head_cache - ring->tail;
+}
+
+const void * asc_ring_item(asc_ring_t *ring, size_t idx)
+{
+    return &ring->buffer[((ring->tail + idx) & ring->mask) * ring->item_size];
+}
+
+size_t asc_ring_peek(asc_ring_t *ring, const void **items)
+{
+    const size_t tail = ring->tail;
+
+    if(ring->head_cache == tail)
+    {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if(ring->head_cache == tail && ring->is_event)
+        {
+            // the ring looks empty. check again after the fence,
+            // otherwise the producer may skip the wake up
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        }
+        if(ring->head_cache == tail)
+            return 0;
+    }
+
+    const size_t size = ring->mask + 1;
+    const size_t idx = tail & ring->mask;
+    size_t count = ring->head_cache - tail;
+    if(count > size - idx)
+        count = size - idx;
+
+    *items = &ring->buffer[idx * ring->item_size];
+    return count;
+}
+
+void asc_ring_release(asc_ring_t *ring, size_t count)
+{
+    __atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+size_t asc_ring_pop(asc_ring_t *ring, void *items, size_t count)
+{
+    size_t total = 0;
+    const void *ptr;
+
+    while(total < count)
+    {
+        size_t part = asc_ring_peek(ring, &ptr);
+        if(!part)
+            break;
+        if(part > count - total)
+            part = count - total;
+
+        memcpy((uint8_t *)items + total * ring->item_size, ptr, part * ring->item_size);
+        asc_ring_release(ring, part);
+        total += part;
+    }
+
+    return total;
+}
+
+void asc_ring_flush(asc_ring_t *ring)
+{
+    ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->tail, ring->head_cache, __ATOMIC_RELEASE);
+}
+
+void asc_ring_wait_reset(asc_ring_t *ring)
+{
+#ifdef RING_EVENTFD
+    uint64_t value;
+    if(read(ring->fd[0], &value, sizeof(value)) == -1 && errno != EAGAIN)
+        asc_log_error(MSG("failed to read eventfd [%s]"), strerror(errno));
+#else
+    uint8_t buffer[64];
+    while(read(ring->fd[0], buffer, sizeof(buffer)) == sizeof(buffer))
+        ;
+#endif
+}
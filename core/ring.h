@@ -0,0 +1,56 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RING_H_
+#define _RING_H_ 1
+
+#include "base.h"
+
+/*
+ * Lock-free single-producer/single-consumer ring of fixed size items.
+ * Producer and consumer may run in different threads. If the ring is created
+ * with is_event, then asc_ring_fd() becomes readable when the ring turns from
+ * empty to non-empty. Consumer should call asc_ring_wait_reset() and then
+ * drain the ring with asc_ring_peek()/asc_ring_release() or asc_ring_pop().
+ */
+
+typedef struct asc_ring_t asc_ring_t;
+
+asc_ring_t * asc_ring_init(size_t item_size, size_t item_count, bool is_event) __wur;
+void asc_ring_destroy(asc_ring_t *ring);
+
+int asc_ring_fd(asc_ring_t *ring) __wur;
+size_t asc_ring_size(asc_ring_t *ring) __wur;
+
+/* producer */
+
+size_t asc_ring_push(asc_ring_t *ring, const void *items, size_t count);
+
+/* consumer */
+
+size_t asc_ring_count(asc_ring_t *ring) __wur;
+const void * asc_ring_item(asc_ring_t *ring, size_t idx) __wur;
+size_t asc_ring_peek(asc_ring_t *ring, const void **items) __wur;
+void asc_ring_release(asc_ring_t *ring, size_t count);
+size_t asc_ring_pop(asc_ring_t *ring, void *items, size_t count);
+void asc_ring_flush(asc_ring_t *ring);
+void asc_ring_wait_reset(asc_ring_t *ring);
+
+#endif /* _RING_H_ */
@@ -40,6 +40,14 @@
 #   include <netdb.h>
 #endif
 
+#ifdef __linux__
+#   include <netinet/udp.h>
+#endif
+
+/* limits for the one UDP_SEGMENT (GSO) send call */
+#define SOCKET_GSO_SEGMENTS 64
+#define SOCKET_GSO_SIZE 65000
+
 #define MSG(_msg) "[core/socket %d]" _msg, sock->fd
 
 struct asc_socket_t
@@ -49,12 +57,22 @@ struct asc_socket_t
     int type;
 
     asc_event_t *event;
+    bool is_io; /* data is received and sent by the event loop */
 
     struct sockaddr_in addr;
     struct sockaddr_in sockaddr; /* recvfrom, sendto, set_sockaddr */
 
     struct ip_mreq mreq;
 
+    int gso; /* UDP_SEGMENT: 0 - not checked, 1 - supported, -1 - not supported */
+
+#ifdef __linux__
+    /* recvmmsg/sendmmsg headers. grows up to the largest batch */
+    struct mmsghdr *msg;
+    struct iovec *iov;
+    size_t msg_size;
+#endif
+
     /* Callbacks */
     void *arg;
     socket_callback_t on_read;      /* data read */
@@ -149,6 +167,8 @@ static asc_socket_t * __socket_open(int family, int type, void * arg)
     sock->type = type;
     sock->arg = arg;
     sock->event = asc_event_init(fd, sock);
+    if(type == SOCK_DGRAM)
+        sock->is_io = asc_event_io_init(sock->event, EVENT_IO_DGRAM);
 
     asc_socket_set_nonblock(sock);
     return sock;
@@ -193,7 +213,13 @@ void asc_socket_close(asc_socket_t *sock)
     if(!sock)
         return;
 
-    if(sock->event)
+    if(sock->is_io)
+    {
+        // descriptor is closed by the event loop when queued data is sent
+        asc_event_io_close(sock->event);
+        sock->fd = 0;
+    }
+    else if(sock->event)
         asc_event_close(sock->event);
 
     if(sock->fd > 0)
@@ -205,6 +231,10 @@ void asc_socket_close(asc_socket_t *sock)
 #endif
     }
     sock->fd = 0;
+#ifdef __linux__
+    free(sock->msg);
+    free(sock->iov);
+#endif
     free(sock);
 }
 
@@ -336,6 +366,7 @@ void asc_socket_listen(asc_socket_t *sock, socket_callback_t on_accept, socket_c
     sock->on_read = on_accept;
     sock->on_ready = NULL;
     sock->on_close = on_error;
+    sock->is_io = asc_event_io_init(sock->event, EVENT_IO_LISTEN);
     asc_event_set_on_read(sock->event, __asc_socket_on_accept);
     asc_event_set_on_write(sock->event, NULL);
     asc_event_set_on_error(sock->event, __asc_socket_on_close);
@@ -354,16 +385,27 @@ bool asc_socket_accept(asc_socket_t *sock, asc_socket_t **client_ptr, void * arg
 {
     asc_socket_t *client = calloc(1, sizeof(asc_socket_t));
     socklen_t sin_size = sizeof(client->addr);
-    client->fd = accept(sock->fd, (struct sockaddr *)&client->addr, &sin_size);
+    if(sock->is_io)
+    {
+        // connection is accepted by the event loop
+        client->fd = asc_event_io_accept(sock->event);
+        if(client->fd > 0)
+            getpeername(client->fd, (struct sockaddr *)&client->addr, &sin_size);
+    }
+    else
+        client->fd = accept(sock->fd, (struct sockaddr *)&client->addr, &sin_size);
+
     if(client->fd <= 0)
     {
-        asc_log_error(MSG("accept() failed [%s]"), asc_socket_error());
+        if(!sock->is_io || errno != EAGAIN)
+            asc_log_error(MSG("accept() failed [%s]"), asc_socket_error());
         free(client);
         *client_ptr = NULL;
         return false;
     }
 
     client->event = asc_event_init(client->fd, client);
+    client->is_io = asc_event_io_init(client->event, EVENT_IO_STREAM);
     client->arg = arg;
     asc_socket_set_nonblock(client);
 
@@ -422,10 +464,12 @@ void asc_socket_connect(asc_socket_t *sock, const char *addr, int port
     }
     else
     {
+        sock->is_io = asc_event_io_init(sock->event, EVENT_IO_STREAM);
         on_connect(sock->arg);
         return;
     }
 
+    sock->is_io = asc_event_io_init(sock->event, EVENT_IO_CONNECT);
     sock->on_read = NULL;
     sock->on_ready = on_connect;
     sock->on_close = on_error;
@@ -445,15 +489,91 @@ void asc_socket_connect(asc_socket_t *sock, const char *addr, int port
 
 ssize_t asc_socket_recv(asc_socket_t *sock, void *buffer, size_t size)
 {
+    if(sock->is_io)
+        return asc_event_io_recv(sock->event, buffer, size);
+
     return recv(sock->fd, buffer, size, 0);
 }
 
+/* source address is not updated if the socket is served by the event loop */
 ssize_t asc_socket_recvfrom(asc_socket_t *sock, void *buffer, size_t size)
 {
+    if(sock->is_io)
+        return asc_event_io_recv(sock->event, buffer, size);
+
     socklen_t slen = sizeof(struct sockaddr_in);
     return recvfrom(sock->fd, buffer, size, 0, (struct sockaddr *)&sock->sockaddr, &slen);
 }
 
+/*
+ * Receive up to count datagrams in one call. Datagram i is stored at
+ * buffer + i * size and its length is stored in lens[i].
+ * Returns number of datagrams, 0 if socket has no more data, -1 on error.
+ */
+#ifdef __linux__
+static void socket_msg_reserve(asc_socket_t *sock, size_t count)
+{
+    if(count <= sock->msg_size)
+        return;
+
+    sock->msg = realloc(sock->msg, count * sizeof(struct mmsghdr));
+    sock->iov = realloc(sock->iov, count * sizeof(struct iovec));
+    asc_assert(sock->msg && sock->iov, "[core/socket] realloc failed");
+    sock->msg_size = count;
+}
+#endif
+
+ssize_t asc_socket_recv_batch(asc_socket_t *sock, void *buffer, size_t size
+                              , size_t count, size_t *lens)
+{
+    if(sock->is_io)
+        return asc_event_io_recv_batch(sock->event, buffer, size, count, lens);
+
+#ifdef __linux__
+    socket_msg_reserve(sock, count);
+    struct mmsghdr *const msg = sock->msg;
+    struct iovec *const iov = sock->iov;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        iov[i].iov_base = (uint8_t *)buffer + i * size;
+        iov[i].iov_len = size;
+        memset(&msg[i].msg_hdr, 0, sizeof(struct msghdr));
+        msg[i].msg_hdr.msg_iov = &iov[i];
+        msg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    const int ret = recvmmsg(sock->fd, msg, count, MSG_DONTWAIT, NULL);
+    if(ret == -1)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+    for(int i = 0; i < ret; ++i)
+        lens[i] = msg[i].msg_len;
+
+    return ret;
+#else
+    size_t i = 0;
+    for(; i < count; ++i)
+    {
+        const ssize_t ret = recv(sock->fd, (char *)buffer + i * size, size, 0);
+        if(ret == -1)
+        {
+#ifdef _WIN32
+            if(WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+                break;
+
+            return (i > 0) ? (ssize_t)i : -1;
+        }
+        lens[i] = ret;
+    }
+
+    return i;
+#endif
+}
+
 /*
  *  oooooooo8 ooooooooooo oooo   oooo ooooooooo
  * 888         888    88   8888o  88   888    88o
@@ -465,6 +585,12 @@ ssize_t asc_socket_recvfrom(asc_socket_t *sock, void *buffer, size_t size)
 
 ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size)
 {
+    if(sock->is_io)
+    {
+        const struct iovec iov = { .iov_base = (void *)buffer, .iov_len = size };
+        return asc_event_io_send(sock->event, &iov, 1);
+    }
+
     const ssize_t ret = send(sock->fd, buffer, size, 0);
     if(ret == -1)
     {
@@ -480,12 +606,188 @@ ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size)
     return ret;
 }
 
+ssize_t asc_socket_sendv(asc_socket_t *sock, const struct iovec *iov, int iovcnt)
+{
+    if(sock->is_io)
+        return asc_event_io_send(sock->event, iov, iovcnt);
+
+#ifdef _WIN32
+    ssize_t total = 0;
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        const ssize_t ret = asc_socket_send(sock, iov[i].iov_base, iov[i].iov_len);
+        if(ret == -1)
+            return (total > 0) ? total : -1;
+        total += ret;
+        if((size_t)ret < iov[i].iov_len)
+            break;
+    }
+    return total;
+#else
+    const ssize_t ret = writev(sock->fd, iov, iovcnt);
+    if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    return ret;
+#endif
+}
+
 ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size)
 {
     socklen_t slen = sizeof(struct sockaddr_in);
+    if(sock->is_io)
+    {
+        const struct iovec iov = { .iov_base = (void *)buffer, .iov_len = size };
+        const ssize_t ret = asc_event_io_sendto(sock->event, &iov, 1
+                                                , &sock->sockaddr, slen, false);
+        if(ret == 0)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        return (ret == -1) ? -1 : (ssize_t)size;
+    }
+
     return sendto(sock->fd, buffer, size, 0, (struct sockaddr *)&sock->sockaddr, slen);
 }
 
+#if defined(__linux__) && defined(UDP_SEGMENT)
+
+static bool socket_check_gso(asc_socket_t *sock)
+{
+    if(sock->gso == 0)
+    {
+        int value = 0;
+        socklen_t slen = sizeof(value);
+        sock->gso = (getsockopt(sock->fd, SOL_UDP, UDP_SEGMENT, &value, &slen) == 0) ? 1 : -1;
+    }
+
+    return (sock->gso == 1);
+}
+
+/* sends datagrams of equal size (last one may be shorter) with one call.
+ * returns number of datagrams in the call or -1 on error */
+static ssize_t socket_sendto_gso(asc_socket_t *sock, const struct iovec *iov, size_t count)
+{
+    const size_t seg_size = iov[0].iov_len;
+    size_t size = seg_size;
+    size_t n = 1;
+    while(n < count
+          && n < SOCKET_GSO_SEGMENTS
+          && iov[n].iov_len <= seg_size
+          && size + iov[n].iov_len <= SOCKET_GSO_SIZE)
+    {
+        size += iov[n].iov_len;
+        ++n;
+        if(iov[n - 1].iov_len < seg_size)
+            break;
+    }
+
+    if(n == 1)
+        return (asc_socket_sendto(sock, iov[0].iov_base, size) == -1) ? -1 : 1;
+
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(control, 0, sizeof(control));
+
+    // payload of the segments may be scattered
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &sock->sockaddr;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = n;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    const uint16_t value = seg_size;
+    memcpy(CMSG_DATA(cm), &value, sizeof(value));
+
+    if(sendmsg(sock->fd, &msg, 0) == -1)
+    {
+        // device without checksum offload or GSO disabled for the route
+        if(errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+        {
+            asc_log_debug(MSG("UDP_SEGMENT is not supported [%s]"), asc_socket_error());
+            sock->gso = -1;
+            return 0;
+        }
+        return -1;
+    }
+
+    return n;
+}
+
+#endif
+
+/*
+ * Send count datagrams to the address defined by asc_socket_set_sockaddr().
+ * iov[i] is a payload of the datagram i. Datagrams of equal size are sent
+ * with UDP_SEGMENT if kernel supports it, otherwise with sendmmsg().
+ * If the socket is served by the event loop, datagrams are queued and sent
+ * with the next wait for events.
+ * Returns number of sent (queued) datagrams or -1 on error.
+ */
+ssize_t asc_socket_sendto_batch(asc_socket_t *sock, const struct iovec *iov, size_t count)
+{
+    size_t sent = 0;
+
+    if(sock->is_io)
+    {
+#if defined(__linux__) && defined(UDP_SEGMENT)
+        const bool is_gso = socket_check_gso(sock);
+#else
+        const bool is_gso = false;
+#endif
+        return asc_event_io_sendto(sock->event, iov, count
+                                   , &sock->sockaddr, sizeof(struct sockaddr_in), is_gso);
+    }
+
+#if defined(__linux__) && defined(UDP_SEGMENT)
+    while(sent < count && socket_check_gso(sock))
+    {
+        const ssize_t ret = socket_sendto_gso(sock, &iov[sent], count - sent);
+        if(ret == -1)
+            return (sent > 0) ? (ssize_t)sent : -1;
+        sent += ret;
+    }
+#endif
+
+#ifdef __linux__
+    if(sent < count)
+    {
+        const size_t n = count - sent;
+        socket_msg_reserve(sock, n);
+        struct mmsghdr *const msg = sock->msg;
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            memset(&msg[i].msg_hdr, 0, sizeof(struct msghdr));
+            msg[i].msg_hdr.msg_name = &sock->sockaddr;
+            msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msg[i].msg_hdr.msg_iov = (struct iovec *)&iov[sent + i];
+            msg[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int ret = sendmmsg(sock->fd, msg, n, 0);
+        if(ret == -1)
+            return (sent > 0) ? (ssize_t)sent : -1;
+
+        sent += ret;
+    }
+#else
+    for(; sent < count; ++sent)
+    {
+        if(asc_socket_sendto(sock, iov[sent].iov_base, iov[sent].iov_len) == -1)
+            return (sent > 0) ? (ssize_t)sent : -1;
+    }
+#endif
+
+    return sent;
+}
+
 /*
  * ooooo oooo   oooo ooooooooooo  ooooooo
  *  888   8888o  88   888    88 o888   888o
@@ -24,6 +24,16 @@
 #include "base.h"
 #include "event.h"
 
+#ifdef _WIN32
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#   include <sys/uio.h>
+#endif
+
 typedef struct asc_socket_t asc_socket_t;
 
 typedef void (*socket_callback_t)(void * arg);
@@ -54,9 +64,14 @@ void asc_socket_connect(asc_socket_t *sock, const char *addr, int port
 
 ssize_t asc_socket_recv(asc_socket_t *sock, void *buffer, size_t size) __wur;
 ssize_t asc_socket_recvfrom(asc_socket_t *sock, void *buffer, size_t size) __wur;
+ssize_t asc_socket_recv_batch(asc_socket_t *sock, void *buffer, size_t size
+                              , size_t count, size_t *lens) __wur;
 
 ssize_t asc_socket_send(asc_socket_t *sock, const void *buffer, size_t size) __wur;
+ssize_t asc_socket_sendv(asc_socket_t *sock, const struct iovec *iov, int iovcnt) __wur;
 ssize_t asc_socket_sendto(asc_socket_t *sock, const void *buffer, size_t size) __wur;
+ssize_t asc_socket_sendto_batch(asc_socket_t *sock, const struct iovec *iov
+                                , size_t count) __wur;
 
 int asc_socket_fd(asc_socket_t *sock) __wur;
 const char * asc_socket_addr(asc_socket_t *sock) __wur;
@@ -19,119 +19,187 @@
  */
 
 #include "timer.h"
-#include "list.h"
+#include "utils.h"
+
+#ifndef TIMER_HEAP_SIZE
+#   define TIMER_HEAP_SIZE 64
+#endif
 
 struct asc_timer_t
 {
     void (*callback)(void *arg);
     void *arg;
 
-    struct timeval interval;
-    struct timeval next_shot;
+    int64_t interval; // us. 0 - one shot timer
+    int64_t next_shot; // us. monotonic
+
+    size_t idx; // position in the heap
 };
 
-static asc_list_t *timer_list = NULL;
-
-#ifndef timeradd
-#define timeradd(tvp, uvp, vvp)                                         \
-    do {                                                                \
-            (vvp)->tv_sec = (tvp)->tv_sec + (uvp)->tv_sec;              \
-            (vvp)->tv_usec = (tvp)->tv_usec + (uvp)->tv_usec;           \
-            if ((vvp)->tv_usec >= 1000000) {                            \
-                    (vvp)->tv_sec++;                                    \
-                    (vvp)->tv_usec -= 1000000;                          \
-            }                                                           \
-    } while (0)
-#endif
+/* binary min-heap ordered by the next_shot. each event loop thread has its own heap */
 
-void asc_timer_core_init(void)
+static __thread struct
+{
+    asc_timer_t **heap;
+    size_t size;
+    size_t capacity;
+
+    asc_timer_t *current; // timer with the running callback
+} timer_core;
+
+static inline bool heap_less(size_t a, size_t b)
 {
-    timer_list = asc_list_init();
+    return timer_core.heap[a]->next_shot < timer_core.heap[b]->next_shot;
 }
 
-void asc_timer_core_destroy(void)
+static inline void heap_swap(size_t a, size_t b)
+{
+    asc_timer_t *const t = timer_core.heap[a];
+    timer_core.heap[a] = timer_core.heap[b];
+    timer_core.heap[b] = t;
+    timer_core.heap[a]->idx = a;
+    timer_core.heap[b]->idx = b;
+}
+
+static void heap_sift_up(size_t idx)
 {
-    asc_list_first(timer_list);
-    while(!asc_list_eol(timer_list))
+    while(idx > 0)
     {
-        free(asc_list_data(timer_list));
-        asc_list_remove_current(timer_list);
+        const size_t parent = (idx - 1) / 2;
+        if(!heap_less(idx, parent))
+            break;
+        heap_swap(idx, parent);
+        idx = parent;
     }
-    asc_list_destroy(timer_list);
-    timer_list = NULL;
 }
 
-void asc_timer_core_loop(void)
+static void heap_sift_down(size_t idx)
 {
-    int is_detached = 0;
-    struct timeval cur;
-
-    asc_list_for(timer_list)
+    while(true)
     {
-        asc_timer_t *timer = asc_list_data(timer_list);
-        if(!timer->callback)
-        {
-            ++is_detached;
-            continue;
-        }
+        const size_t l = idx * 2 + 1;
+        if(l >= timer_core.size)
+            break;
+        const size_t r = l + 1;
+        const size_t m = (r < timer_core.size && heap_less(r, l)) ? r : l;
+        if(!heap_less(m, idx))
+            break;
+        heap_swap(idx, m);
+        idx = m;
+    }
+}
 
-        gettimeofday(&cur, NULL);
-        if(timercmp(&cur, &timer->next_shot, >=))
-        {
-            if(timer->interval.tv_sec == 0 && timer->interval.tv_usec == 0)
-            {
-                // one shot timer
-                timer->callback(timer->arg);
-                timer->callback = NULL;
-                ++is_detached;
-            }
-            else
-            {
-                timeradd(&cur, &timer->interval, &timer->next_shot);
-                timer->callback(timer->arg);
-            }
-        }
+static void heap_insert(asc_timer_t *timer)
+{
+    if(timer_core.size == timer_core.capacity)
+    {
+        timer_core.capacity = (timer_core.capacity) ? timer_core.capacity * 2 : TIMER_HEAP_SIZE;
+        timer_core.heap = realloc(timer_core.heap, timer_core.capacity * sizeof(asc_timer_t *));
     }
 
-    if(!is_detached)
+    timer->idx = timer_core.size;
+    timer_core.heap[timer_core.size] = timer;
+    ++timer_core.size;
+    heap_sift_up(timer->idx);
+}
+
+static void heap_remove(asc_timer_t *timer)
+{
+    const size_t idx = timer->idx;
+    --timer_core.size;
+    if(idx == timer_core.size)
         return;
 
-    asc_list_first(timer_list);
-    while(!asc_list_eol(timer_list))
+    timer_core.heap[idx] = timer_core.heap[timer_core.size];
+    timer_core.heap[idx]->idx = idx;
+    if(idx > 0 && heap_less(idx, (idx - 1) / 2))
+        heap_sift_up(idx);
+    else
+        heap_sift_down(idx);
+}
+
+void asc_timer_core_init(void)
+{
+    memset(&timer_core, 0, sizeof(timer_core));
+}
+
+void asc_timer_core_destroy(void)
+{
+    for(size_t i = 0; i < timer_core.size; ++i)
+        free(timer_core.heap[i]);
+
+    free(timer_core.heap);
+    memset(&timer_core, 0, sizeof(timer_core));
+}
+
+void asc_timer_core_loop(void)
+{
+    const int64_t cur = asc_utime();
+
+    while(timer_core.size > 0)
     {
-        asc_timer_t *timer = asc_list_data(timer_list);
-        if(timer->callback)
-            asc_list_next(timer_list);
+        asc_timer_t *timer = timer_core.heap[0];
+        if(timer->next_shot > cur)
+            break;
+
+        if(timer->interval == 0)
+            heap_remove(timer); // one shot timer
         else
         {
-            free(asc_list_data(timer_list));
-            asc_list_remove_current(timer_list);
+            timer->next_shot = cur + timer->interval;
+            heap_sift_down(0);
+        }
+
+        timer_core.current = timer;
+        timer->callback(timer->arg);
+        timer_core.current = NULL;
+
+        if(timer->interval == 0 || !timer->callback)
+        {
+            // one shot timer or destroyed in the callback
+            if(timer->interval != 0)
+                heap_remove(timer);
+            free(timer);
         }
     }
 }
 
+int asc_timer_core_timeout(int max_ms)
+{
+    if(!timer_core.size)
+        return max_ms;
+
+    const int64_t delta = timer_core.heap[0]->next_shot - asc_utime();
+    if(delta <= 0)
+        return 0;
+
+    // round up to avoid early wake up
+    const int64_t ms = (delta + 999) / 1000;
+    return (ms < max_ms) ? (int)ms : max_ms;
+}
+
 asc_timer_t * asc_timer_init(unsigned int ms, void (*callback)(void *), void *arg)
 {
     asc_timer_t *timer = calloc(1, sizeof(asc_timer_t));
-    timer->interval.tv_sec = ms / 1000;
-    timer->interval.tv_usec = (ms % 1000) * 1000;
+    timer->interval = (int64_t)ms * 1000;
     timer->callback = callback;
     timer->arg = arg;
+    timer->next_shot = asc_utime() + timer->interval;
 
-    struct timeval cur;
-    gettimeofday(&cur, NULL);
-    timeradd(&cur, &timer->interval, &timer->next_shot);
-
-    asc_list_insert_tail(timer_list, timer);
+    heap_insert(timer);
 
     return timer;
 }
 
-void timer_one_shot(unsigned int ms, void (*callback)(void *), void *arg)
+void asc_timer_one_shot(unsigned int ms, void (*callback)(void *), void *arg)
 {
-    asc_timer_t *timer = asc_timer_init(ms, callback, arg);
-    timer->interval.tv_sec = 0;
-    timer->interval.tv_usec = 0;
+    asc_timer_t *timer = calloc(1, sizeof(asc_timer_t));
+    timer->interval = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->next_shot = asc_utime() + (int64_t)ms * 1000;
+
+    heap_insert(timer);
 }
 
 void asc_timer_destroy(asc_timer_t *timer)
@@ -139,5 +207,13 @@ void asc_timer_destroy(asc_timer_t *timer)
     if(!timer)
         return;
 
-    timer->callback = NULL;
+    if(timer == timer_core.current)
+    {
+        // released by asc_timer_core_loop() on callback return
+        timer->callback = NULL;
+        return;
+    }
+
+    heap_remove(timer);
+    free(timer);
 }
@@ -28,6 +28,7 @@ typedef struct asc_timer_t asc_timer_t;
 void asc_timer_core_init(void);
 void asc_timer_core_loop(void);
 void asc_timer_core_destroy(void);
+int asc_timer_core_timeout(int max_ms) __wur;
 
 void asc_timer_one_shot(unsigned int ms, void (*callback)(void *), void *arg);
 
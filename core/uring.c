@@ -0,0 +1,246 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uring.h"
+#include "log.h"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define MSG(_msg) "[core/uring] " _msg
+
+struct asc_uring_t
+{
+    int fd;
+    unsigned features;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_entries;
+    unsigned *sq_array;
+    unsigned sq_pending; // local tail, not visible to the kernel yet
+
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static void uring_unmap(asc_uring_t *uring)
+{
+    if(uring->sqes)
+        munmap(uring->sqes, uring->sqes_size);
+    if(uring->cq_ring && uring->cq_ring != uring->sq_ring)
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    if(uring->sq_ring)
+        munmap(uring->sq_ring, uring->sq_ring_size);
+}
+
+asc_uring_t * asc_uring_init(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    const int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if(fd == -1)
+    {
+        asc_log_debug(MSG("io_uring is not available [%s]"), strerror(errno));
+        return NULL;
+    }
+
+    asc_uring_t *uring = calloc(1, sizeof(asc_uring_t));
+    uring->fd = fd;
+    uring->features = p.features;
+
+    uring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    // since linux 5.4 both rings are in the one mapping
+    const bool is_single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(is_single_mmap && uring->cq_ring_size > uring->sq_ring_size)
+        uring->sq_ring_size = uring->cq_ring_size;
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE
+                          , MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(uring->sq_ring == MAP_FAILED)
+    {
+        uring->sq_ring = NULL;
+        goto fail;
+    }
+
+    if(is_single_mmap)
+        uring->cq_ring = uring->sq_ring;
+    else
+    {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE
+                              , MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(uring->cq_ring == MAP_FAILED)
+        {
+            uring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE
+                       , MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(uring->sqes == MAP_FAILED)
+    {
+        uring->sqes = NULL;
+        goto fail;
+    }
+
+    uint8_t *sq = uring->sq_ring;
+    uring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    uring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    uring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    uring->sq_entries = (unsigned *)(sq + p.sq_off.ring_entries);
+    uring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    uring->sq_pending = *uring->sq_tail;
+
+    uint8_t *cq = uring->cq_ring;
+    uring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    uring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    uring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return uring;
+
+fail:
+    asc_log_error(MSG("failed to map rings [%s]"), strerror(errno));
+    uring_unmap(uring);
+    close(fd);
+    free(uring);
+    return NULL;
+}
+
+void asc_uring_destroy(asc_uring_t *uring)
+{
+    if(!uring)
+        return;
+
+    uring_unmap(uring);
+    close(uring->fd);
+    free(uring);
+}
+
+int asc_uring_fd(asc_uring_t *uring)
+{
+    return uring->fd;
+}
+
+unsigned asc_uring_features(asc_uring_t *uring)
+{
+    return uring->features;
+}
+
+struct io_uring_sqe * asc_uring_get_sqe(asc_uring_t *uring)
+{
+    const unsigned head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    if(uring->sq_pending - head >= *uring->sq_entries)
+        return NULL;
+
+    const unsigned idx = uring->sq_pending & *uring->sq_mask;
+    ++uring->sq_pending;
+
+    struct io_uring_sqe *sqe = &uring->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    uring->sq_array[idx] = idx;
+
+    return sqe;
+}
+
+/* returns number of submitted entries or -1 on error */
+int asc_uring_submit(asc_uring_t *uring, unsigned wait_nr)
+{
+    const unsigned to_submit = uring->sq_pending - *uring->sq_tail;
+    __atomic_store_n(uring->sq_tail, uring->sq_pending, __ATOMIC_RELEASE);
+
+    if(!to_submit && !wait_nr)
+        return 0;
+
+    const unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do
+    {
+        ret = syscall(__NR_io_uring_enter, uring->fd, to_submit, wait_nr, flags, NULL, 0);
+    } while(ret == -1 && errno == EINTR);
+
+    return ret;
+}
+
+#ifdef IORING_ENTER_EXT_ARG
+
+/* submits pending entries and waits for wait_nr completions, but not longer
+ * than timeout (in milliseconds). requires IORING_FEAT_EXT_ARG (linux 5.11) */
+int asc_uring_wait(asc_uring_t *uring, unsigned wait_nr, int timeout)
+{
+    const unsigned to_submit = uring->sq_pending - *uring->sq_tail;
+    __atomic_store_n(uring->sq_tail, uring->sq_pending, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts = { timeout / 1000, (timeout % 1000) * 1000000 };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uintptr_t)&ts;
+
+    return syscall(__NR_io_uring_enter, uring->fd, to_submit, wait_nr
+                   , IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+#else
+
+int asc_uring_wait(asc_uring_t *uring, unsigned wait_nr, int timeout)
+{
+    __uarg(timeout);
+    return asc_uring_submit(uring, wait_nr);
+}
+
+#endif /* IORING_ENTER_EXT_ARG */
+
+struct io_uring_cqe * asc_uring_peek_cqe(asc_uring_t *uring)
+{
+    const unsigned head = *uring->cq_head;
+    if(head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    return &uring->cqes[head & *uring->cq_mask];
+}
+
+void asc_uring_cqe_seen(asc_uring_t *uring)
+{
+    __atomic_store_n(uring->cq_head, *uring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int asc_uring_register(asc_uring_t *uring, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, uring->fd, opcode, arg, nr_args);
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,57 @@
+/*
+ * Astra Core
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _URING_H_
+#define _URING_H_ 1
+
+#include "base.h"
+
+#ifdef HAVE_IO_URING
+
+/*
+ * Minimal io_uring wrapper over the raw system calls.
+ * Instance is not thread-safe, each thread should have own one.
+ * asc_uring_init() returns NULL if the kernel has no io_uring support.
+ * Submission entries returned by asc_uring_get_sqe() are zeroed and
+ * passed to the kernel on the next asc_uring_submit().
+ */
+
+#include <linux/io_uring.h>
+
+typedef struct asc_uring_t asc_uring_t;
+
+asc_uring_t * asc_uring_init(unsigned entries) __wur;
+void asc_uring_destroy(asc_uring_t *uring);
+
+int asc_uring_fd(asc_uring_t *uring) __wur;
+unsigned asc_uring_features(asc_uring_t *uring) __wur;
+
+struct io_uring_sqe * asc_uring_get_sqe(asc_uring_t *uring) __wur;
+int asc_uring_submit(asc_uring_t *uring, unsigned wait_nr);
+int asc_uring_wait(asc_uring_t *uring, unsigned wait_nr, int timeout);
+
+struct io_uring_cqe * asc_uring_peek_cqe(asc_uring_t *uring) __wur;
+void asc_uring_cqe_seen(asc_uring_t *uring);
+
+int asc_uring_register(asc_uring_t *uring, unsigned opcode, const void *arg, unsigned nr_args);
+
+#endif /* HAVE_IO_URING */
+
+#endif /* _URING_H_ */
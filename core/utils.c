@@ -36,3 +36,16 @@ int64_t asc_utime(void)
     return ((int64_t)tv.tv_sec * 1000000) + (int64_t)tv.tv_usec;
 #endif
 }
+
+// updated by the event loop after waiting for events
+static __thread int64_t utime_now = 0;
+
+void asc_utime_update(void)
+{
+    utime_now = asc_utime();
+}
+
+int64_t asc_utime_now(void)
+{
+    return (utime_now) ? utime_now : asc_utime();
+}
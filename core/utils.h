@@ -23,6 +23,12 @@
 
 #include "base.h"
 
+/* precise monotonic time in microseconds. for pacing and timers */
 int64_t asc_utime(void);
 
+/* time of the current event loop iteration. for per-packet paths.
+ * threads without event loop get the precise time */
+int64_t asc_utime_now(void);
+void asc_utime_update(void);
+
 #endif /* _UTILS_H_ */
@@ -114,6 +114,7 @@ int main(int argc, const char **argv)
     asc_timer_core_init();
     asc_socket_core_init();
     asc_event_core_init();
+    asc_reactor_core_init();
 
     lua = luaL_newstate();
     luaL_openlibs(lua);
@@ -156,6 +157,7 @@ int main(int argc, const char **argv)
 
     /* destroy */
     lua_close(lua);
+    asc_reactor_core_destroy();
     asc_event_core_destroy();
     asc_socket_core_destroy();
     asc_timer_core_destroy();
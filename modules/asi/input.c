@@ -66,8 +66,7 @@ static void asi_on_read(void *arg)
         return;
     }
 
-    for(int i = 0; i < len; i += TS_PACKET_SIZE)
-        module_stream_send(mod, &mod->buffer[i]);
+    module_stream_send_batch(mod, mod->buffer, len / TS_PACKET_SIZE);
 }
 
 
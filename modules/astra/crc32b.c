@@ -3,69 +3,281 @@
  *
  * Based on "File Verification Using CRC" by Mark R. Nelson in
  * Dr. Dobb's Journal, May 1992, pp. 64-67
+ *
+ * MPEG-2 CRC: polynomial 0x04C11DB7, initial value 0xFFFFFFFF,
+ * without reflection and final XOR.
+ *
+ * Implementation is selected on startup:
+ * - PCLMULQDQ (x86) or PMULL (ARMv8) folding for long buffers
+ * - slice-by-16 tables for others and for the tail of the buffer
+ *
+ * Folding is described in "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction" by V. Gopal et al., Intel, 2009.
+ * Constants are x^N mod P and floor(x^64 / P) for the Barrett reduction.
  */
 
-#include "stddef.h"
-#include "stdint.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   define CRC32_CLMUL
+#   include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO) && defined(__linux__)
+#   define CRC32_PMULL
+#   include <arm_neon.h>
+#   include <sys/auxv.h>
+#   include <asm/hwcap.h>
+#endif
+
+#define CRC32_POLY 0x04C11DB7
+
+#define CRC32_K576 0x8833794C /* x^(512+64) mod P */
+#define CRC32_K512 0xE6228B11 /* x^512 mod P */
+#define CRC32_K192 0xC5B9CD4C /* x^(128+64) mod P */
+#define CRC32_K128 0xE8A45605 /* x^128 mod P */
+#define CRC32_K96  0xF200AA66 /* x^96 mod P */
+#define CRC32_K64  0x490D678D /* x^64 mod P */
+#define CRC32_MU   0x104D101DFULL /* floor(x^64 / P) */
+#define CRC32_P    0x104C11DB7ULL /* P with x^32 */
+
+static uint32_t crc32_table[16][256];
 
-static uint32_t crc32_table[256] = { 0 };
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *buffer, size_t size);
+static uint32_t (*crc32_func)(uint32_t crc, const uint8_t *buffer, size_t size)
+    = crc32_slice16;
 
-static void _init_crc32(void)
+static inline uint32_t load_be32(const uint8_t *buffer)
 {
-    int i, j;
-    uint32_t c;
-
-#if 0 /* little-endian */
-#   define POLY 0xedb88320
-#   define STEP { c = (c&1) ? ((c >> 1) ^ POLY) : (c >> 1); }
-#else
-#   define POLY 0x04c11db7
-#   define STEP { c = c & 0x80000000 ? (c << 1) ^ POLY : (c << 1); }
-#endif
+    return ((uint32_t)buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+}
 
-    for(i = 0; i < 256; ++i)
+/*
+ *  oooooooo8 ooooo       ooooo  oooooooo8 ooooooooooo
+ * 888         888         888 o888     88  888    88
+ *  888oooooo  888         888 888          888ooo8
+ *         888 888      o  888 888o     oo  888    oo
+ * o88oooo888 o888ooooo88 o888o 888oooo88  o888ooo8888
+ *
+ */
+
+/* reference implementation. one byte per step */
+static uint32_t crc32_byte(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    for(size_t i = 0; i < size; ++i)
+        crc = (crc << 8) ^ crc32_table[0][(crc >> 24) ^ buffer[i]];
+
+    return crc;
+}
+
+/* crc32_table[n][i] - CRC of the byte i followed by n zero bytes */
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    const uint32_t (*t)[256] = (const uint32_t (*)[256])crc32_table;
+
+    while(size >= 16)
     {
-        for(c = i << 24, j = 8; j > 0; --j)
-            STEP;
-        crc32_table[i] = c;
+        const uint32_t a = crc ^ load_be32(buffer);
+        crc = t[15][(a >> 24)       ] ^ t[14][(a >> 16) & 0xFF]
+            ^ t[13][(a >>  8) & 0xFF] ^ t[12][(a      ) & 0xFF]
+            ^ t[11][buffer[4]       ] ^ t[10][buffer[5]       ]
+            ^ t[ 9][buffer[6]       ] ^ t[ 8][buffer[7]       ]
+            ^ t[ 7][buffer[8]       ] ^ t[ 6][buffer[9]       ]
+            ^ t[ 5][buffer[10]      ] ^ t[ 4][buffer[11]      ]
+            ^ t[ 3][buffer[12]      ] ^ t[ 2][buffer[13]      ]
+            ^ t[ 1][buffer[14]      ] ^ t[ 0][buffer[15]      ];
+
+        buffer += 16;
+        size -= 16;
     }
 
-#undef STEP
-#undef POLY
+    return crc32_byte(crc, buffer, size);
 }
 
-uint32_t crc32b(const uint8_t *buffer, int size)
+/*
+ *   oooooooo8 ooooo       oooo     oooo ooooo  oooo ooooo
+ * o888     88  888         8888o   888   888    88   888
+ * 888          888         88 888o8 88   888    88   888
+ * 888o     oo  888      o  88  888  88   888    88   888      o
+ *  888oooo88  o888ooooo88 o88o  8  o88o   888oo88   o888ooooo88
+ *
+ */
+
+#ifdef CRC32_CLMUL
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crc32_clmul_fold(__m128i x, __m128i k, __m128i data)
 {
-    if(!crc32_table[0])
-        _init_crc32();
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11)
+                                       , _mm_clmulepi64_si128(x, k, 0x00))
+                         , data);
+}
 
-#if 0 /* little-endian */
-#   define ESTEP (crc >> 8) ^ crc32_table[(crc ^ *buffer) & 0xFF]
-#else
-#   define ESTEP (crc << 8) ^ crc32_table[(crc >> 24) ^ *buffer]
-#endif
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32_clmul(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    if(size < 64)
+        return crc32_slice16(crc, buffer, size);
 
-#define STEP { crc = ESTEP; ++buffer; --size; }
+    // first byte of the block to the most significant position
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7
+                                       , 8, 9, 10, 11, 12, 13, 14, 15);
+#define LOAD(_offset) \
+    _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&buffer[_offset]), bswap)
 
-    register uint32_t crc = 0xffffffff;
+    __m128i x0 = _mm_xor_si128(LOAD(0), _mm_set_epi32((int)crc, 0, 0, 0));
+    __m128i x1 = LOAD(16);
+    __m128i x2 = LOAD(32);
+    __m128i x3 = LOAD(48);
+    buffer += 64;
+    size -= 64;
 
-    int n = (size + 7) / 8;
-    const int m = size % 8;
-    switch(m)
+    // fold by 4 blocks
+    const __m128i k4 = _mm_set_epi64x(CRC32_K576, CRC32_K512);
+    while(size >= 64)
     {
-        case 0: do { STEP;
-        case 7:      STEP;
-        case 6:      STEP;
-        case 5:      STEP;
-        case 4:      STEP;
-        case 3:      STEP;
-        case 2:      STEP;
-        case 1:      STEP;
-                   } while (--n > 0);
+        x0 = crc32_clmul_fold(x0, k4, LOAD(0));
+        x1 = crc32_clmul_fold(x1, k4, LOAD(16));
+        x2 = crc32_clmul_fold(x2, k4, LOAD(32));
+        x3 = crc32_clmul_fold(x3, k4, LOAD(48));
+        buffer += 64;
+        size -= 64;
     }
 
-#undef STEP
-#undef ESTEP
+    // fold by 1 block
+    const __m128i k1 = _mm_set_epi64x(CRC32_K192, CRC32_K128);
+    __m128i x = crc32_clmul_fold(x0, k1, x1);
+    x = crc32_clmul_fold(x, k1, x2);
+    x = crc32_clmul_fold(x, k1, x3);
+    while(size >= 16)
+    {
+        x = crc32_clmul_fold(x, k1, LOAD(0));
+        buffer += 16;
+        size -= 16;
+    }
 
-    return crc;
+#undef LOAD
+
+    // 128 bits -> 96 bits: x_hi * (x^96 mod P) + x_lo * x^32
+    __m128i t = _mm_clmulepi64_si128(x, _mm_set_epi64x(0, CRC32_K96), 0x01);
+    t = _mm_xor_si128(t, _mm_slli_si128(_mm_move_epi64(x), 4));
+    // 96 bits -> 64 bits: t_hi * (x^64 mod P) + t_lo
+    __m128i u = _mm_clmulepi64_si128(t, _mm_set_epi64x(0, CRC32_K64), 0x01);
+    u = _mm_xor_si128(u, _mm_move_epi64(t));
+    // Barrett reduction
+    __m128i q = _mm_clmulepi64_si128(_mm_srli_epi64(u, 32), _mm_set_epi64x(0, CRC32_MU), 0x00);
+    q = _mm_srli_epi64(q, 32);
+    const __m128i r = _mm_xor_si128(u, _mm_clmulepi64_si128(q, _mm_set_epi64x(0, CRC32_P), 0x00));
+    crc = (uint32_t)_mm_cvtsi128_si32(r);
+
+    return crc32_slice16(crc, buffer, size);
+}
+
+#endif /* CRC32_CLMUL */
+
+/*
+ * oooooooooo oooo     oooo ooooo  oooo ooooo       ooooo
+ *  888    888 8888o   888   888    88   888         888
+ *  888oooo88  88 888o8 88   888    88   888         888
+ *  888        88  888  88   888    88   888      o  888      o
+ * o888o      o88o  8  o88o   888oo88   o888ooooo88 o888ooooo88
+ *
+ */
+
+#ifdef CRC32_PMULL
+
+static inline uint64_t load_be64(const uint8_t *buffer)
+{
+    return ((uint64_t)load_be32(buffer) << 32) | load_be32(&buffer[4]);
+}
+
+static inline void crc32_pmull_mul(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+    const uint64x2_t r = vreinterpretq_u64_p128(vmull_p64((poly64_t)a, (poly64_t)b));
+    *lo = vgetq_lane_u64(r, 0);
+    *hi = vgetq_lane_u64(r, 1);
+}
+
+static uint32_t crc32_pmull(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    if(size < 64)
+        return crc32_slice16(crc, buffer, size);
+
+    uint64_t x_hi = load_be64(buffer) ^ ((uint64_t)crc << 32);
+    uint64_t x_lo = load_be64(&buffer[8]);
+    buffer += 16;
+    size -= 16;
+
+    uint64_t h1, l1, h2, l2;
+    while(size >= 16)
+    {
+        crc32_pmull_mul(x_hi, CRC32_K192, &h1, &l1);
+        crc32_pmull_mul(x_lo, CRC32_K128, &h2, &l2);
+        x_hi = h1 ^ h2 ^ load_be64(buffer);
+        x_lo = l1 ^ l2 ^ load_be64(&buffer[8]);
+        buffer += 16;
+        size -= 16;
+    }
+
+    // 128 bits -> 96 bits
+    crc32_pmull_mul(x_hi, CRC32_K96, &h1, &l1);
+    const uint64_t t_hi = h1 ^ (x_lo >> 32);
+    const uint64_t t_lo = l1 ^ (x_lo << 32);
+    // 96 bits -> 64 bits
+    crc32_pmull_mul(t_hi, CRC32_K64, &h1, &l1);
+    const uint64_t u = l1 ^ t_lo;
+    // Barrett reduction
+    crc32_pmull_mul(u >> 32, CRC32_MU, &h1, &l1);
+    crc32_pmull_mul(l1 >> 32, CRC32_P, &h1, &l1);
+    crc = (uint32_t)(u ^ l1);
+
+    return crc32_slice16(crc, buffer, size);
+}
+
+#endif /* CRC32_PMULL */
+
+/*
+ * ooooo oooo   oooo ooooo ooooooooooo
+ *  888   8888o  88   888  88  888  88
+ *  888   88 888o88   888      888
+ *  888   88   8888   888      888
+ * o888o o88o    88  o888o    o888o
+ *
+ */
+
+__attribute__((constructor))
+static void crc32_init(void)
+{
+    for(uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t c = i << 24;
+        for(int j = 0; j < 8; ++j)
+            c = (c & 0x80000000) ? ((c << 1) ^ CRC32_POLY) : (c << 1);
+        crc32_table[0][i] = c;
+    }
+
+    for(int n = 1; n < 16; ++n)
+    {
+        for(int i = 0; i < 256; ++i)
+        {
+            const uint32_t c = crc32_table[n - 1][i];
+            crc32_table[n][i] = (c << 8) ^ crc32_table[0][c >> 24];
+        }
+    }
+
+#if defined(CRC32_CLMUL)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+        crc32_func = crc32_clmul;
+#elif defined(CRC32_PMULL)
+    if(getauxval(AT_HWCAP) & HWCAP_PMULL)
+        crc32_func = crc32_pmull;
+#endif
+}
+
+uint32_t crc32b(const uint8_t *buffer, int size)
+{
+    if(size <= 0)
+        return 0xFFFFFFFF;
+
+    return crc32_func(0xFFFFFFFF, buffer, size);
 }
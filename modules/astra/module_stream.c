@@ -20,36 +20,340 @@
 
 #include <astra.h>
 
-void __module_stream_detach(module_stream_t *stream, module_stream_t *child)
+/*
+ * the stream tree is modified only in the thread of the reactor where the tree
+ * is running. the caller waits until changes are applied.
+ */
+
+typedef struct
+{
+    module_stream_t *stream;
+    module_stream_t *child;
+    uint16_t pid;
+} stream_link_t;
+
+/*
+ * oooooooooo ooooo ooooooooo        oooo     oooo      o      oooooooooo
+ *  888    888 888   888    88o       8888o   888      888      888    888
+ *  888oooo88  888   888    888       88 888o8 88     8  88     888oooo88
+ *  888        888   888    888       88  888  88    8oooo88    888
+ * o888o      o888o o888ooo88        o88o  8  o88o o88o  o888o o888o
+ *
+ */
+
+static void stream_list_append(module_stream_t ***list, uint32_t *count, uint32_t *size
+                               , module_stream_t *child)
+{
+    if(*count == *size)
+    {
+        *size = (*size) ? (*size * 2) : 4;
+        *list = realloc(*list, *size * sizeof(module_stream_t *));
+        asc_assert(*list != NULL, "[module_stream] failed to allocate child list");
+    }
+    (*list)[(*count)++] = child;
+}
+
+/* keeps order of childs */
+static void stream_list_remove(module_stream_t **list, uint32_t *count, module_stream_t *child)
+{
+    for(uint32_t i = 0; i < *count; ++i)
+    {
+        if(list[i] == child)
+        {
+            --(*count);
+            memmove(&list[i], &list[i + 1], (*count - i) * sizeof(module_stream_t *));
+            return;
+        }
+    }
+}
+
+static void stream_pid_attach(void *arg)
+{
+    stream_link_t *link = arg;
+    module_stream_t *stream = link->stream;
+
+    if(link->child->is_broadcast)
+        return;
+
+    if(!stream->pid_map)
+    {
+        stream->pid_map = calloc(MAX_PID, sizeof(module_stream_pid_t));
+        asc_assert(stream->pid_map != NULL, "[module_stream] failed to allocate pid map");
+    }
+
+    module_stream_pid_t *item = &stream->pid_map[link->pid];
+    stream_list_append(&item->list, &item->count, &item->size, link->child);
+}
+
+static void stream_pid_detach(void *arg)
+{
+    stream_link_t *link = arg;
+    module_stream_t *stream = link->stream;
+
+    if(!stream->pid_map)
+        return;
+
+    module_stream_pid_t *item = &stream->pid_map[link->pid];
+    stream_list_remove(item->list, &item->count, link->child);
+}
+
+static void stream_pid_map_destroy(module_stream_t *stream)
+{
+    if(!stream->pid_map)
+        return;
+
+    for(int i = 0; i < MAX_PID; ++i)
+        free(stream->pid_map[i].list);
+    free(stream->pid_map);
+    stream->pid_map = NULL;
+}
+
+/* list of childs without demux and childs with is_broadcast */
+static void stream_broadcast_update(void *arg)
+{
+    module_stream_t *stream = arg;
+
+    stream->broadcast_count = 0;
+    module_stream_t *i;
+    TAILQ_FOREACH(i, &stream->childs, entries)
+    {
+        if(!i->pid_list || i->is_broadcast)
+        {
+            stream_list_append(&stream->broadcast, &stream->broadcast_count
+                               , &stream->broadcast_size, i);
+        }
+    }
+}
+
+void __module_stream_demux_set(module_stream_t *stream)
+{
+    if(stream->parent)
+        asc_reactor_call_wait(stream->parent->reactor, stream_broadcast_update, stream->parent);
+}
+
+void __module_stream_join_pid(module_stream_t *stream, uint16_t pid)
+{
+    if(!stream->parent)
+        return;
+
+    stream_link_t link = { stream->parent, stream, pid };
+    asc_reactor_call_wait(stream->parent->reactor, stream_pid_attach, &link);
+}
+
+void __module_stream_leave_pid(module_stream_t *stream, uint16_t pid)
 {
+    if(!stream->parent)
+        return;
+
+    stream_link_t link = { stream->parent, stream, pid };
+    asc_reactor_call_wait(stream->parent->reactor, stream_pid_detach, &link);
+}
+
+/*
+ * ooooooooooo oooooooooo  ooooooooooo ooooooooooo
+ * 88  888  88  888    888  888    88   888    88
+ *     888      888oooo88   888ooo8     888ooo8
+ *     888      888  88o    888    oo   888    oo
+ *    o888o    o888o  88o8 o888ooo8888 o888ooo8888
+ *
+ */
+
+static void stream_set_reactor(module_stream_t *stream, asc_reactor_t *reactor)
+{
+    stream->reactor = reactor;
+
+    module_stream_t *i;
+    TAILQ_FOREACH(i, &stream->childs, entries)
+        stream_set_reactor(i, reactor);
+}
+
+static void stream_detach(void *arg)
+{
+    stream_link_t *link = arg;
+
     module_stream_t *i, *n;
-    TAILQ_FOREACH_SAFE(i, &stream->childs, entries, n)
+    TAILQ_FOREACH_SAFE(i, &link->stream->childs, entries, n)
     {
-        if(i == child)
+        if(i == link->child)
         {
-            TAILQ_REMOVE(&stream->childs, i, entries);
+            TAILQ_REMOVE(&link->stream->childs, i, entries);
             break;
         }
     }
-    child->parent = NULL;
+    link->child->parent = NULL;
+    stream_set_reactor(link->child, NULL);
+
+    if(link->child->pid_list)
+    {
+        for(int pid = 0; pid < MAX_PID; ++pid)
+        {
+            if(link->child->pid_list[pid])
+            {
+                link->pid = pid;
+                stream_pid_detach(link);
+            }
+        }
+    }
+    stream_broadcast_update(link->stream);
+}
+
+static void stream_attach(void *arg)
+{
+    stream_link_t *link = arg;
+
+    link->child->parent = link->stream;
+    TAILQ_INSERT_TAIL(&link->stream->childs, link->child, entries);
+    stream_set_reactor(link->child, link->stream->reactor);
+
+    if(link->child->pid_list)
+    {
+        for(int pid = 0; pid < MAX_PID; ++pid)
+        {
+            if(link->child->pid_list[pid])
+            {
+                link->pid = pid;
+                stream_pid_attach(link);
+            }
+        }
+    }
+    stream_broadcast_update(link->stream);
+}
+
+static void stream_clear(void *arg)
+{
+    module_stream_t *stream = arg;
+
+    module_stream_t *i, *n;
+    TAILQ_FOREACH_SAFE(i, &stream->childs, entries, n)
+    {
+        i->parent = NULL;
+        TAILQ_REMOVE(&stream->childs, i, entries);
+        stream_set_reactor(i, NULL);
+    }
+
+    stream->broadcast_count = 0;
+    stream_pid_map_destroy(stream);
+}
+
+void __module_stream_detach(module_stream_t *stream, module_stream_t *child)
+{
+    stream_link_t link = { stream, child, 0 };
+    asc_reactor_call_wait(stream->reactor, stream_detach, &link);
+}
+
+static bool stream_is_main_loop(const module_stream_t *stream)
+{
+    if(stream->is_main_loop)
+        return true;
+
+    const module_stream_t *i;
+    TAILQ_FOREACH(i, &stream->childs, entries)
+    {
+        if(stream_is_main_loop(i))
+            return true;
+    }
+
+    return false;
 }
 
 void __module_stream_attach(module_stream_t *stream, module_stream_t *child)
 {
+    if(stream->reactor && stream_is_main_loop(child))
+    {
+        asc_log_error("[stream] module could not be attached to the stream running in a reactor");
+        return;
+    }
+
     if(child->parent)
         __module_stream_detach(child->parent, child);
-    child->parent = stream;
-    TAILQ_INSERT_TAIL(&stream->childs, child, entries);
+
+    stream_link_t link = { stream, child, 0 };
+    asc_reactor_call_wait(stream->reactor, stream_attach, &link);
+}
+
+/* callbacks may detach the child or leave the pid, so the list is re-read
+ * on each step and the index is not moved if the child was removed */
+static inline bool stream_list_next(module_stream_t **list, uint32_t count, uint32_t i
+                                    , module_stream_t *child)
+{
+    return (i < count && list[i] == child);
+}
+
+static inline void stream_send_pid(module_stream_t *stream, asc_buffer_t *buffer
+                                   , const uint8_t *ts)
+{
+    module_stream_pid_t *item = &stream->pid_map[TS_PID(ts)];
+    for(uint32_t n = 0; n < item->count; )
+    {
+        module_stream_t *i = item->list[n];
+        if(i->on_ts)
+            i->on_ts(i->self, ts);
+        else if(i->on_ts_batch)
+            i->on_ts_batch(i->self, ts, 1);
+        else if(i->on_ts_buffer)
+            i->on_ts_buffer(i->self, buffer, ts, 1);
+
+        if(stream_list_next(item->list, item->count, n, i))
+            ++n;
+    }
 }
 
 void __module_stream_send(module_stream_t *stream, const uint8_t *ts)
 {
-    module_stream_t *i;
-    TAILQ_FOREACH(i, &stream->childs, entries)
+    for(uint32_t n = 0; n < stream->broadcast_count; )
     {
+        module_stream_t *i = stream->broadcast[n];
         if(i->on_ts)
             i->on_ts(i->self, ts);
+        else if(i->on_ts_batch)
+            i->on_ts_batch(i->self, ts, 1);
+        else if(i->on_ts_buffer)
+            i->on_ts_buffer(i->self, NULL, ts, 1);
+
+        if(stream_list_next(stream->broadcast, stream->broadcast_count, n, i))
+            ++n;
     }
+
+    if(stream->pid_map)
+        stream_send_pid(stream, NULL, ts);
+}
+
+/* the batch is a contiguous block of count TS packets.
+ * if the buffer is defined, the block is in it and childs with on_ts_buffer
+ * may keep a reference instead of copying. childs without batch callbacks
+ * receive it packet by packet */
+void __module_stream_send_buffer(module_stream_t *stream, asc_buffer_t *buffer
+                                 , const uint8_t *ts, size_t count)
+{
+    const uint8_t *const ts_end = ts + count * TS_PACKET_SIZE;
+
+    for(uint32_t n = 0; n < stream->broadcast_count; )
+    {
+        module_stream_t *i = stream->broadcast[n];
+        if(i->on_ts_buffer)
+            i->on_ts_buffer(i->self, buffer, ts, count);
+        else if(i->on_ts_batch)
+            i->on_ts_batch(i->self, ts, count);
+        else if(i->on_ts)
+        {
+            for(const uint8_t *p = ts; p < ts_end; p += TS_PACKET_SIZE)
+                i->on_ts(i->self, p);
+        }
+
+        if(stream_list_next(stream->broadcast, stream->broadcast_count, n, i))
+            ++n;
+    }
+
+    if(stream->pid_map)
+    {
+        for(const uint8_t *p = ts; p < ts_end; p += TS_PACKET_SIZE)
+            stream_send_pid(stream, buffer, p);
+    }
+}
+
+void __module_stream_send_batch(module_stream_t *stream, const uint8_t *ts, size_t count)
+{
+    __module_stream_send_buffer(stream, NULL, ts, count);
 }
 
 void __module_stream_init(module_stream_t *stream)
@@ -61,10 +365,9 @@ void __module_stream_destroy(module_stream_t *stream)
 {
     if(stream->parent)
         __module_stream_detach(stream->parent, stream);
-    module_stream_t *i, *n;
-    TAILQ_FOREACH_SAFE(i, &stream->childs, entries, n)
-    {
-        i->parent = NULL;
-        TAILQ_REMOVE(&stream->childs, i, entries);
-    }
+    asc_reactor_call_wait(stream->reactor, stream_clear, stream);
+
+    free(stream->broadcast);
+    stream->broadcast = NULL;
+    stream->broadcast_size = 0;
 }
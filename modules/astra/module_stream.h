@@ -26,17 +26,45 @@
 #include <core/asc.h>
 
 typedef struct module_stream_t module_stream_t;
+
+typedef struct
+{
+    module_stream_t **list;
+    uint32_t count;
+    uint32_t size;
+} module_stream_pid_t;
+
 struct module_stream_t
 {
     module_data_t *self;
     module_stream_t *parent;
 
+    // event loop where the tree is running. NULL - main loop
+    asc_reactor_t *reactor;
+    // module uses Lua, timers or sockets of the main loop,
+    // so it could not be attached to the tree running in a reactor
+    bool is_main_loop;
+    // child with demux that receives each packet of the parent,
+    // joined pids are only passed to the upstream
+    bool is_broadcast;
+
     // stream
     void (*on_ts)(module_data_t *mod, const uint8_t *ts);
+    void (*on_ts_batch)(module_data_t *mod, const uint8_t *ts, size_t count);
+    // ts is in the buffer. NULL buffer if packets are not reference-counted
+    void (*on_ts_buffer)(module_data_t *mod, asc_buffer_t *buffer
+                         , const uint8_t *ts, size_t count);
 
     TAILQ_ENTRY(module_stream_t) entries;
     TAILQ_HEAD(a_list_t, module_stream_t) childs;
 
+    // childs without demux receive each packet,
+    // childs with demux only packets of joined pids
+    module_stream_t **broadcast;
+    uint32_t broadcast_count;
+    uint32_t broadcast_size;
+    module_stream_pid_t *pid_map; // MAX_PID items. allocated on first join
+
     // demux
     void (*join_pid)(module_data_t *mod, uint16_t pid);
     void (*leave_pid)(module_data_t *mod, uint16_t pid);
@@ -52,6 +80,13 @@ void __module_stream_init(module_stream_t *stream);
 void __module_stream_destroy(module_stream_t *stream);
 void __module_stream_attach(module_stream_t *stream, module_stream_t *child);
 void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
+void __module_stream_send_batch(module_stream_t *stream, const uint8_t *ts, size_t count);
+void __module_stream_send_buffer(module_stream_t *stream, asc_buffer_t *buffer
+                                 , const uint8_t *ts, size_t count);
+
+void __module_stream_demux_set(module_stream_t *stream);
+void __module_stream_join_pid(module_stream_t *stream, uint16_t pid);
+void __module_stream_leave_pid(module_stream_t *stream, uint16_t pid);
 
 #define module_stream_init(_mod, _on_ts)                                                        \
     {                                                                                           \
@@ -64,11 +99,39 @@ void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
         lua_pop(lua, 1);                                                                        \
     }
 
+/* should be called before module_stream_init() */
+#define module_stream_main_loop_set(_mod)                                                       \
+    {                                                                                           \
+        _mod->__stream.is_main_loop = true;                                                     \
+    }
+
+/* should be called before module_stream_init() */
+#define module_stream_broadcast_set(_mod)                                                       \
+    {                                                                                           \
+        _mod->__stream.is_broadcast = true;                                                     \
+    }
+
+#define module_stream_reactor_set(_mod, _reactor)                                                \
+    {                                                                                           \
+        _mod->__stream.reactor = _reactor;                                                      \
+    }
+
+#define module_stream_batch_set(_mod, _on_ts_batch)                                              \
+    {                                                                                           \
+        _mod->__stream.on_ts_batch = _on_ts_batch;                                              \
+    }
+
+#define module_stream_buffer_set(_mod, _on_ts_buffer)                                           \
+    {                                                                                           \
+        _mod->__stream.on_ts_buffer = _on_ts_buffer;                                            \
+    }
+
 #define module_stream_demux_set(_mod, _join_pid, _leave_pid)                                    \
     {                                                                                           \
         _mod->__stream.pid_list = calloc(MAX_PID, sizeof(uint8_t));                             \
         _mod->__stream.join_pid = _join_pid;                                                    \
         _mod->__stream.leave_pid = _leave_pid;                                                  \
+        __module_stream_demux_set(&_mod->__stream);                                             \
     }
 
 #define module_stream_destroy(_mod)                                                             \
@@ -91,6 +154,12 @@ void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
 #define module_stream_send(_mod, _ts)                                                           \
     __module_stream_send(&_mod->__stream, _ts)
 
+#define module_stream_send_batch(_mod, _ts, _count)                                             \
+    __module_stream_send_batch(&_mod->__stream, _ts, _count)
+
+#define module_stream_send_buffer(_mod, _buffer, _ts, _count)                                   \
+    __module_stream_send_buffer(&_mod->__stream, _buffer, _ts, _count)
+
 // demux
 
 #define module_stream_demux_check_pid(_mod, _pid)                                               \
@@ -102,6 +171,8 @@ void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
         asc_assert(_mod->__stream.pid_list != NULL                                              \
                    , "%s:%d module_stream_demux_set() is required", __FILE__, __LINE__);        \
         ++_mod->__stream.pid_list[__pid];                                                       \
+        if(_mod->__stream.pid_list[__pid] == 1)                                                 \
+            __module_stream_join_pid(&_mod->__stream, __pid);                                   \
         if(_mod->__stream.pid_list[__pid] == 1                                                  \
            && _mod->__stream.parent                                                             \
            && _mod->__stream.parent->join_pid)                                                  \
@@ -118,6 +189,8 @@ void __module_stream_send(module_stream_t *stream, const uint8_t *ts);
         if(_mod->__stream.pid_list[__pid] > 0)                                                  \
         {                                                                                       \
             --_mod->__stream.pid_list[__pid];                                                   \
+            if(_mod->__stream.pid_list[__pid] == 0)                                             \
+                __module_stream_leave_pid(&_mod->__stream, __pid);                              \
             if(_mod->__stream.pid_list[__pid] == 0                                              \
                && _mod->__stream.parent                                                         \
                && _mod->__stream.parent->leave_pid)                                             \
@@ -23,11 +23,10 @@
 
 #include <fcntl.h>
 #include <poll.h>
-#include <sys/socket.h>
 
 #define MSG(_msg) "[ddci %d:%d] " _msg, mod->adapter, mod->device
 
-#define BUFFER_SIZE (1022 * TS_PACKET_SIZE)
+#define BUFFER_SIZE 1024 /* packets */
 
 struct module_data_t
 {
@@ -54,14 +53,9 @@ struct module_data_t
     {
         asc_thread_t *thread;
 
-        int fd[2];
+        asc_ring_t *ring;
         asc_event_t *event;
 
-        uint8_t *buffer;
-        uint32_t buffer_size;
-        uint32_t buffer_count;
-        uint32_t buffer_read;
-        uint32_t buffer_write;
         uint32_t buffer_overflow;
     } sync;
 };
@@ -78,7 +72,7 @@ struct module_data_t
 
 static void sync_queue_push(module_data_t *mod, const uint8_t *ts)
 {
-    if(mod->sync.buffer_count >= mod->sync.buffer_size)
+    if(!asc_ring_push(mod->sync.ring, ts, 1))
     {
         ++mod->sync.buffer_overflow;
         return;
@@ -89,31 +83,6 @@ static void sync_queue_push(module_data_t *mod, const uint8_t *ts)
         asc_log_error(MSG("sync buffer overflow. dropped %d packets"), mod->sync.buffer_overflow);
         mod->sync.buffer_overflow = 0;
     }
-
-    memcpy(&mod->sync.buffer[mod->sync.buffer_write], ts, TS_PACKET_SIZE);
-    mod->sync.buffer_write += TS_PACKET_SIZE;
-    if(mod->sync.buffer_write >= mod->sync.buffer_size)
-        mod->sync.buffer_write = 0;
-
-    __sync_fetch_and_add(&mod->sync.buffer_count, TS_PACKET_SIZE);
-
-    uint8_t cmd[1] = { 0 };
-    if(send(mod->sync.fd[0], cmd, sizeof(cmd), 0) != sizeof(cmd))
-        asc_log_error(MSG("failed to push signal to queue\n"));
-}
-
-static void sync_queue_pop(module_data_t *mod, uint8_t *ts)
-{
-    uint8_t cmd[1];
-    if(recv(mod->sync.fd[1], cmd, sizeof(cmd), 0) != sizeof(cmd))
-        asc_log_error(MSG("failed to pop signal from queue\n"));
-
-    memcpy(ts, &mod->sync.buffer[mod->sync.buffer_read], TS_PACKET_SIZE);
-    mod->sync.buffer_read += TS_PACKET_SIZE;
-    if(mod->sync.buffer_read >= mod->sync.buffer_size)
-        mod->sync.buffer_read = 0;
-
-    __sync_fetch_and_sub(&mod->sync.buffer_count, TS_PACKET_SIZE);
 }
 
 static void sec_thread_loop(void *arg)
@@ -136,9 +105,15 @@ static void on_thread_read(void *arg)
 {
     module_data_t *mod = arg;
 
-    uint8_t ts[TS_PACKET_SIZE];
-    sync_queue_pop(mod, ts);
-    module_stream_send(mod, ts);
+    asc_ring_wait_reset(mod->sync.ring);
+
+    const void *ts;
+    size_t count;
+    while((count = asc_ring_peek(mod->sync.ring, &ts)) > 0)
+    {
+        module_stream_send_batch(mod, ts, count);
+        asc_ring_release(mod->sync.ring, count);
+    }
 }
 
 static void sec_open(module_data_t *mod)
@@ -150,12 +125,9 @@ static void sec_open(module_data_t *mod)
         astra_abort();
     }
 
-    socketpair(AF_LOCAL, SOCK_STREAM, 0, mod->sync.fd);
-
-    mod->sync.event = asc_event_init(mod->sync.fd[1], mod);
+    mod->sync.ring = asc_ring_init(TS_PACKET_SIZE, BUFFER_SIZE, true);
+    mod->sync.event = asc_event_init(asc_ring_fd(mod->sync.ring), mod);
     asc_event_set_on_read(mod->sync.event, on_thread_read);
-    mod->sync.buffer = malloc(BUFFER_SIZE);
-    mod->sync.buffer_size = BUFFER_SIZE;
 
     asc_thread_init(&mod->sync.thread, sec_thread_loop, mod);
 }
@@ -170,13 +142,9 @@ static void sec_close(module_data_t *mod)
 
     asc_thread_destroy(&mod->sync.thread);
     asc_event_close(mod->sync.event);
-    if(mod->sync.fd[0])
-    {
-        close(mod->sync.fd[0]);
-        close(mod->sync.fd[1]);
-    }
-    if(mod->sync.buffer)
-        free(mod->sync.buffer);
+    mod->sync.event = NULL;
+    asc_ring_destroy(mod->sync.ring);
+    mod->sync.ring = NULL;
 }
 
 /*
@@ -270,6 +238,9 @@ static int method_ca_set_pnr(module_data_t *mod)
 
 static void module_init(module_data_t *mod)
 {
+    module_stream_main_loop_set(mod);
+    // the CI device receives the whole stream
+    module_stream_broadcast_set(mod);
     module_stream_init(mod, on_ts);
     module_stream_demux_set(mod, join_pid, leave_pid);
 
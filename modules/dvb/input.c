@@ -96,13 +96,13 @@ static void dvr_on_read(void *arg)
     }
     mod->dvr_read += len;
 
-    for(int i = 0; i < len; i += TS_PACKET_SIZE)
+    if(mod->ca->ca_fd > 0)
     {
-        if(mod->ca->ca_fd > 0)
+        for(int i = 0; i < len; i += TS_PACKET_SIZE)
             ca_on_ts(mod->ca, &mod->dvr_buffer[i]);
-
-        module_stream_send(mod, &mod->dvr_buffer[i]);
     }
+
+    module_stream_send_batch(mod, mod->dvr_buffer, len / TS_PACKET_SIZE);
 }
 
 static void dvr_open(module_data_t *mod)
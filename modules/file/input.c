@@ -37,7 +37,6 @@
 
 #include <sys/mman.h>
 #include <fcntl.h>
-#include <sys/socket.h>
 
 #define MSG(_msg) "[file_intput %s] " _msg, mod->filename
 
@@ -103,7 +102,7 @@ MODULE_LUA_METHODS()
 
 #else
 
-#define SYNC_BUFFER_SIZE (TS_PACKET_SIZE * 2048)
+#define SYNC_BUFFER_SIZE 2048 /* packets */
 
 struct module_data_t
 {
@@ -132,14 +131,9 @@ struct module_data_t
     {
         asc_thread_t *thread;
 
-        int fd[2];
+        asc_ring_t *ring;
         asc_event_t *event;
 
-        uint8_t *buffer;
-        uint32_t buffer_size;
-        uint32_t buffer_count;
-        uint32_t buffer_read;
-        uint32_t buffer_write;
         uint32_t buffer_overflow;
     } sync;
     uint64_t pcr;
@@ -309,7 +303,7 @@ static int open_file(module_data_t *mod)
 
 static void sync_queue_push(module_data_t *mod, const uint8_t *ts)
 {
-    if(mod->sync.buffer_count >= mod->sync.buffer_size)
+    if(!asc_ring_push(mod->sync.ring, ts, 1))
     {
         ++mod->sync.buffer_overflow;
         return;
@@ -320,31 +314,6 @@ static void sync_queue_push(module_data_t *mod, const uint8_t *ts)
         asc_log_error(MSG("sync buffer overflow. dropped %d packets"), mod->sync.buffer_overflow);
         mod->sync.buffer_overflow = 0;
     }
-
-    memcpy(&mod->sync.buffer[mod->sync.buffer_write], ts, TS_PACKET_SIZE);
-    mod->sync.buffer_write += TS_PACKET_SIZE;
-    if(mod->sync.buffer_write >= mod->sync.buffer_size)
-        mod->sync.buffer_write = 0;
-
-    __sync_fetch_and_add(&mod->sync.buffer_count, TS_PACKET_SIZE);
-
-    uint8_t cmd[1] = { 0 };
-    if(send(mod->sync.fd[0], cmd, sizeof(cmd), 0) != sizeof(cmd))
-        asc_log_error(MSG("failed to push signal to queue\n"));
-}
-
-static void sync_queue_pop(module_data_t *mod, uint8_t *ts)
-{
-    uint8_t cmd[1];
-    if(recv(mod->sync.fd[1], cmd, sizeof(cmd), 0) != sizeof(cmd))
-        asc_log_error(MSG("failed to pop signal from queue\n"));
-
-    memcpy(ts, &mod->sync.buffer[mod->sync.buffer_read], TS_PACKET_SIZE);
-    mod->sync.buffer_read += TS_PACKET_SIZE;
-    if(mod->sync.buffer_read >= mod->sync.buffer_size)
-        mod->sync.buffer_read = 0;
-
-    __sync_fetch_and_sub(&mod->sync.buffer_count, TS_PACKET_SIZE);
 }
 
 static void thread_loop(void *arg)
@@ -511,9 +480,15 @@ static void on_thread_read(void *arg)
 {
     module_data_t *mod = arg;
 
-    uint8_t ts[TS_PACKET_SIZE];
-    sync_queue_pop(mod, ts);
-    module_stream_send(mod, ts);
+    asc_ring_wait_reset(mod->sync.ring);
+
+    const void *ts;
+    size_t count;
+    while((count = asc_ring_peek(mod->sync.ring, &ts)) > 0)
+    {
+        module_stream_send_batch(mod, ts, count);
+        asc_ring_release(mod->sync.ring, count);
+    }
 }
 
 static void timer_skip_set(void *arg)
@@ -617,12 +592,9 @@ static void module_init(module_data_t *mod)
         mod->timer_skip = asc_timer_init(2000, timer_skip_set, mod);
     }
 
-    socketpair(AF_LOCAL, SOCK_STREAM, 0, mod->sync.fd);
-
-    mod->sync.event = asc_event_init(mod->sync.fd[1], mod);
+    mod->sync.ring = asc_ring_init(TS_PACKET_SIZE, SYNC_BUFFER_SIZE, true);
+    mod->sync.event = asc_event_init(asc_ring_fd(mod->sync.ring), mod);
     asc_event_set_on_read(mod->sync.event, on_thread_read);
-    mod->sync.buffer = malloc(SYNC_BUFFER_SIZE);
-    mod->sync.buffer_size = SYNC_BUFFER_SIZE;
 
     asc_thread_init(&mod->sync.thread, thread_loop, mod);
 }
@@ -633,14 +605,7 @@ static void module_destroy(module_data_t *mod)
     asc_thread_destroy(&mod->sync.thread);
 
     asc_event_close(mod->sync.event);
-    if(mod->sync.fd[0])
-    {
-        close(mod->sync.fd[0]);
-        close(mod->sync.fd[1]);
-    }
-
-    if(mod->sync.buffer)
-        free(mod->sync.buffer);
+    asc_ring_destroy(mod->sync.ring);
 
     if(mod->idx_callback)
     {
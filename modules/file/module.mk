@@ -56,5 +56,9 @@ if check_aio ; then
             CFLAGS="$CFLAGS -DHAVE_LIBAIO=1"
             LDFLAGS="$LDFLAGS -laio"
         fi
+        # check_io_uring is defined in core/module.mk
+        if check_io_uring ; then
+            CFLAGS="$CFLAGS -DHAVE_IO_URING=1"
+        fi
     fi
 fi
@@ -27,6 +27,7 @@
  *      m2ts        - boolean, use m2ts file format [default : false]
  *      buffer_size - number, output buffer size. in kilobytes [default : 32]
  *      aio         - boolean, use aio [default : false]
+ *      aio_queue   - number, number of buffers written at once with aio [default : 4]
  *      directio    - boolean, try to avoid all caching operations [default : false]
  *
  * Module Methods:
@@ -45,12 +46,40 @@
 #endif /* HAVE_AIO */
 
 #define FILE_BUFFER_SIZE 32
+#define FILE_AIO_QUEUE 4
+#define FILE_AIO_QUEUE_MAX 64
 
 #define ALIGN 4096
 #define align(_size) ((_size / ALIGN) * ALIGN)
 
 #define MSG(_msg) "[file_output %s] " _msg, mod->filename
 
+#ifdef HAVE_AIO
+
+typedef enum
+{
+    FILE_AIO_POSIX = 0,
+    FILE_AIO_LIBAIO,
+    FILE_AIO_URING,
+} file_aio_type_t;
+
+typedef struct
+{
+    uint8_t *buffer;
+    ssize_t size;
+    bool is_busy;
+
+    struct aiocb aiocb;
+#ifdef HAVE_LIBAIO
+    struct iocb iocb;
+#endif
+#ifdef HAVE_IO_URING
+    struct iovec iov;
+#endif
+} file_aio_t;
+
+#endif /* HAVE_AIO */
+
 struct module_data_t
 {
     MODULE_LUA_DATA();
@@ -67,14 +96,20 @@ struct module_data_t
 
 #ifdef HAVE_AIO
     int aio;
+    file_aio_type_t aio_type;
+
+    // writes are submitted and completed in the queue order
+    file_aio_t *aio_queue;
+    int aio_queue_size;
+    int aio_next;
+    int aio_busy;
 
-    struct aiocb aiocb;
-    void *buffer_aio;
 #ifdef HAVE_LIBAIO
-    int aio_kernel;
     io_context_t ctx;
-    struct iocb *io[1];
 #endif /* HAVE_LIBAIO */
+#ifdef HAVE_IO_URING
+    asc_uring_t *uring;
+#endif /* HAVE_IO_URING */
 #endif /* HAVE_AIO */
 
     size_t file_size;
@@ -85,86 +120,310 @@ struct module_data_t
     uint8_t *buffer; // write buffer
 };
 
-/* stream_ts callbacks */
+static void * aligned_malloc(size_t size)
+{
+    void *ptr = NULL;
+#ifdef HAVE_POSIX_MEMALIGN
+    if(posix_memalign(&ptr, ALIGN, size))
+        ptr = NULL;
+#else
+    ptr = malloc(size);
+#endif
+    return ptr;
+}
 
-static void module_destroy(module_data_t *mod);
+/*
+ *      o      ooooo  ooooooo
+ *     888      888 o888   888o
+ *    8  88     888 888     888
+ *   8oooo88    888 888o   o888
+ * o88o  o888o o888o  88ooo88
+ *
+ */
 
-static void on_ts(module_data_t *mod, const uint8_t *ts)
+#ifdef HAVE_AIO
+
+static void aio_queue_complete(module_data_t *mod, file_aio_t *item, ssize_t ret)
 {
-    if(mod->buffer_skip > mod->buffer_size - mod->packet_size || !ts)
+    item->is_busy = false;
+    --mod->aio_busy;
+
+    if(ret == item->size)
+        return;
+
+    if(ret < 0)
+        asc_log_error(MSG("aio write error: %s"), strerror(-ret));
+    else
+        asc_log_error(MSG("aio write error: %zd bytes of %zd"), ret, item->size);
+    mod->error = true;
+}
+
+/* checks completed writes. if is_wait, waits for all submitted writes */
+static void aio_queue_reap(module_data_t *mod, bool is_wait)
+{
+    while(mod->aio_busy > 0)
     {
-        ssize_t size;
-#ifdef HAVE_AIO
-        if(mod->aio)
+        switch(mod->aio_type)
         {
-            size = align(mod->buffer_skip);
-
-#ifdef HAVE_LIBAIO
-            if(mod->aio_kernel)
+#ifdef HAVE_IO_URING
+            case FILE_AIO_URING:
             {
-                if(!mod->io[0])
-                    mod->io[0] = malloc(sizeof(struct iocb));
-                else
+                if(is_wait && asc_uring_submit(mod->uring, 1) == -1)
                 {
-                    struct io_event events[1];
-                    if(!io_getevents(mod->ctx, 1, 1, events, 0))
-                    {
-                        if(!mod->error)
-                        {
-                            asc_log_error(MSG("io_submit in progress. "
-                                              "Try to increase buffer size"));
-                            mod->error = true;
-                        }
-                        return;
-                    }
+                    asc_log_error(MSG("io_uring_enter error: %s"), strerror(errno));
+                    return;
                 }
 
-                memcpy(mod->buffer_aio, mod->buffer, size);
-                io_prep_pwrite(mod->io[0], mod->fd, mod->buffer_aio, size, mod->file_size);
-                if(io_submit(mod->ctx, 1, mod->io) != 1)
+                struct io_uring_cqe *cqe;
+                while((cqe = asc_uring_peek_cqe(mod->uring)) != NULL)
                 {
-                    asc_log_error(MSG("Error at io_submit"));
-                    mod->error = true;
-                    module_destroy(mod);
+                    aio_queue_complete(mod, &mod->aio_queue[cqe->user_data], cqe->res);
+                    asc_uring_cqe_seen(mod->uring);
+                }
+                break;
+            }
+#endif /* HAVE_IO_URING */
+#ifdef HAVE_LIBAIO
+            case FILE_AIO_LIBAIO:
+            {
+                struct io_event events[FILE_AIO_QUEUE_MAX];
+                struct timespec timeout = { 0, 0 };
+                const int count = io_getevents(mod->ctx, is_wait ? 1 : 0, mod->aio_busy
+                                               , events, is_wait ? NULL : &timeout);
+                if(count < 0)
+                {
+                    asc_log_error(MSG("io_getevents error: %s"), strerror(-count));
                     return;
                 }
+
+                for(int i = 0; i < count; ++i)
+                    aio_queue_complete(mod, events[i].data, (long)events[i].res);
+                break;
             }
-            else
 #endif /* HAVE_LIBAIO */
+            default:
             {
-                int error = aio_error(&mod->aiocb);
-                if(error == EINPROGRESS)
+                const struct aiocb *list[FILE_AIO_QUEUE_MAX];
+                int count = 0;
+
+                for(int i = 0; i < mod->aio_queue_size; ++i)
                 {
-                    if(!mod->error)
+                    file_aio_t *item = &mod->aio_queue[i];
+                    if(!item->is_busy)
+                        continue;
+
+                    const int error = aio_error(&item->aiocb);
+                    if(error == EINPROGRESS)
                     {
-                        asc_log_error(MSG("aio_write in progress. "
-                                          "Try to increase buffer size"));
-                        mod->error = true;
+                        list[count++] = &item->aiocb;
+                        continue;
                     }
-                    return;
-                }
-                else if(error != 0)
-                {
-                    asc_log_error(MSG("Error at aio_write: %s"), strerror(errno));
-                    mod->error = true;
-                    module_destroy(mod);
-                    return;
+
+                    const ssize_t ret = aio_return(&item->aiocb);
+                    aio_queue_complete(mod, item, (error) ? -error : ret);
                 }
 
-                memcpy(mod->buffer_aio, mod->buffer, size);
-                mod->aiocb.aio_nbytes = size;
+                if(is_wait && count > 0)
+                    aio_suspend(list, count, NULL);
+                break;
+            }
+        }
+
+        if(!is_wait)
+            return;
+    }
+}
+
+static bool aio_queue_submit(module_data_t *mod, ssize_t size)
+{
+    aio_queue_reap(mod, false);
+
+    file_aio_t *item = &mod->aio_queue[mod->aio_next];
+    if(item->is_busy)
+    {
+        if(!mod->error)
+        {
+            asc_log_error(MSG("aio queue is full. "
+                              "Try to increase buffer_size or aio_queue"));
+            mod->error = true;
+        }
+        return false;
+    }
+
+    memcpy(item->buffer, mod->buffer, size);
+    item->size = size;
 
-                aio_write(&mod->aiocb);
+    int ret = 0;
+    switch(mod->aio_type)
+    {
+#ifdef HAVE_IO_URING
+        case FILE_AIO_URING:
+        {
+            struct io_uring_sqe *sqe = asc_uring_get_sqe(mod->uring);
+            if(!sqe)
+            {
+                errno = EBUSY;
+                ret = -1;
+                break;
             }
+
+            item->iov.iov_base = item->buffer;
+            item->iov.iov_len = size;
+
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->fd = mod->fd;
+            sqe->addr = (uintptr_t)&item->iov;
+            sqe->len = 1;
+            sqe->off = mod->file_size;
+            sqe->user_data = mod->aio_next;
+
+            ret = (asc_uring_submit(mod->uring, 0) == 1) ? 0 : -1;
+            break;
         }
-        else
+#endif /* HAVE_IO_URING */
+#ifdef HAVE_LIBAIO
+        case FILE_AIO_LIBAIO:
+        {
+            struct iocb *list[1] = { &item->iocb };
+            io_prep_pwrite(&item->iocb, mod->fd, item->buffer, size, mod->file_size);
+            item->iocb.data = item;
+
+            const int count = io_submit(mod->ctx, 1, list);
+            if(count != 1)
+            {
+                errno = (count < 0) ? -count : EAGAIN;
+                ret = -1;
+            }
+            break;
+        }
+#endif /* HAVE_LIBAIO */
+        default:
+        {
+            item->aiocb.aio_buf = item->buffer;
+            item->aiocb.aio_nbytes = size;
+            item->aiocb.aio_offset = mod->file_size;
+            ret = aio_write(&item->aiocb);
+            break;
+        }
+    }
+
+    if(ret != 0)
+    {
+        asc_log_error(MSG("failed to submit aio write: %s"), strerror(errno));
+        mod->error = true;
+        return false;
+    }
+
+    item->is_busy = true;
+    ++mod->aio_busy;
+    mod->aio_next = (mod->aio_next + 1) % mod->aio_queue_size;
+    mod->error = false;
+
+    return true;
+}
+
+static void aio_queue_init(module_data_t *mod)
+{
+    mod->aio_queue_size = FILE_AIO_QUEUE;
+    module_option_number("aio_queue", &mod->aio_queue_size);
+    if(mod->aio_queue_size < 1 || mod->aio_queue_size > FILE_AIO_QUEUE_MAX)
+    {
+        asc_log_error(MSG("option 'aio_queue' must be in range 1-%d"), FILE_AIO_QUEUE_MAX);
+        astra_abort();
+    }
+
+    mod->aio_queue = calloc(mod->aio_queue_size, sizeof(file_aio_t));
+    for(int i = 0; i < mod->aio_queue_size; ++i)
+    {
+        file_aio_t *item = &mod->aio_queue[i];
+        item->buffer = aligned_malloc(mod->buffer_size);
+        if(!item->buffer)
+        {
+            asc_log_error(MSG("cannot malloc aligned memory"));
+            astra_abort();
+        }
+
+        item->aiocb.aio_fildes = mod->fd;
+        item->aiocb.aio_lio_opcode = LIO_WRITE;
+        item->aiocb.aio_sigevent.sigev_notify = SIGEV_NONE;
+    }
+
+    mod->aio_type = FILE_AIO_POSIX;
+
+#ifdef HAVE_IO_URING
+    mod->uring = asc_uring_init(mod->aio_queue_size);
+    if(mod->uring)
+    {
+        mod->aio_type = FILE_AIO_URING;
+        asc_log_debug(MSG("using io_uring"));
+        return;
+    }
+#endif /* HAVE_IO_URING */
+
+#ifdef HAVE_LIBAIO
+    // kernel aio is asynchronous only with O_DIRECT
+    if(mod->directio)
+    {
+        memset(&mod->ctx, 0, sizeof(mod->ctx));
+        const int ret = io_queue_init(mod->aio_queue_size, &mod->ctx);
+        if(ret == 0)
+        {
+            mod->aio_type = FILE_AIO_LIBAIO;
+            asc_log_debug(MSG("using libaio"));
+            return;
+        }
+        asc_log_warning(MSG("io_queue_init error: %s"), strerror(-ret));
+    }
+#endif /* HAVE_LIBAIO */
+
+    asc_log_debug(MSG("using posix aio"));
+}
+
+static void aio_queue_destroy(module_data_t *mod)
+{
+    aio_queue_reap(mod, true);
+
+#ifdef HAVE_IO_URING
+    if(mod->aio_type == FILE_AIO_URING)
+        asc_uring_destroy(mod->uring);
+#endif
+#ifdef HAVE_LIBAIO
+    if(mod->aio_type == FILE_AIO_LIBAIO)
+        io_destroy(mod->ctx);
+#endif
+
+    for(int i = 0; i < mod->aio_queue_size; ++i)
+        free(mod->aio_queue[i].buffer);
+    free(mod->aio_queue);
+    mod->aio_queue = NULL;
+}
+
 #endif /* HAVE_AIO */
-        { /* !mod->aio */
+
+/* stream_ts callbacks */
+
+static void module_destroy(module_data_t *mod);
+
+static void on_ts(module_data_t *mod, const uint8_t *ts)
+{
+    if(mod->buffer_skip > mod->buffer_size - mod->packet_size || !ts)
+    {
+        ssize_t size;
 #ifdef O_DIRECT
-            size = mod->directio ? align(mod->buffer_skip) : mod->buffer_skip;
+        size = mod->directio ? align(mod->buffer_skip) : mod->buffer_skip;
 #else
-            size = mod->buffer_skip;
+        size = mod->buffer_skip;
 #endif /* O_DIRECT */
+
+#ifdef HAVE_AIO
+        if(mod->aio)
+        {
+            if(size > 0 && !aio_queue_submit(mod, size))
+                return;
+        }
+        else
+#endif /* HAVE_AIO */
+        { /* !mod->aio */
             if(write(mod->fd, mod->buffer, size) != size)
             {
                 if(errno == EAGAIN)
@@ -201,9 +460,7 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     }
     else
     {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        uint32_t t = (tv.tv_usec / 1000) + (tv.tv_sec * 1000);
+        const uint32_t t = asc_utime_now() / 1000;
         mod->buffer[0 + mod->buffer_skip] = (t >> 24) & 0xFF;
         mod->buffer[1 + mod->buffer_skip] = (t >> 16) & 0xFF;
         mod->buffer[2 + mod->buffer_skip] = (t >>  8) & 0xFF;
@@ -246,9 +503,6 @@ static void module_init(module_data_t *mod)
 
 #ifdef HAVE_AIO
     module_option_number("aio", &mod->aio);
-#ifdef HAVE_LIBAIO
-    mod->aio_kernel = mod->aio && mod->directio;
-#endif /* HAVE_LIBAIO */
 #endif /* HAVE_AIO */
 
     int buffer_size = 0;
@@ -257,7 +511,6 @@ static void module_init(module_data_t *mod)
     else
         mod->buffer_size = buffer_size * 1024;
 
-
 #if defined(HAVE_POSIX_MEMALIGN) && defined(O_DIRECT)
     if(mod->directio
 #ifdef HAVE_AIO
@@ -265,7 +518,8 @@ static void module_init(module_data_t *mod)
 #endif
        )
     {
-        if(posix_memalign((void *)&mod->buffer, ALIGN, mod->buffer_size))
+        mod->buffer = aligned_malloc(mod->buffer_size);
+        if(!mod->buffer)
         {
             asc_log_error(MSG("cannot malloc aligned memory"));
             astra_abort();
@@ -277,12 +531,18 @@ static void module_init(module_data_t *mod)
         mod->buffer = malloc(mod->buffer_size);
     }
 
-    int flags = O_CREAT | O_APPEND | O_RDWR;
+    int flags = O_CREAT | O_RDWR;
     int mode = S_IRUSR | S_IWUSR;
 
 #ifdef HAVE_AIO
     flags |= O_BINARY | O_NONBLOCK;
     mode |= S_IRGRP | S_IROTH;
+
+    // writes with aio have explicit offsets and may complete in any order
+    if(!mod->aio)
+        flags |= O_APPEND;
+#else
+    flags |= O_APPEND;
 #endif
 
 #ifdef O_DIRECT
@@ -292,50 +552,22 @@ static void module_init(module_data_t *mod)
 
     mod->fd = open(mod->filename, flags, mode);
 
-
-    struct stat st;
-    fstat(mod->fd, &st);
-    mod->file_size = st.st_size;
-
     if(mod->fd <= 0)
     {
         asc_log_error(MSG("failed to open file [%s]"), strerror(errno));
         astra_abort();
     }
 
+    struct stat st;
+    fstat(mod->fd, &st);
+    mod->file_size = st.st_size;
+
 #ifdef HAVE_AIO
     if(mod->aio)
-    {
-#ifdef HAVE_LIBAIO
-        if(mod->aio_kernel)
-        {
-#ifdef HAVE_POSIX_MEMALIGN
-            if(posix_memalign(&mod->buffer_aio, ALIGN, mod->buffer_size))
-            {
-                asc_log_error(MSG("cannot malloc aligned memory"));
-                astra_abort();
-            }
-#else /* !HAVE_POSIX_MEMALIGN */
-            mod->buffer_aio = malloc(mod->buffer_size);
-#endif /* HAVE_POSIX_MEMALIGN */
-            memset(&mod->ctx, 0, sizeof(mod->ctx));
-            io_queue_init(1, &mod->ctx);
-            mod->io[0] = NULL;
-        }
-        else
-#endif /* HAVE_LIBAIO */
-        { /* !mod->aio_kernel */
-            mod->buffer_aio = malloc(mod->buffer_size);
-
-            memset(&mod->aiocb, 0, sizeof(struct aiocb));
-            mod->aiocb.aio_fildes = mod->fd;
-            mod->aiocb.aio_buf = mod->buffer_aio;
-            mod->aiocb.aio_lio_opcode = LIO_WRITE;
-            mod->aiocb.aio_sigevent.sigev_notify = SIGEV_NONE;
-        }
-    } /* mod->aio */
+        aio_queue_init(mod);
 #endif /* HAVE_AIO */
 
+    module_stream_main_loop_set(mod);
     module_stream_init(mod, on_ts);
 }
 
@@ -344,39 +576,30 @@ static void module_destroy(module_data_t *mod)
     module_stream_destroy(mod);
 
 #ifdef HAVE_AIO
-    if(mod->aio)
-    {
-#ifdef HAVE_LIBAIO
-        if(mod->aio_kernel)
-        {
-            struct io_event events[1];
-            io_cancel(mod->ctx, mod->io[0], events);
-            io_destroy(mod->ctx);
-            if(mod->io[0])
-                free(mod->io[0]);
-        }
-        else
+    /* wait for pending writes, the last buffer should not hit a full queue */
+    if(mod->aio_queue)
+        aio_queue_reap(mod, true);
 #endif
-        {
-            const int error = aio_error(&mod->aiocb);
-            if(error == EINPROGRESS)
-                aio_cancel(mod->fd, &mod->aiocb);
-        }
-    }
-    else if(!mod->error)
+
+    if(!mod->error)
         on_ts(mod, NULL); /* Flush buffer */
+
+#ifdef HAVE_AIO
+    if(mod->aio_queue)
+        aio_queue_destroy(mod);
 #endif
 
     if(mod->fd > 0)
+    {
         close(mod->fd);
+        mod->fd = 0;
+    }
 
     if(mod->buffer)
+    {
         free(mod->buffer);
-
-#ifdef HAVE_AIO
-    if(mod->buffer_aio)
-        free(mod->buffer_aio);
-#endif
+        mod->buffer = NULL;
+    }
 }
 
 MODULE_LUA_METHODS()
@@ -26,6 +26,12 @@
  *      addr        - string, server IP address
  *      port        - number, server port
  *      callback    - function,
+ *      gop_cache   - number, max size of the GOP cache in KB. default: 0 - disabled
+ *                    new client of the TS stream starts with the current PAT/PMT
+ *                    and the last random access point (H.264/HEVC IDR or
+ *                    random_access_indicator) if it is not older than this size
+ *      gop_linger  - number, seconds to keep the GOP cache of the upstream
+ *                    after the last client is gone. default: 60
  *
  * Module Methods:
  *      port()      - return number, server port
@@ -42,6 +48,12 @@
  *                    * upstream - object, stream instance returned by module_instance:stream()
  *      data(client)
  *                  - return table, client data
+ *      status()    - return table, streaming statistics:
+ *                    * streams - number of upstreams with connected clients
+ *                      or with the GOP cache kept after the last client
+ *                    * resync - number of times when a slow client has lost data
+ *                      and has been moved to the actual stream position
+ *                    * gop_start - number of clients started from the GOP cache
  */
 
 #include <astra.h>
@@ -50,8 +62,17 @@
 
 #define MSG(_msg) "[http_server %s:%d] " _msg, mod->addr, mod->port
 
-#define HTTP_BUFFER_SIZE (1024 * 1024)
-#define HTTP_BUFFER_FILL (128 * 1024)
+#define HTTP_BUFFER_SIZE (64 * 1024)
+/* ring clients are woken up each time this much data is written to the ring */
+#define HTTP_RING_NOTIFY (64 * 1024)
+
+/* shared buffer for all clients of the one upstream. aligned to TS packet */
+#define HTTP_RING_SIZE (((4 * 1024 * 1024) / TS_PACKET_SIZE) * TS_PACKET_SIZE)
+
+/* GOP cache is a part of the ring. the rest is a room for the slow start */
+#define HTTP_GOP_CACHE_MAX (HTTP_RING_SIZE / 2)
+/* PAT and PMT sent before the GOP cache */
+#define HTTP_GOP_PSI_SIZE (TS_PACKET_SIZE * 16)
 
 #define FRAME_HEADER_SIZE 2
 #define FRAME_KEY_SIZE 4
@@ -59,10 +80,37 @@
 #define FRAME_SIZE16_SIZE 2
 #define FRAME_SIZE64_SIZE 8
 
+typedef struct http_client_t http_client_t;
+
 typedef struct
 {
     MODULE_STREAM_DATA();
 
+    module_data_t *mod;
+    void *upstream;
+
+    TAILQ_HEAD(http_ring_clients_t, http_client_t) clients;
+
+    uint8_t *buffer;
+    uint64_t head; // total bytes written to the ring
+    uint64_t notify; // head value on the last clients notification
+
+    // GOP cache
+    mpegts_psi_t *pat;
+    mpegts_psi_t *pmt;
+    uint16_t video_pid;
+    uint8_t video_type;
+    bool is_rap;
+    uint64_t rap_pos; // ring position of the last random access point
+    uint8_t pat_cc; // continuity counters of the last PAT and PMT packets
+    uint8_t pmt_cc;
+    uint8_t rap_pat_cc; // counters before the random access point
+    uint8_t rap_pmt_cc;
+    asc_timer_t *linger; // ring without clients is kept for the GOP cache
+} http_ring_t;
+
+struct http_client_t
+{
     module_data_t *mod;
 
     asc_socket_t *sock;
@@ -80,11 +128,20 @@ typedef struct
     FILE *src_file;
     int src_content; // lua reference
 
+    http_ring_t *ring;
+    uint64_t ring_pos; // absolute position in the ring, aligned to TS packet
+    TAILQ_ENTRY(http_client_t) ring_entries;
+
+    // sent before the ring data: rest of the partially sent TS packet
+    // or PAT/PMT for the client started from the GOP cache
+    int packet_rest_size;
+    uint8_t packet_rest[HTTP_GOP_PSI_SIZE];
+
     int buffer_skip;
     char buffer[HTTP_BUFFER_SIZE];
 
     bool is_socket_busy;
-} http_client_t;
+};
 
 struct module_data_t
 {
@@ -97,8 +154,17 @@ struct module_data_t
 
     asc_socket_t *sock;
     asc_list_t *clients;
+    asc_list_t *rings;
+
+    int gop_cache;
+    int gop_linger;
+
+    uint64_t ts_resync;
+    uint64_t gop_start;
 };
 
+static void ring_leave(http_client_t *client);
+
 /*
  *   oooooooo8 ooooo       ooooo ooooooooooo oooo   oooo ooooooooooo
  * o888     88  888         888   888    88   8888o  88  88  888  88
@@ -136,8 +202,8 @@ static void on_read_error(void *arg)
         luaL_unref(lua, LUA_REGISTRYINDEX, client->idx_data);
     lua_gc(lua, LUA_GCCOLLECT, 0);
 
-    if(client->__stream.self)
-        __module_stream_destroy(&client->__stream);
+    if(client->ring)
+        ring_leave(client);
 
     if(client->sock)
         asc_socket_close(client->sock);
@@ -361,13 +427,6 @@ static void on_read(void *arg)
                 else if(data_size == 126)
                 {
                     data_size = (data[2] << 8) | data[3];
-
-                    asc_assert(data_size < (HTTP_BUFFER_SIZE
-                                            - FRAME_HEADER_SIZE
-                                            - FRAME_SIZE16_SIZE
-                                            - FRAME_KEY_SIZE)
-                               , MSG("data_size limit"));
-
                     key = data + FRAME_HEADER_SIZE + FRAME_SIZE16_SIZE;
                 }
                 else if(data_size == 127)
@@ -380,15 +439,19 @@ static void on_read(void *arg)
                                  | ((uint64_t)data[7] << 16)
                                  | ((uint64_t)data[8] << 8 )
                                  | ((uint64_t)data[9]      ));
-
-                    asc_assert(data_size < (HTTP_BUFFER_SIZE
-                                            - FRAME_HEADER_SIZE
-                                            - FRAME_SIZE64_SIZE
-                                            - FRAME_KEY_SIZE)
-                               , MSG("data_size limit"));
-
                     key = data + FRAME_HEADER_SIZE + FRAME_SIZE64_SIZE;
                 }
+
+                // frame should be received at once
+                const size_t header_size = (key - data) + FRAME_KEY_SIZE;
+                if(data_size > (uint64_t)r || header_size + data_size > (uint64_t)r)
+                {
+                    lua_pop(lua, 3);
+                    asc_log_error(MSG("websocket frame is too large or truncated"));
+                    on_read_error(client);
+                    return;
+                }
+
                 data = key + FRAME_KEY_SIZE;
 
                 // TODO: check FIN
@@ -503,66 +566,453 @@ static void on_ready_send_file(void *arg)
         client->src_file = NULL;
 }
 
-static void on_ready_send_ts(void *arg)
+/*
+ * TS streaming. all clients of the one upstream share the ring buffer and
+ * each client has only a read position in it. a client which falls behind
+ * the ring size is moved to the actual position.
+ */
+
+static void on_ready_send_ts(void *arg);
+
+static void client_check_ts_lag(http_client_t *client)
 {
-    http_client_t *client = arg;
+    http_ring_t *ring = client->ring;
     module_data_t *mod = client->mod;
 
-    const ssize_t send_size = asc_socket_send(client->sock
-                                              , client->buffer, client->buffer_skip);
-    if(send_size > 0)
+    if(ring->head - client->ring_pos > HTTP_RING_SIZE)
     {
-        client->buffer_skip -= send_size;
-        if(client->buffer_skip > 0)
-            memmove(client->buffer, &client->buffer[send_size], client->buffer_skip);
+        ++mod->ts_resync;
+        asc_log_warning(MSG("client:%d is too slow. skip %llu bytes")
+                        , asc_socket_fd(client->sock)
+                        , (unsigned long long)(ring->head - client->ring_pos));
+        client->ring_pos = ring->head;
     }
-    else if(send_size == -1)
+}
+
+/* returns false on socket error */
+static bool client_send_ts(http_client_t *client)
+{
+    http_ring_t *ring = client->ring;
+    module_data_t *mod = client->mod;
+
+    client_check_ts_lag(client);
+
+    struct iovec iov[3];
+    int iovcnt = 0;
+
+    if(client->packet_rest_size > 0)
     {
-        asc_log_warning(MSG("failed to send ts (%d bytes) to client:%d [%s]")
-                        , client->buffer_skip, asc_socket_fd(client->sock)
-                        , asc_socket_error());
+        iov[iovcnt].iov_base = client->packet_rest;
+        iov[iovcnt].iov_len = client->packet_rest_size;
+        ++iovcnt;
+    }
+
+    size_t size = ring->head - client->ring_pos;
+    if(size > 0)
+    {
+        const size_t offset = client->ring_pos % HTTP_RING_SIZE;
+        const size_t block = (offset + size > HTTP_RING_SIZE)
+                           ? (HTTP_RING_SIZE - offset)
+                           : size;
+        iov[iovcnt].iov_base = &ring->buffer[offset];
+        iov[iovcnt].iov_len = block;
+        ++iovcnt;
+
+        if(block < size)
+        {
+            iov[iovcnt].iov_base = ring->buffer;
+            iov[iovcnt].iov_len = size - block;
+            ++iovcnt;
+        }
+    }
+
+    if(iovcnt > 0)
+    {
+        ssize_t send_size = asc_socket_sendv(client->sock, iov, iovcnt);
+        if(send_size == -1)
+        {
+            asc_log_warning(MSG("failed to send ts to client:%d [%s]")
+                            , asc_socket_fd(client->sock), asc_socket_error());
+            return false;
+        }
+
+        if(client->packet_rest_size > 0)
+        {
+            if(send_size < client->packet_rest_size)
+            {
+                client->packet_rest_size -= send_size;
+                memmove(client->packet_rest, &client->packet_rest[send_size]
+                        , client->packet_rest_size);
+                send_size = 0;
+            }
+            else
+            {
+                send_size -= client->packet_rest_size;
+                client->packet_rest_size = 0;
+            }
+        }
+
+        client->ring_pos += send_size;
+
+        // keep the read position on the packet boundary
+        const size_t packet_skip = client->ring_pos % TS_PACKET_SIZE;
+        if(packet_skip > 0)
+        {
+            const size_t offset = client->ring_pos % HTTP_RING_SIZE;
+            client->packet_rest_size = TS_PACKET_SIZE - packet_skip;
+            memcpy(client->packet_rest, &ring->buffer[offset], client->packet_rest_size);
+            client->ring_pos += client->packet_rest_size;
+        }
+    }
+
+    const bool is_pending = (client->packet_rest_size > 0 || client->ring_pos < ring->head);
+    if(is_pending != client->is_socket_busy)
+    {
+        asc_socket_set_on_ready(client->sock, (is_pending) ? on_ready_send_ts : NULL);
+        client->is_socket_busy = is_pending;
+    }
+
+    return true;
+}
+
+static void on_ready_send_ts(void *arg)
+{
+    http_client_t *client = arg;
+
+    if(!client_send_ts(client))
         on_read_error(client);
+}
+
+/*
+ * GOP cache. the ring keeps the position of the last random access point
+ * of the video, PAT and PMT are parsed to find the video pid.
+ */
+
+static void ring_on_pat(void *arg, mpegts_psi_t *psi)
+{
+    http_ring_t *ring = arg;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if(crc32 == psi->crc32)
+        return;
+    if(crc32 != PSI_CALC_CRC32(psi))
         return;
+    psi->crc32 = crc32;
+
+    mpegts_psi_packetize(psi);
+
+    ring->pmt->pid = MAX_PID;
+    ring->pmt->crc32 = 0;
+    ring->pmt->packets_count = 0;
+    ring->video_pid = MAX_PID;
+    ring->is_rap = false;
+
+    // first program
+    const uint8_t *pointer = PAT_ITEMS_FIRST(psi);
+    while(!PAT_ITEMS_EOL(psi, pointer))
+    {
+        if(PAT_ITEMS_GET_PNR(psi, pointer))
+        {
+            ring->pmt->pid = PAT_ITEMS_GET_PID(psi, pointer);
+            break;
+        }
+        PAT_ITEMS_NEXT(psi, pointer);
     }
+}
+
+static void ring_on_pmt(void *arg, mpegts_psi_t *psi)
+{
+    http_ring_t *ring = arg;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if(crc32 == psi->crc32)
+        return;
+    if(crc32 != PSI_CALC_CRC32(psi))
+        return;
+    psi->crc32 = crc32;
 
-    if(client->buffer_skip == 0)
+    mpegts_psi_packetize(psi);
+
+    ring->video_pid = MAX_PID;
+    ring->is_rap = false;
+
+    const uint8_t *pointer = PMT_ITEMS_FIRST(psi);
+    while(!PMT_ITEMS_EOL(psi, pointer))
     {
-        if(client->is_socket_busy)
+        const uint8_t type = PMT_ITEM_GET_TYPE(psi, pointer);
+        if(type == 0x1B || type == 0x24)
         {
-            asc_socket_set_on_ready(client->sock, NULL);
-            client->is_socket_busy = false;
+            ring->video_pid = PMT_ITEM_GET_PID(psi, pointer);
+            ring->video_type = type;
+            break;
         }
+        PMT_ITEMS_NEXT(psi, pointer);
     }
-    else
+}
+
+/* IDR or parameter sets in the first packet of the PES */
+static bool ring_check_rap(http_ring_t *ring, const uint8_t *ts)
+{
+    // random_access_indicator
+    if((TS_AF(ts) & 0x20) && ts[4] > 0 && (ts[5] & 0x40))
+        return true;
+
+    const uint8_t *payload = TS_PTR(ts);
+    if(!payload)
+        return false;
+
+    const uint8_t *end = ts + TS_PACKET_SIZE;
+    if(payload + 9 > end || PES_HEADER(payload) != 0x000001)
+        return false;
+
+    const uint8_t *ptr = payload + 9 + payload[8];
+    for(; ptr + 3 < end; ++ptr)
     {
-        if(!client->is_socket_busy)
+        if(ptr[0] != 0x00 || ptr[1] != 0x00 || ptr[2] != 0x01)
+            continue;
+
+        if(ring->video_type == 0x1B)
         {
-            asc_socket_set_on_ready(client->sock, on_ready_send_ts);
-            client->is_socket_busy = true;
+            const uint8_t nal_type = ptr[3] & 0x1F;
+            if(nal_type == 5 || nal_type == 7)
+                return true;
         }
+        else
+        {
+            const uint8_t nal_type = (ptr[3] >> 1) & 0x3F;
+            if((nal_type >= 16 && nal_type <= 21) || (nal_type >= 32 && nal_type <= 34))
+                return true;
+        }
+        ptr += 2;
     }
+
+    return false;
 }
 
-static void on_ts(void *arg, const uint8_t *ts)
+static void ring_scan(http_ring_t *ring, const uint8_t *ts, size_t size)
 {
-    http_client_t *client = arg;
+    for(size_t skip = 0; skip < size; skip += TS_PACKET_SIZE)
+    {
+        const uint8_t *packet = &ts[skip];
+        const uint16_t pid = TS_PID(packet);
 
-    if(client->buffer_skip > HTTP_BUFFER_SIZE - TS_PACKET_SIZE)
+        if(pid == ring->video_pid)
+        {
+            if(TS_PUSI(packet) && ring_check_rap(ring, packet))
+            {
+                ring->is_rap = true;
+                ring->rap_pos = ring->head + skip;
+                ring->rap_pat_cc = ring->pat_cc;
+                ring->rap_pmt_cc = ring->pmt_cc;
+            }
+        }
+        else if(pid == 0x00)
+        {
+            ring->pat_cc = TS_CC(packet);
+            mpegts_psi_mux(ring->pat, packet, ring_on_pat, ring);
+        }
+        else if(pid == ring->pmt->pid)
+        {
+            ring->pmt_cc = TS_CC(packet);
+            mpegts_psi_mux(ring->pmt, packet, ring_on_pmt, ring);
+        }
+    }
+}
+
+/* sets continuity counters of the packets to end with the last_cc */
+static void ring_set_cc(uint8_t *ts, size_t count, uint8_t last_cc)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        uint8_t *packet = &ts[i * TS_PACKET_SIZE];
+        const uint8_t cc = (last_cc - (count - 1 - i)) & 0x0F;
+        packet[3] = (packet[3] & 0xF0) | cc;
+    }
+}
+
+/* starts the client from the GOP cache. returns false if the cache is not ready */
+static bool ring_gop_start(http_client_t *client)
+{
+    http_ring_t *ring = client->ring;
+    module_data_t *mod = client->mod;
+
+    if(!ring->is_rap || ring->head - ring->rap_pos > (uint64_t)mod->gop_cache)
+        return false;
+
+    const size_t pat_size = ring->pat->packets_count * TS_PACKET_SIZE;
+    const size_t pmt_size = ring->pmt->packets_count * TS_PACKET_SIZE;
+    if(!pat_size || !pmt_size || pat_size + pmt_size > sizeof(client->packet_rest))
+        return false;
+
+    memcpy(client->packet_rest, ring->pat->packets, pat_size);
+    memcpy(&client->packet_rest[pat_size], ring->pmt->packets, pmt_size);
+    client->packet_rest_size = pat_size + pmt_size;
+
+    // tables are followed by the next upstream packets of the same pids
+    ring_set_cc(client->packet_rest, ring->pat->packets_count, ring->rap_pat_cc);
+    ring_set_cc(&client->packet_rest[pat_size], ring->pmt->packets_count, ring->rap_pmt_cc);
+    client->ring_pos = ring->rap_pos;
+
+    ++mod->gop_start;
+    return true;
+}
+
+static void ring_write(http_ring_t *ring, const uint8_t *ts, size_t size)
+{
+    if(ring->pat)
+        ring_scan(ring, ts, size);
+
+    while(size > 0)
+    {
+        const size_t offset = ring->head % HTTP_RING_SIZE;
+        const size_t block = (offset + size > HTTP_RING_SIZE)
+                           ? (HTTP_RING_SIZE - offset)
+                           : size;
+        memcpy(&ring->buffer[offset], ts, block);
+        ring->head += block;
+        ts += block;
+        size -= block;
+    }
+
+    if(ring->head - ring->notify < HTTP_RING_NOTIFY)
+        return;
+    ring->notify = ring->head;
+
+    http_client_t *client;
+    TAILQ_FOREACH(client, &ring->clients, ring_entries)
     {
-        client->buffer_skip = 0;
         if(client->is_socket_busy)
+            client_check_ts_lag(client);
+        // Lua callbacks are not allowed here. the client will be closed on the next read
+        else if(!client_send_ts(client))
+            asc_socket_shutdown_both(client->sock);
+    }
+}
+
+static void ring_on_ts(void *arg, const uint8_t *ts)
+{
+    ring_write(arg, ts, TS_PACKET_SIZE);
+}
+
+static void ring_on_ts_batch(void *arg, const uint8_t *ts, size_t count)
+{
+    ring_write(arg, ts, count * TS_PACKET_SIZE);
+}
+
+static void ring_destroy(http_ring_t *ring)
+{
+    module_data_t *mod = ring->mod;
+
+    if(ring->linger)
+        asc_timer_destroy(ring->linger);
+
+    __module_stream_destroy(&ring->__stream);
+
+    asc_list_for(mod->rings)
+    {
+        if(asc_list_data(mod->rings) == ring)
         {
-            asc_socket_set_on_ready(client->sock, NULL);
-            client->is_socket_busy = false;
+            asc_list_remove_current(mod->rings);
+            break;
         }
-        return;
     }
 
-    memcpy(&client->buffer[client->buffer_skip], ts, TS_PACKET_SIZE);
-    client->buffer_skip += TS_PACKET_SIZE;
+    if(ring->pat)
+    {
+        mpegts_psi_destroy(ring->pat);
+        mpegts_psi_destroy(ring->pmt);
+    }
+
+    free(ring->buffer);
+    free(ring);
+}
+
+static void ring_join(http_client_t *client, void *upstream)
+{
+    module_data_t *mod = client->mod;
+
+    http_ring_t *ring = NULL;
+    asc_list_for(mod->rings)
+    {
+        ring = asc_list_data(mod->rings);
+        if(ring->upstream == upstream)
+            break;
+        ring = NULL;
+    }
+
+    if(ring && ring->linger)
+    {
+        asc_timer_destroy(ring->linger);
+        ring->linger = NULL;
 
-    if(!client->is_socket_busy && client->buffer_skip >= HTTP_BUFFER_FILL)
-        on_ready_send_ts(arg);
+        // upstream is destroyed while the ring was waiting for clients
+        if(ring->__stream.parent != upstream)
+        {
+            ring_destroy(ring);
+            ring = NULL;
+        }
+    }
+
+    if(!ring)
+    {
+        ring = calloc(1, sizeof(http_ring_t));
+        ring->mod = mod;
+        ring->upstream = upstream;
+        ring->buffer = malloc(HTTP_RING_SIZE);
+        TAILQ_INIT(&ring->clients);
+        asc_list_insert_tail(mod->rings, ring);
+
+        // like module_stream_init()
+        ring->__stream.self = (void *)ring;
+        ring->__stream.on_ts = (void (*)(module_data_t *, const uint8_t *))ring_on_ts;
+        ring->__stream.on_ts_batch
+            = (void (*)(module_data_t *, const uint8_t *, size_t))ring_on_ts_batch;
+        ring->__stream.is_main_loop = true;
+        __module_stream_init(&ring->__stream);
+
+        if(mod->gop_cache)
+        {
+            ring->pat = mpegts_psi_init(MPEGTS_PACKET_PAT, 0x00);
+            ring->pmt = mpegts_psi_init(MPEGTS_PACKET_PMT, MAX_PID);
+            ring->video_pid = MAX_PID;
+        }
+
+        __module_stream_attach(upstream, &ring->__stream);
+    }
+
+    client->ring = ring;
+    client->ring_pos = ring->head;
+    client->packet_rest_size = 0;
+    TAILQ_INSERT_TAIL(&ring->clients, client, ring_entries);
+
+    if(ring->pat && ring_gop_start(client))
+    {
+        if(!client_send_ts(client))
+            asc_socket_shutdown_both(client->sock);
+    }
+}
+
+static void on_ring_linger(void *arg)
+{
+    http_ring_t *ring = arg;
+    ring_destroy(ring);
+}
+
+static void ring_leave(http_client_t *client)
+{
+    http_ring_t *ring = client->ring;
+
+    TAILQ_REMOVE(&ring->clients, client, ring_entries);
+    client->ring = NULL;
+
+    if(!TAILQ_EMPTY(&ring->clients))
+        return;
+
+    // keep scanning the upstream, so the next client starts from the GOP cache
+    if(ring->pat && ring->mod->gop_linger > 0 && ring->__stream.parent)
+        ring->linger = asc_timer_init(ring->mod->gop_linger * 1000, on_ring_linger, ring);
+    else
+        ring_destroy(ring);
 }
 
 static void buffer_set_text(char **buffer, int capacity
@@ -616,7 +1066,7 @@ static int method_send(module_data_t *mod)
 
         if(client->is_websocket)
         {
-            uint8_t *data = (uint8_t *)client->buffer;
+            uint8_t data[FRAME_HEADER_SIZE + FRAME_SIZE64_SIZE];
             uint8_t frame_header = FRAME_HEADER_SIZE;
 
             data[0] = 0x81;
@@ -647,9 +1097,12 @@ static int method_send(module_data_t *mod)
                 frame_header += FRAME_SIZE64_SIZE;
             }
 
-            memcpy(&data[frame_header], str, str_size);
-
-            send_ret = asc_socket_send(client->sock, (void *)data, frame_header + str_size);
+            const struct iovec iov[2] =
+            {
+                { .iov_base = data, .iov_len = frame_header },
+                { .iov_base = (void *)str, .iov_len = str_size },
+            };
+            send_ret = asc_socket_sendv(client->sock, iov, 2);
         }
         else
             send_ret = asc_socket_send(client->sock, (void *)str, str_size);
@@ -734,11 +1187,9 @@ static int method_send(module_data_t *mod)
     lua_getfield(lua, 3, "upstream");
     if(!lua_isnil(lua, -1))
     {
-        // like module_stream_init()
-        client->__stream.self = (void *)client;
-        client->__stream.on_ts = (void (*)(module_data_t *, const uint8_t *))on_ts;
-        __module_stream_init(&client->__stream);
-        __module_stream_attach(lua_touserdata(lua, -1), &client->__stream);
+        if(client->ring)
+            ring_leave(client);
+        ring_join(client, lua_touserdata(lua, -1));
     }
     lua_pop(lua, 1);
 
@@ -748,6 +1199,20 @@ static int method_send(module_data_t *mod)
     return 0;
 }
 
+static int method_status(module_data_t *mod)
+{
+    lua_newtable(lua);
+
+    lua_pushnumber(lua, asc_list_size(mod->rings));
+    lua_setfield(lua, -2, "streams");
+    lua_pushnumber(lua, mod->ts_resync);
+    lua_setfield(lua, -2, "resync");
+    lua_pushnumber(lua, mod->gop_start);
+    lua_setfield(lua, -2, "gop_start");
+
+    return 1;
+}
+
 static int method_data(module_data_t *mod)
 {
     if(lua_type(lua, 2) != LUA_TLIGHTUSERDATA)
@@ -785,6 +1250,8 @@ static void server_close(module_data_t *mod)
         ; asc_list_first(mod->clients))
     {
         http_client_t *client = asc_list_data(mod->clients);
+        if(client->ring)
+            ring_leave(client);
         if(client->sock)
             asc_socket_close(client->sock);
         free(client);
@@ -797,6 +1264,16 @@ static void server_close(module_data_t *mod)
     asc_list_destroy(mod->clients);
     mod->clients = NULL;
 
+    for(asc_list_first(mod->rings)
+        ; !asc_list_eol(mod->rings)
+        ; asc_list_first(mod->rings))
+    {
+        ring_destroy(asc_list_data(mod->rings));
+    }
+
+    asc_list_destroy(mod->rings);
+    mod->rings = NULL;
+
     if(mod->idx_self > 0)
     {
         luaL_unref(lua, LUA_REGISTRYINDEX, mod->idx_self);
@@ -905,6 +1382,19 @@ static void module_init(module_data_t *mod)
     mod->idx_self = luaL_ref(lua, LUA_REGISTRYINDEX);
 
     mod->clients = asc_list_init();
+    mod->rings = asc_list_init();
+
+    if(module_option_number("gop_cache", &mod->gop_cache) && mod->gop_cache > 0)
+    {
+        mod->gop_cache *= 1024;
+        if(mod->gop_cache > HTTP_GOP_CACHE_MAX)
+            mod->gop_cache = HTTP_GOP_CACHE_MAX;
+    }
+    else
+        mod->gop_cache = 0;
+
+    mod->gop_linger = 60;
+    module_option_number("gop_linger", &mod->gop_linger);
 
     mod->sock = asc_socket_open_tcp4(mod);
     asc_socket_set_reuseaddr(mod->sock, 1);
@@ -927,7 +1417,8 @@ MODULE_LUA_METHODS()
     { "port", method_port },
     { "close", method_close },
     { "send", method_send },
-    { "data", method_data }
+    { "data", method_data },
+    { "status", method_status }
 };
 
 MODULE_LUA_REGISTER(http_server)
@@ -32,6 +32,24 @@
  *                    data.analyze  - table, per pid information: errors, bitrate
  *                    data.on_air   - boolean, comes with data.analyze, stream status
  *                    data.rate     - table, rate_stat array
+ *                    data.analyze comes only if on_air or error state is changed
+ *
+ * TR 101 290 indicators, per pid in data.analyze:
+ *      tei_error   - packets with Transport Error Indicator (2.1)
+ *      pcr_error   - interval between PCR values more than 40ms
+ *                    or discontinuity (2.3a/2.3b)
+ *      pcr_jitter  - max difference between PCR and arrival time, in us (2.4)
+ *      pts_error   - PTS interval more than 700ms (2.5)
+ *      psi_error   - PAT/PMT interval more than 500ms (1.3/1.5)
+ * and for the stream:
+ *      sync_error  - packets with wrong sync byte (1.2)
+ *      sync_loss   - two or more wrong sync bytes in a row (1.1)
+ * Arrival time is the cached loop time, so pcr_jitter includes the delay
+ * of the batch the packet was received in.
+ *
+ * Module Methods:
+ *      stat()      - returns table with the statistics of the last second:
+ *                    { analyze = { ... }, on_air = boolean }
  */
 
 #include <astra.h>
@@ -48,8 +66,46 @@ typedef struct
     uint32_t cc_error;  // Continuity Counter
     uint32_t sc_error;  // Scrambled
     uint32_t pes_error; // PES header
+
+    // TR 101 290
+    uint32_t tei_error;
+    uint32_t pcr_error;
+    uint32_t pcr_jitter; // us
+    uint32_t pts_error;
+    uint32_t psi_error;
+
+    uint64_t pcr;
+    int64_t pcr_time;
+    int64_t pts_time;
+    int64_t psi_time;
+
+    uint16_t pnr; // program of the elementary stream or PCR pid
+    bool is_active;
+    bool is_listed; // found in the current table. used by on_pat() and on_pmt()
+
+    // last second
+    struct
+    {
+        uint32_t bitrate;
+        uint32_t cc_error;
+        uint32_t sc_error;
+        uint32_t pes_error;
+        uint32_t tei_error;
+        uint32_t pcr_error;
+        uint32_t pcr_jitter;
+        uint32_t pts_error;
+        uint32_t psi_error;
+    } stat;
 } analyze_item_t;
 
+// TR 101 290 limits, us
+#define TR_PCR_INTERVAL 40000
+#define TR_PCR_DISCONTINUITY 100000
+#define TR_PTS_INTERVAL 700000
+#define TR_PSI_INTERVAL 500000
+
+#define PCR_MAX (0x200000000LL * 300)
+
 typedef struct
 {
     uint16_t pnr;
@@ -69,6 +125,23 @@ struct module_data_t
     asc_timer_t *check_stat;
     analyze_item_t stream[MAX_PID];
 
+    // pids with packets or with known type. only these are checked
+    uint16_t active_list[MAX_PID];
+    int active_count;
+
+    bool is_stat;
+    bool on_air;
+    bool is_error;
+
+    uint32_t sync_error;
+    uint32_t sync_loss;
+    int sync_count;
+    struct
+    {
+        uint32_t sync_error;
+        uint32_t sync_loss;
+    } stat;
+
     mpegts_psi_t *pat;
     mpegts_psi_t *cat;
     mpegts_psi_t *pmt;
@@ -81,7 +154,7 @@ struct module_data_t
     uint32_t *sdt_checksum_list;
 
     // rate_stat
-    struct timeval last_ts;
+    int64_t last_ts; // 10ms
     uint32_t ts_count;
     int rate_count;
     int rate[10];
@@ -99,6 +172,28 @@ static const char __psi[] = "psi";
 static const char __err[] = "error";
 static const char __callback[] = "callback";
 
+static void item_activate(module_data_t *mod, uint16_t pid)
+{
+    analyze_item_t *item = &mod->stream[pid];
+    if(item->is_active)
+        return;
+
+    item->is_active = true;
+    mod->active_list[mod->active_count] = pid;
+    ++mod->active_count;
+}
+
+/* pid is removed from PAT or PMT. checks of the missing data are stopped.
+ * pid without packets is removed from the active list by on_check_stat() */
+static void item_release(analyze_item_t *item)
+{
+    item->type = MPEGTS_PACKET_UNKNOWN;
+    item->pnr = 0;
+    item->pcr_time = 0;
+    item->pts_time = 0;
+    item->psi_time = 0;
+}
+
 static void do_callback(module_data_t *mod)
 {
     asc_assert((lua_type(lua, -1) == LUA_TTABLE), "table required");
@@ -173,11 +268,26 @@ static void on_pat(void *arg, mpegts_psi_t *psi)
         lua_settable(lua, -3); // append to the "programs" table
 
         mod->stream[pid].type = (pnr) ? MPEGTS_PACKET_PMT : MPEGTS_PACKET_NIT;
+        mod->stream[pid].pnr = 0;
+        mod->stream[pid].is_listed = true;
+        item_activate(mod, pid);
 
         PAT_ITEMS_NEXT(psi, pointer);
     }
     lua_setfield(lua, -2, "programs");
 
+    // programs removed from PAT
+    for(int i = 0; i < mod->active_count; ++i)
+    {
+        analyze_item_t *item = &mod->stream[mod->active_list[i]];
+        if((item->type == MPEGTS_PACKET_PMT || item->type == MPEGTS_PACKET_NIT)
+           && !item->is_listed)
+        {
+            item_release(item);
+        }
+        item->is_listed = false;
+    }
+
     mod->pmt_count = programs_count;
     if(mod->pmt_checksum_list)
         free(mod->pmt_checksum_list);
@@ -317,7 +427,8 @@ static void on_pmt(void *arg, mpegts_psi_t *psi)
     }
     lua_setfield(lua, -2, __descriptors);
 
-    lua_pushnumber(lua, PMT_GET_PCR(psi));
+    const uint16_t pcr_pid = PMT_GET_PCR(psi);
+    lua_pushnumber(lua, pcr_pid);
     lua_setfield(lua, -2, "pcr");
 
     int streams_count = 1;
@@ -332,6 +443,9 @@ static void on_pmt(void *arg, mpegts_psi_t *psi)
         lua_newtable(lua);
 
         mod->stream[pid].type = mpegts_pes_type(type);
+        mod->stream[pid].pnr = pnr;
+        mod->stream[pid].is_listed = true;
+        item_activate(mod, pid);
         lua_pushstring(lua, mpegts_type_name(mod->stream[pid].type));
         lua_setfield(lua, -2, "type_name");
 
@@ -360,6 +474,28 @@ static void on_pmt(void *arg, mpegts_psi_t *psi)
     }
     lua_setfield(lua, -2, "streams");
 
+    if(pcr_pid < NULL_TS_PID)
+    {
+        mod->stream[pcr_pid].pnr = pnr;
+        mod->stream[pcr_pid].is_listed = true;
+        item_activate(mod, pcr_pid);
+    }
+
+    // streams removed from the program. PCR is checked on the PCR pid only
+    for(int i = 0; i < mod->active_count; ++i)
+    {
+        const uint16_t pid = mod->active_list[i];
+        analyze_item_t *item = &mod->stream[pid];
+        if(item->pnr != pnr)
+            continue;
+
+        if(!item->is_listed)
+            item_release(item);
+        else if(pid != pcr_pid)
+            item->pcr_time = 0;
+        item->is_listed = false;
+    }
+
     do_callback(mod);
     lua_pop(lua, 1); // options
 }
@@ -506,6 +642,49 @@ static void append_rate(module_data_t *mod, int rate)
     }
 }
 
+static void check_interval(int64_t *last_time, int64_t limit, uint32_t *error)
+{
+    const int64_t now = asc_utime_now();
+    if(*last_time && now - *last_time > limit)
+        ++(*error);
+    *last_time = now;
+}
+
+static void check_pcr(analyze_item_t *item, const uint8_t *ts)
+{
+    const uint64_t pcr_base = ((uint64_t)ts[6] << 25)
+                            | (ts[7] << 17)
+                            | (ts[8] << 9)
+                            | (ts[9] << 1)
+                            | (ts[10] >> 7);
+    const uint64_t pcr = pcr_base * 300 + (((ts[10] & 0x01) << 8) | ts[11]);
+
+    const int64_t now = asc_utime_now();
+    const int64_t last_time = item->pcr_time;
+    const uint64_t last_pcr = item->pcr;
+
+    item->pcr = pcr;
+    item->pcr_time = now;
+
+    // discontinuity_indicator
+    if(!last_time || (ts[5] & 0x80))
+        return;
+
+    // 2.3a and 2.3b are checked by PCR values, arrival time is only for the jitter
+    const int64_t pcr_delta = ((pcr + PCR_MAX - last_pcr) % PCR_MAX) / 27;
+    if(pcr_delta > TR_PCR_INTERVAL)
+    {
+        ++item->pcr_error;
+        return;
+    }
+
+    int64_t jitter = pcr_delta - (now - last_time);
+    if(jitter < 0)
+        jitter = -jitter;
+    if(jitter > item->pcr_jitter)
+        item->pcr_jitter = jitter;
+}
+
 static void on_ts(module_data_t *mod, const uint8_t *ts)
 {
     if(mod->rate_stat)
@@ -513,14 +692,11 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         ++mod->ts_count;
 
         int diff_interval = 0;
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        tv.tv_usec /= 10000;
-        const int64_t s = mod->last_ts.tv_sec * 100 + mod->last_ts.tv_usec;
-        const int64_t e = tv.tv_sec * 100 + tv.tv_usec;
+        const int64_t s = mod->last_ts;
+        const int64_t e = asc_utime_now() / 10000;
         if(e != s)
         {
-            memcpy(&mod->last_ts, &tv, sizeof(struct timeval));
+            mod->last_ts = e;
             if(s > 0)
                 diff_interval = e - s;
         }
@@ -538,12 +714,27 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
         }
     }
 
+    if(ts[0] != 0x47)
+    {
+        ++mod->sync_error;
+        ++mod->sync_count;
+        if(mod->sync_count == 2)
+            ++mod->sync_loss;
+        return;
+    }
+    mod->sync_count = 0;
+
     const uint16_t pid = TS_PID(ts);
 
     analyze_item_t *item = &mod->stream[pid];
     const mpegts_packet_type_t type = item->type;
 
     ++item->packets;
+    if(!item->is_active)
+        item_activate(mod, pid);
+
+    if(ts[1] & 0x80)
+        ++item->tei_error;
 
     if(type == MPEGTS_PACKET_NULL)
         return;
@@ -573,10 +764,18 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     // Analyze
 
     const uint8_t af = TS_AF(ts);
+
+    // PCR
+    if((af & 0x20) && ts[4] >= 7 && (ts[5] & 0x10))
+        check_pcr(item, ts);
+
     // skip packets without payload
     if(!(af & 0x10))
         return;
 
+    if(TS_PUSI(ts) && (type == MPEGTS_PACKET_PAT || type == MPEGTS_PACKET_PMT))
+        check_interval(&item->psi_time, TR_PSI_INTERVAL, &item->psi_error);
+
     const uint8_t cc = TS_CC(ts);
     const uint8_t last_cc = (item->cc + 1) & 0x0F;
     item->cc = cc;
@@ -598,47 +797,110 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
 
         if(PES_HEADER(payload) != 0x000001)
             ++item->pes_error;
+        else if(payload + 8 <= ts + TS_PACKET_SIZE && (payload[7] & 0x80))
+            check_interval(&item->pts_time, TR_PTS_INTERVAL, &item->pts_error);
     }
 }
 
-static void on_check_stat(void *arg)
+static void push_stat(module_data_t *mod)
 {
-    module_data_t *mod = arg;
-
-    int items_count = 1;
     lua_newtable(lua);
 
-    bool on_air = true;
-
-    uint32_t bitrate = 0;
-
     lua_newtable(lua);
-    for(int i = 0; i < MAX_PID; ++i)
+    for(int i = 0; i < mod->active_count; ++i)
     {
-        analyze_item_t *item = &mod->stream[i];
-
-        if(item->type == MPEGTS_PACKET_UNKNOWN && item->packets == 0)
-            continue;
+        const uint16_t pid = mod->active_list[i];
+        const analyze_item_t *item = &mod->stream[pid];
 
-        lua_pushnumber(lua, items_count++);
+        lua_pushnumber(lua, i + 1);
         lua_newtable(lua);
 
-        lua_pushnumber(lua, i);
+        lua_pushnumber(lua, pid);
         lua_setfield(lua, -2, __pid);
 
-        const uint32_t item_bitrate = (item->packets * TS_PACKET_SIZE * 8) / 1000;
-        bitrate += item_bitrate;
-
-        lua_pushnumber(lua, item_bitrate);
+        lua_pushnumber(lua, item->stat.bitrate);
         lua_setfield(lua, -2, "bitrate");
 
-        lua_pushnumber(lua, item->cc_error);
+        lua_pushnumber(lua, item->stat.cc_error);
         lua_setfield(lua, -2, "cc_error");
-        lua_pushnumber(lua, item->sc_error);
+        lua_pushnumber(lua, item->stat.sc_error);
         lua_setfield(lua, -2, "sc_error");
-        lua_pushnumber(lua, item->pes_error);
+        lua_pushnumber(lua, item->stat.pes_error);
         lua_setfield(lua, -2, "pes_error");
 
+        lua_pushnumber(lua, item->stat.tei_error);
+        lua_setfield(lua, -2, "tei_error");
+        lua_pushnumber(lua, item->stat.pcr_error);
+        lua_setfield(lua, -2, "pcr_error");
+        lua_pushnumber(lua, item->stat.pcr_jitter);
+        lua_setfield(lua, -2, "pcr_jitter");
+        lua_pushnumber(lua, item->stat.pts_error);
+        lua_setfield(lua, -2, "pts_error");
+        lua_pushnumber(lua, item->stat.psi_error);
+        lua_setfield(lua, -2, "psi_error");
+
+        lua_settable(lua, -3);
+    }
+    lua_setfield(lua, -2, "analyze");
+
+    lua_pushnumber(lua, mod->stat.sync_error);
+    lua_setfield(lua, -2, "sync_error");
+    lua_pushnumber(lua, mod->stat.sync_loss);
+    lua_setfield(lua, -2, "sync_loss");
+
+    lua_pushboolean(lua, mod->on_air);
+    lua_setfield(lua, -2, "on_air");
+}
+
+static void on_check_stat(void *arg)
+{
+    module_data_t *mod = arg;
+
+    bool on_air = true;
+    bool is_error = false;
+
+    uint32_t bitrate = 0;
+
+    // tables and PCR that are not coming at all
+    const int64_t now = asc_utime();
+
+    int i = 0;
+    while(i < mod->active_count)
+    {
+        const uint16_t pid = mod->active_list[i];
+        analyze_item_t *item = &mod->stream[pid];
+
+        if(item->type == MPEGTS_PACKET_UNKNOWN && item->packets == 0)
+        {
+            item->is_active = false;
+            item->pcr_time = 0;
+            item->pts_time = 0;
+            item->psi_time = 0;
+            memset(&item->stat, 0, sizeof(item->stat));
+            --mod->active_count;
+            mod->active_list[i] = mod->active_list[mod->active_count];
+            continue;
+        }
+
+        if(item->pcr_time && now - item->pcr_time > TR_PCR_DISCONTINUITY)
+            ++item->pcr_error;
+        if(item->pts_time && now - item->pts_time > TR_PTS_INTERVAL)
+            ++item->pts_error;
+        if(item->psi_time && now - item->psi_time > TR_PSI_INTERVAL)
+            ++item->psi_error;
+
+        item->stat.bitrate = (item->packets * TS_PACKET_SIZE * 8) / 1000;
+        item->stat.cc_error = item->cc_error;
+        item->stat.sc_error = item->sc_error;
+        item->stat.pes_error = item->pes_error;
+        item->stat.tei_error = item->tei_error;
+        item->stat.pcr_error = item->pcr_error;
+        item->stat.pcr_jitter = item->pcr_jitter;
+        item->stat.pts_error = item->pts_error;
+        item->stat.psi_error = item->psi_error;
+
+        bitrate += item->stat.bitrate;
+
         if(item->type == MPEGTS_PACKET_VIDEO || item->type == MPEGTS_PACKET_AUDIO)
         {
             if(item->sc_error)
@@ -647,26 +909,57 @@ static void on_check_stat(void *arg)
                 on_air = false;
         }
 
+        if(   item->cc_error || item->sc_error || item->pes_error
+           || item->tei_error || item->pcr_error || item->pts_error || item->psi_error)
+        {
+            is_error = true;
+        }
+
         item->packets = 0;
         item->cc_error = 0;
         item->sc_error = 0;
         item->pes_error = 0;
+        item->tei_error = 0;
+        item->pcr_error = 0;
+        item->pcr_jitter = 0;
+        item->pts_error = 0;
+        item->psi_error = 0;
 
-        lua_settable(lua, -3);
+        ++i;
     }
-    lua_setfield(lua, -2, "analyze");
 
     if(bitrate < 32)
         on_air = false;
 
-    lua_pushboolean(lua, on_air);
-    lua_setfield(lua, -2, "on_air");
+    mod->stat.sync_error = mod->sync_error;
+    mod->stat.sync_loss = mod->sync_loss;
+    if(mod->sync_error)
+        is_error = true;
+    mod->sync_error = 0;
+    mod->sync_loss = 0;
 
-    do_callback(mod);
+    const bool is_changed = (!mod->is_stat
+                             || on_air != mod->on_air
+                             || is_error != mod->is_error);
+
+    mod->is_stat = true;
+    mod->on_air = on_air;
+    mod->is_error = is_error;
 
+    if(!is_changed)
+        return;
+
+    push_stat(mod);
+    do_callback(mod);
     lua_pop(lua, 1); // table
 }
 
+static int method_stat(module_data_t *mod)
+{
+    push_stat(mod);
+    return 1;
+}
+
 /*
  * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
  *  8888o   888 o888   888o 888    88o 888    88   888         888    88
@@ -687,23 +980,29 @@ static void module_init(module_data_t *mod)
 
     module_option_number("rate_stat", &mod->rate_stat);
 
+    module_stream_main_loop_set(mod);
     module_stream_init(mod, on_ts);
 
     // PAT
     mod->stream[0x00].type = MPEGTS_PACKET_PAT;
+    item_activate(mod, 0x00);
     mod->pat = mpegts_psi_init(MPEGTS_PACKET_PAT, 0x00);
     // CAT
     mod->stream[0x01].type = MPEGTS_PACKET_CAT;
+    item_activate(mod, 0x01);
     mod->cat = mpegts_psi_init(MPEGTS_PACKET_CAT, 0x01);
     // SDT
     mod->stream[0x11].type = MPEGTS_PACKET_SDT;
+    item_activate(mod, 0x11);
     mod->sdt = mpegts_psi_init(MPEGTS_PACKET_SDT, 0x11);
     // EIT
     mod->stream[0x12].type = MPEGTS_PACKET_EIT;
+    item_activate(mod, 0x12);
     // PMT
     mod->pmt = mpegts_psi_init(MPEGTS_PACKET_PMT, MAX_PID);
     // NULL
     mod->stream[NULL_TS_PID].type = MPEGTS_PACKET_NULL;
+    item_activate(mod, NULL_TS_PID);
 
     mod->check_stat = asc_timer_init(1000, on_check_stat, mod);
 }
@@ -728,6 +1027,7 @@ static void module_destroy(module_data_t *mod)
 MODULE_STREAM_METHODS()
 MODULE_LUA_METHODS()
 {
-    MODULE_STREAM_METHODS_REF()
+    MODULE_STREAM_METHODS_REF(),
+    { "stat", method_stat }
 };
 MODULE_LUA_REGISTER(analyze)
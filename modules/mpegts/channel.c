@@ -31,6 +31,9 @@
  *      map         - list, map PID by stream type, item format: "type=pid"
  *                    type: video, audio, rus, end... and other language code
  *                     pid: number identifier in range 32-8190
+ *      psi_interval
+ *                  - number, send PAT/PMT/SDT with the interval in milliseconds
+ *                    instead of repeating them with the source tables
  */
 
 #include <astra.h>
@@ -57,6 +60,7 @@ struct module_data_t
         int sdt;
         int eit;
         int filter_reverse;
+        int psi_interval;
     } config;
 
     /* */
@@ -84,10 +88,25 @@ struct module_data_t
     uint32_t *sdt_checksum_list;
 
     uint8_t eit_cc;
+
+    asc_timer_t *psi_timer;
 };
 
 #define MSG(_msg) "[channel %s] " _msg, mod->config.name
 
+static void send_psi(module_data_t *mod, mpegts_psi_t *psi)
+{
+    mpegts_psi_send(psi
+                    , (void (*)(void *, const uint8_t *))__module_stream_send
+                    , &mod->__stream);
+}
+
+static void repeat_psi(module_data_t *mod, mpegts_psi_t *psi)
+{
+    if(!mod->psi_timer)
+        send_psi(mod, psi);
+}
+
 static void stream_reload(module_data_t *mod)
 {
     memset(mod->stream, 0, sizeof(mod->stream));
@@ -104,6 +123,7 @@ static void stream_reload(module_data_t *mod)
     mod->pat->crc32 = 0;
     mod->cat->crc32 = 0;
     mod->pmt->crc32 = 0;
+    mod->custom_pmt->packets_count = 0;
 
     module_stream_demux_join_pid(mod, 0x00);
     module_stream_demux_join_pid(mod, 0x01);
@@ -117,6 +137,7 @@ static void stream_reload(module_data_t *mod)
             free(mod->sdt_checksum_list);
             mod->sdt_checksum_list = NULL;
         }
+        mod->custom_sdt->packets_count = 0;
     }
 
     if(mod->config.eit)
@@ -151,9 +172,7 @@ static void on_pat(void *arg, mpegts_psi_t *psi)
     const uint32_t crc32 = PSI_GET_CRC32(psi);
     if(crc32 == psi->crc32)
     {
-        mpegts_psi_demux(mod->custom_pat
-                         , (void (*)(void *, const uint8_t *))__module_stream_send
-                         , &mod->__stream);
+        repeat_psi(mod, mod->custom_pat);
         return;
     }
 
@@ -198,6 +217,7 @@ static void on_pat(void *arg, mpegts_psi_t *psi)
     if(PAT_ITEMS_EOL(psi, pointer))
     {
         mod->custom_pat->buffer_size = 0;
+        mod->custom_pat->packets_count = 0;
         asc_log_error(MSG("PAT: stream with id %d is not found"), mod->config.pnr);
         return;
     }
@@ -244,9 +264,8 @@ static void on_pat(void *arg, mpegts_psi_t *psi)
     PSI_SET_SIZE(mod->custom_pat);
     PSI_SET_CRC32(mod->custom_pat);
 
-    mpegts_psi_demux(mod->custom_pat
-                     , (void (*)(void *, const uint8_t *))__module_stream_send
-                     , &mod->__stream);
+    mpegts_psi_packetize(mod->custom_pat);
+    send_psi(mod, mod->custom_pat);
 }
 
 /*
@@ -322,9 +341,7 @@ static void on_pmt(void *arg, mpegts_psi_t *psi)
     const uint32_t crc32 = PSI_GET_CRC32(psi);
     if(crc32 == psi->crc32)
     {
-        mpegts_psi_demux(mod->custom_pmt
-                         , (void (*)(void *, const uint8_t *))__module_stream_send
-                         , &mod->__stream);
+        repeat_psi(mod, mod->custom_pmt);
         return;
     }
 
@@ -499,9 +516,8 @@ static void on_pmt(void *arg, mpegts_psi_t *psi)
 
     PSI_SET_SIZE(mod->custom_pmt);
     PSI_SET_CRC32(mod->custom_pmt);
-    mpegts_psi_demux(mod->custom_pmt
-                     , (void (*)(void *, const uint8_t *))__module_stream_send
-                     , &mod->__stream);
+    mpegts_psi_packetize(mod->custom_pmt);
+    send_psi(mod, mod->custom_pmt);
 }
 
 /*
@@ -549,9 +565,7 @@ static void on_sdt(void *arg, mpegts_psi_t *psi)
     {
         if(mod->sdt_original_section_id == section_id)
         {
-            mpegts_psi_demux(mod->custom_sdt
-                             , (void (*)(void *, const uint8_t *))__module_stream_send
-                             , &mod->__stream);
+            repeat_psi(mod, mod->custom_sdt);
         }
         return;
     }
@@ -590,9 +604,8 @@ static void on_sdt(void *arg, mpegts_psi_t *psi)
     PSI_SET_SIZE(mod->custom_sdt);
     PSI_SET_CRC32(mod->custom_sdt);
 
-    mpegts_psi_demux(mod->custom_sdt
-                     , (void (*)(void *, const uint8_t *))__module_stream_send
-                     , &mod->__stream);
+    mpegts_psi_packetize(mod->custom_sdt);
+    send_psi(mod, mod->custom_sdt);
 }
 
 /*
@@ -686,6 +699,39 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     module_stream_send(mod, ts);
 }
 
+/*
+ * oooooooooo   oooooooo8 ooooo
+ *  888    888 888         888
+ *  888oooo88   888oooooo  888
+ *  888                888 888
+ * o888o       o88oooo888 o888o
+ *
+ */
+
+static void on_psi_timer(void *arg)
+{
+    module_data_t *mod = arg;
+
+    send_psi(mod, mod->custom_pat);
+    send_psi(mod, mod->custom_pmt);
+    if(mod->custom_sdt)
+        send_psi(mod, mod->custom_sdt);
+}
+
+/* timer works in the thread of the stream */
+static void psi_timer_start(void *arg)
+{
+    module_data_t *mod = arg;
+    mod->psi_timer = asc_timer_init(mod->config.psi_interval, on_psi_timer, mod);
+}
+
+static void psi_timer_stop(void *arg)
+{
+    module_data_t *mod = arg;
+    asc_timer_destroy(mod->psi_timer);
+    mod->psi_timer = NULL;
+}
+
 /*
  * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
  *  8888o   888 o888   888o 888    88o 888    88   888         888    88
@@ -774,10 +820,17 @@ static void module_init(module_data_t *mod)
         }
     }
     lua_pop(lua, 1); // filter
+
+    module_option_number("psi_interval", &mod->config.psi_interval);
+    if(mod->config.psi_interval > 0)
+        asc_reactor_call_wait(mod->__stream.reactor, psi_timer_start, mod);
 }
 
 static void module_destroy(module_data_t *mod)
 {
+    if(mod->psi_timer)
+        asc_reactor_call_wait(mod->__stream.reactor, psi_timer_stop, mod);
+
     module_stream_destroy(mod);
 
     mpegts_psi_destroy(mod->pat);
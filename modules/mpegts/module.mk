@@ -1,3 +1,3 @@
 SOURCES="src/psi.c src/pes.c src/types.c"
-SOURCES="$SOURCES analyze.c channel.c transmit.c"
-MODULES="analyze channel transmit"
+SOURCES="$SOURCES analyze.c channel.c mpts_demux.c transmit.c"
+MODULES="analyze channel mpts_demux transmit"
@@ -127,6 +127,10 @@ typedef struct
     uint8_t buffer[PSI_MAX_SIZE];
 
     uint8_t reload_counter;
+
+    // packetized section. see mpegts_psi_packetize()
+    uint8_t *packets;
+    uint16_t packets_count;
 } mpegts_psi_t;
 
 mpegts_psi_t * mpegts_psi_init(mpegts_packet_type_t type, uint16_t pid);
@@ -140,6 +144,11 @@ void mpegts_psi_demux(mpegts_psi_t *psi
                       , void (*callback)(void *, const uint8_t *)
                       , void *arg);
 
+void mpegts_psi_packetize(mpegts_psi_t *psi);
+void mpegts_psi_send(mpegts_psi_t *psi
+                     , void (*callback)(void *, const uint8_t *)
+                     , void *arg);
+
 #define PSI_CALC_CRC32(_psi) crc32b(_psi->buffer, _psi->buffer_size - CRC32_SIZE)
 
 // with inline function we have nine more instructions
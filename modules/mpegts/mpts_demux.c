@@ -0,0 +1,793 @@
+/*
+ * Astra Module: MPEG-TS (MPTS Demux)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Splits MPTS to the programs in a single pass. PSI is parsed once for all
+ * programs, each packet is routed by the PID table to the programs it belongs to.
+ * PAT/PMT/SDT of the program are rebuilt only when the original table is changed.
+ *
+ * Module Name:
+ *      mpts_demux
+ *
+ * Module Options:
+ *      upstream    - object, stream instance returned by module_instance:stream()
+ *      name        - string, demux name
+ *      sdt         - boolean, join SDT table
+ *      eit         - boolean, join EIT table
+ *
+ * Module Methods:
+ *      program(pnr)
+ *                  - returns stream instance of the program with number pnr
+ *                    (to use as upstream option of the next module)
+ */
+
+#include <astra.h>
+
+typedef struct mpts_program_t mpts_program_t;
+
+struct mpts_program_t
+{
+    module_data_t *mod;
+    module_stream_t stream;
+
+    uint16_t pnr;
+
+    mpegts_psi_t *pmt;
+
+    mpegts_psi_t *custom_pat;
+    mpegts_psi_t *custom_pmt;
+    mpegts_psi_t *custom_sdt;
+
+    bool is_cat;
+    bool is_sdt;
+    uint8_t sdt_section_id;
+
+    uint8_t eit_cc;
+};
+
+typedef struct
+{
+    mpts_program_t **list;
+    uint16_t count;
+    uint16_t size;
+} mpts_route_t;
+
+struct module_data_t
+{
+    MODULE_LUA_DATA();
+    MODULE_STREAM_DATA();
+
+    /* Options */
+    struct
+    {
+        const char *name;
+        int sdt;
+        int eit;
+    } config;
+
+    /* */
+    mpts_program_t **program_list;
+    int program_count;
+
+    mpegts_psi_t *pat;
+    mpegts_psi_t *cat;
+    mpegts_psi_t *sdt;
+
+    uint16_t tsid;
+
+    mpegts_packet_type_t stream[MAX_PID];
+    mpts_route_t *route; // MAX_PID items
+
+    uint8_t sdt_max_section_id;
+    uint32_t *sdt_checksum_list;
+
+    mpts_program_t *eit_program;
+    uint8_t custom_ts[TS_PACKET_SIZE];
+};
+
+#define MSG(_msg) "[mpts_demux %s] " _msg, mod->config.name
+
+static mpts_program_t * program_find(module_data_t *mod, uint16_t pnr)
+{
+    for(int i = 0; i < mod->program_count; ++i)
+    {
+        if(mod->program_list[i]->pnr == pnr)
+            return mod->program_list[i];
+    }
+    return NULL;
+}
+
+#define PROGRAM_SEND(_program, _psi)                                                            \
+    mpegts_psi_send(_psi                                                                        \
+                    , (void (*)(void *, const uint8_t *))__module_stream_send                   \
+                    , &(_program)->stream)
+
+/*
+ * oooooooooo    ooooooo  ooooo  oooo ooooooooooo ooooooooooo
+ *  888    888 o888   888o 888    88  88  888  88  888    88
+ *  888oooo88  888     888 888    88      888      888ooo8
+ *  888  88o   888o   o888 888    88      888      888    oo
+ * o888o  88o8   88ooo88    888oo88      o888o    o888ooo8888
+ *
+ */
+
+static void route_append(module_data_t *mod, uint16_t pid, mpegts_packet_type_t type
+                         , mpts_program_t *program)
+{
+    mpts_route_t *route = &mod->route[pid];
+
+    for(int i = 0; i < route->count; ++i)
+    {
+        if(route->list[i] == program)
+            return;
+    }
+
+    if(route->count == route->size)
+    {
+        route->size = (route->size) ? (route->size * 2) : 4;
+        route->list = realloc(route->list, route->size * sizeof(mpts_program_t *));
+    }
+    route->list[route->count] = program;
+    ++route->count;
+
+    if(route->count == 1)
+    {
+        mod->stream[pid] = type;
+        module_stream_demux_join_pid(mod, pid);
+    }
+}
+
+static void route_remove(module_data_t *mod, uint16_t pid, mpts_program_t *program)
+{
+    mpts_route_t *route = &mod->route[pid];
+
+    for(int i = 0; i < route->count; ++i)
+    {
+        if(route->list[i] != program)
+            continue;
+
+        --route->count;
+        route->list[i] = route->list[route->count];
+
+        if(route->count == 0)
+        {
+            mod->stream[pid] = MPEGTS_PACKET_UNKNOWN;
+            module_stream_demux_leave_pid(mod, pid);
+        }
+        return;
+    }
+}
+
+static void route_append_ca(module_data_t *mod, const uint8_t *desc_pointer
+                            , mpegts_packet_type_t type, mpts_program_t *program)
+{
+    const uint16_t ca_pid = DESC_CA_PID(desc_pointer);
+    if(ca_pid == NULL_TS_PID)
+        return;
+
+    if(mod->stream[ca_pid] == MPEGTS_PACKET_UNKNOWN || mod->stream[ca_pid] == type)
+        route_append(mod, ca_pid, type, program);
+}
+
+/* drops PIDs of the program except PMT and EMM */
+static void program_reset(module_data_t *mod, mpts_program_t *program)
+{
+    for(int pid = 0; pid < MAX_PID; ++pid)
+    {
+        if(!mod->route[pid].count)
+            continue;
+
+        const mpegts_packet_type_t type = mod->stream[pid];
+        if(type == MPEGTS_PACKET_PMT || type == MPEGTS_PACKET_EMM)
+            continue;
+
+        route_remove(mod, pid, program);
+    }
+
+    program->custom_pmt->buffer_size = 0;
+    program->custom_pmt->packets_count = 0;
+}
+
+static void demux_reload(module_data_t *mod)
+{
+    for(int pid = 0; pid < MAX_PID; ++pid)
+    {
+        mpts_route_t *route = &mod->route[pid];
+        if(!route->count)
+            continue;
+
+        route->count = 0;
+        mod->stream[pid] = MPEGTS_PACKET_UNKNOWN;
+        module_stream_demux_leave_pid(mod, pid);
+    }
+
+    mod->pat->crc32 = 0;
+    mod->cat->crc32 = 0;
+
+    if(mod->sdt_checksum_list)
+    {
+        free(mod->sdt_checksum_list);
+        mod->sdt_checksum_list = NULL;
+    }
+
+    for(int i = 0; i < mod->program_count; ++i)
+    {
+        mpts_program_t *program = mod->program_list[i];
+        program->pmt->pid = MAX_PID;
+        program->pmt->crc32 = 0;
+        program->custom_pat->buffer_size = 0;
+        program->custom_pat->packets_count = 0;
+        program->custom_pmt->buffer_size = 0;
+        program->custom_pmt->packets_count = 0;
+        program->is_cat = false;
+        program->is_sdt = false;
+    }
+
+    mod->eit_program = NULL;
+}
+
+/*
+ * oooooooooo   o   ooooooooooo
+ *  888    888 888  88  888  88
+ *  888oooo88 8  88     888
+ *  888      8oooo88    888
+ * o888o   o88o  o888o o888o
+ *
+ */
+
+/* sets PMT pid and builds PAT of the program. returns false if pnr is not found */
+static bool pat_program_set(module_data_t *mod, mpegts_psi_t *psi, mpts_program_t *program)
+{
+    const uint8_t *pointer = PAT_ITEMS_FIRST(psi);
+    while(!PAT_ITEMS_EOL(psi, pointer))
+    {
+        if(PAT_ITEMS_GET_PNR(psi, pointer) == program->pnr)
+            break;
+        PAT_ITEMS_NEXT(psi, pointer);
+    }
+    if(PAT_ITEMS_EOL(psi, pointer))
+        return false;
+
+    const uint16_t pid = PAT_ITEMS_GET_PID(psi, pointer);
+    program->pmt->pid = pid;
+    program->custom_pmt->pid = pid;
+    route_append(mod, pid, MPEGTS_PACKET_PMT, program);
+
+    const uint8_t pat_version = PAT_GET_VERSION(program->custom_pat) + 1;
+    PAT_INIT(program->custom_pat, mod->tsid, pat_version);
+    memcpy(PAT_ITEMS_FIRST(program->custom_pat), pointer, 4);
+    program->custom_pat->buffer_size = 8 + 4 + CRC32_SIZE;
+    PSI_SET_SIZE(program->custom_pat);
+    PSI_SET_CRC32(program->custom_pat);
+    mpegts_psi_packetize(program->custom_pat);
+
+    return true;
+}
+
+static void on_pat(void *arg, mpegts_psi_t *psi)
+{
+    module_data_t *mod = arg;
+
+    // check changes
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if(crc32 == psi->crc32)
+    {
+        for(int i = 0; i < mod->program_count; ++i)
+        {
+            mpts_program_t *program = mod->program_list[i];
+            // program added after the PAT is parsed
+            if(!program->custom_pat->buffer_size && !pat_program_set(mod, psi, program))
+                continue;
+            PROGRAM_SEND(program, program->custom_pat);
+        }
+        return;
+    }
+
+    // check crc
+    if(crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("PAT checksum error"));
+        return;
+    }
+
+    // reload stream
+    if(psi->crc32 != 0)
+        asc_log_warning(MSG("PAT changed. Reload stream info"));
+
+    demux_reload(mod);
+
+    psi->crc32 = crc32;
+
+    mod->tsid = PAT_GET_TSID(psi);
+
+    for(int i = 0; i < mod->program_count; ++i)
+    {
+        mpts_program_t *program = mod->program_list[i];
+        if(!pat_program_set(mod, psi, program))
+        {
+            asc_log_error(MSG("PAT: stream with id %d is not found"), program->pnr);
+            continue;
+        }
+        PROGRAM_SEND(program, program->custom_pat);
+    }
+}
+
+/*
+ *   oooooooo8     o   ooooooooooo
+ * o888     88    888  88  888  88
+ * 888           8  88     888
+ * 888o     oo  8oooo88    888
+ *  888oooo88 o88o  o888o o888o
+ *
+ */
+
+static void cat_program_set(module_data_t *mod, mpegts_psi_t *psi, mpts_program_t *program)
+{
+    const uint8_t *desc_pointer = CAT_DESC_FIRST(psi);
+    while(!CAT_DESC_EOL(psi, desc_pointer))
+    {
+        if(desc_pointer[0] == 0x09)
+            route_append_ca(mod, desc_pointer, MPEGTS_PACKET_EMM, program);
+        CAT_DESC_NEXT(psi, desc_pointer);
+    }
+    program->is_cat = true;
+}
+
+static void on_cat(void *arg, mpegts_psi_t *psi)
+{
+    module_data_t *mod = arg;
+
+    // check changes
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if(crc32 == psi->crc32)
+    {
+        // program added after the CAT is parsed
+        for(int i = 0; i < mod->program_count; ++i)
+        {
+            mpts_program_t *program = mod->program_list[i];
+            if(!program->is_cat)
+                cat_program_set(mod, psi, program);
+        }
+        return;
+    }
+
+    // check crc
+    if(crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("CAT checksum mismatch"));
+        return;
+    }
+
+    // reload stream
+    if(psi->crc32 != 0)
+    {
+        asc_log_warning(MSG("CAT changed. Reload stream info"));
+        demux_reload(mod);
+        return;
+    }
+
+    psi->crc32 = crc32;
+
+    for(int i = 0; i < mod->program_count; ++i)
+        cat_program_set(mod, psi, mod->program_list[i]);
+}
+
+/*
+ * oooooooooo oooo     oooo ooooooooooo
+ *  888    888 8888o   888  88  888  88
+ *  888oooo88  88 888o8 88      888
+ *  888        88  888  88      888
+ * o888o      o88o  8  o88o    o888o
+ *
+ */
+
+static void on_pmt(void *arg, mpegts_psi_t *psi)
+{
+    mpts_program_t *program = arg;
+    module_data_t *mod = program->mod;
+
+    // check pnr
+    if(PMT_GET_PNR(psi) != program->pnr)
+        return;
+
+    // check changes
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    if(crc32 == psi->crc32)
+    {
+        PROGRAM_SEND(program, program->custom_pmt);
+        return;
+    }
+
+    // check crc
+    if(crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("PMT checksum error. pnr:%d"), program->pnr);
+        return;
+    }
+
+    // reload program
+    if(psi->crc32 != 0)
+    {
+        asc_log_warning(MSG("PMT changed. Reload program info. pnr:%d"), program->pnr);
+        program_reset(mod, program);
+    }
+
+    psi->crc32 = crc32;
+
+    const uint8_t *desc_pointer = PMT_DESC_FIRST(psi);
+    while(!PMT_DESC_EOL(psi, desc_pointer))
+    {
+        if(desc_pointer[0] == 0x09)
+            route_append_ca(mod, desc_pointer, MPEGTS_PACKET_ECM, program);
+        PMT_DESC_NEXT(psi, desc_pointer);
+    }
+
+    const uint8_t *pointer = PMT_ITEMS_FIRST(psi);
+    while(!PMT_ITEMS_EOL(psi, pointer))
+    {
+        const uint16_t pid = PMT_ITEM_GET_PID(psi, pointer);
+        route_append(mod, pid, MPEGTS_PACKET_PES, program);
+
+        desc_pointer = PMT_ITEM_DESC_FIRST(pointer);
+        while(!PMT_ITEM_DESC_EOL(pointer, desc_pointer))
+        {
+            if(desc_pointer[0] == 0x09)
+                route_append_ca(mod, desc_pointer, MPEGTS_PACKET_ECM, program);
+            PMT_ITEM_DESC_NEXT(pointer, desc_pointer);
+        }
+
+        PMT_ITEMS_NEXT(psi, pointer);
+    }
+
+    const uint16_t pcr_pid = PMT_GET_PCR(psi);
+    if(pcr_pid != NULL_TS_PID)
+        route_append(mod, pcr_pid, MPEGTS_PACKET_PES, program);
+
+    // section is passed as is, packets are built with own continuity counter
+    memcpy(program->custom_pmt->buffer, psi->buffer, psi->buffer_size);
+    program->custom_pmt->buffer_size = psi->buffer_size;
+    mpegts_psi_packetize(program->custom_pmt);
+
+    PROGRAM_SEND(program, program->custom_pmt);
+}
+
+/*
+ *  oooooooo8 ooooooooo   ooooooooooo
+ * 888         888    88o 88  888  88
+ *  888oooooo  888    888     888
+ *         888 888    888     888
+ * o88oooo888 o888ooo88      o888o
+ *
+ */
+
+/* builds SDT of the program from the section */
+static void sdt_program_set(mpegts_psi_t *psi, mpts_program_t *program, uint8_t section_id)
+{
+    const uint8_t *pointer = SDT_ITEMS_FIRST(psi);
+    while(!SDT_ITEMS_EOL(psi, pointer))
+    {
+        if(SDT_ITEM_GET_SID(psi, pointer) == program->pnr)
+            break;
+
+        SDT_ITEMS_NEXT(psi, pointer);
+    }
+
+    if(SDT_ITEMS_EOL(psi, pointer))
+    {
+        if(program->is_sdt && program->sdt_section_id == section_id)
+            program->is_sdt = false;
+        return;
+    }
+
+    program->is_sdt = true;
+    program->sdt_section_id = section_id;
+
+    mpegts_psi_t *custom_sdt = program->custom_sdt;
+    memcpy(custom_sdt->buffer, psi->buffer, 11); // copy SDT header
+    SDT_SET_SECTION_NUMBER(custom_sdt, 0);
+    SDT_SET_LAST_SECTION_NUMBER(custom_sdt, 0);
+
+    const uint16_t item_length = __SDT_ITEM_DESC_SIZE(pointer) + 5;
+    memcpy(&custom_sdt->buffer[11], pointer, item_length);
+    const uint16_t section_length = item_length + 8 + CRC32_SIZE;
+    custom_sdt->buffer_size = 3 + section_length;
+    PSI_SET_SIZE(custom_sdt);
+    PSI_SET_CRC32(custom_sdt);
+    mpegts_psi_packetize(custom_sdt);
+
+    PROGRAM_SEND(program, custom_sdt);
+}
+
+static void on_sdt(void *arg, mpegts_psi_t *psi)
+{
+    module_data_t *mod = arg;
+
+    if(psi->buffer[0] != 0x42)
+        return;
+
+    if(mod->tsid != SDT_GET_TSID(psi))
+        return;
+
+    const uint32_t crc32 = PSI_GET_CRC32(psi);
+    const uint8_t section_id = SDT_GET_SECTION_NUMBER(psi);
+
+    // check changes
+    if(mod->sdt_checksum_list
+       && section_id <= mod->sdt_max_section_id
+       && mod->sdt_checksum_list[section_id] == crc32)
+    {
+        for(int i = 0; i < mod->program_count; ++i)
+        {
+            mpts_program_t *program = mod->program_list[i];
+            if(!program->is_sdt)
+                sdt_program_set(psi, program, section_id);
+            else if(program->sdt_section_id == section_id)
+                PROGRAM_SEND(program, program->custom_sdt);
+        }
+        return;
+    }
+
+    // check crc
+    if(crc32 != PSI_CALC_CRC32(psi))
+    {
+        asc_log_error(MSG("SDT checksum error"));
+        return;
+    }
+
+    const uint8_t max_section_id = SDT_GET_LAST_SECTION_NUMBER(psi);
+    if(!mod->sdt_checksum_list || mod->sdt_max_section_id != max_section_id)
+    {
+        if(mod->sdt_checksum_list)
+            free(mod->sdt_checksum_list);
+        mod->sdt_max_section_id = max_section_id;
+        mod->sdt_checksum_list = calloc(max_section_id + 1, sizeof(uint32_t));
+    }
+    if(section_id > mod->sdt_max_section_id)
+    {
+        asc_log_warning(MSG("SDT: section_number is greater then section_last_number"));
+        return;
+    }
+
+    mod->sdt_checksum_list[section_id] = crc32;
+
+    for(int i = 0; i < mod->program_count; ++i)
+        sdt_program_set(psi, mod->program_list[i], section_id);
+}
+
+/*
+ * ooooooooooo ooooo ooooooooooo
+ *  888    88   888  88  888  88
+ *  888ooo8     888      888
+ *  888    oo   888      888
+ * o888ooo8888 o888o    o888o
+ *
+ */
+
+static void on_eit(module_data_t *mod, const uint8_t *ts)
+{
+    if(TS_PUSI(ts))
+    {
+        const uint8_t *payload = TS_PTR(ts);
+        if(!payload)
+            return;
+        payload = payload + payload[0] + 1;
+
+        mod->eit_program = NULL;
+
+        const uint8_t table_id = payload[0];
+        if(table_id == 0x4E || (table_id >= 0x50 && table_id <= 0x5F))
+            mod->eit_program = program_find(mod, (payload[3] << 8) | payload[4]);
+    }
+
+    mpts_program_t *program = mod->eit_program;
+    if(!program)
+        return;
+
+    memcpy(mod->custom_ts, ts, TS_PACKET_SIZE);
+    mod->custom_ts[3] = (ts[3] & 0xF0) | program->eit_cc;
+    program->eit_cc = (program->eit_cc + 1) & 0x0F;
+    __module_stream_send(&program->stream, mod->custom_ts);
+}
+
+/*
+ * ooooooooooo  oooooooo8
+ * 88  888  88 888
+ *     888      888oooooo
+ *     888             888
+ *    o888o    o88oooo888
+ *
+ */
+
+static void on_ts(module_data_t *mod, const uint8_t *ts)
+{
+    const uint16_t pid = TS_PID(ts);
+    if(pid == NULL_TS_PID)
+        return;
+
+    const mpts_route_t *route = &mod->route[pid];
+
+    switch(mod->stream[pid])
+    {
+        case MPEGTS_PACKET_UNKNOWN:
+            return;
+        case MPEGTS_PACKET_PAT:
+            mpegts_psi_mux(mod->pat, ts, on_pat, mod);
+            return;
+        case MPEGTS_PACKET_CAT:
+            mpegts_psi_mux(mod->cat, ts, on_cat, mod);
+            for(int i = 0; i < mod->program_count; ++i)
+                __module_stream_send(&mod->program_list[i]->stream, ts);
+            return;
+        case MPEGTS_PACKET_PMT:
+            for(int i = 0; i < route->count; ++i)
+            {
+                mpts_program_t *program = route->list[i];
+                mpegts_psi_mux(program->pmt, ts, on_pmt, program);
+            }
+            return;
+        case MPEGTS_PACKET_SDT:
+            mpegts_psi_mux(mod->sdt, ts, on_sdt, mod);
+            return;
+        case MPEGTS_PACKET_EIT:
+            on_eit(mod, ts);
+            return;
+        default:
+            break;
+    }
+
+    for(int i = 0; i < route->count; ++i)
+        __module_stream_send(&route->list[i]->stream, ts);
+}
+
+/*
+ * oooo     oooo ooooooooooo ooooooooooo ooooo ooooo  ooooooo  ooooooooo    oooooooo8
+ *  8888o   888   888    88  88  888  88  888   888 o888   888o 888    88o 888
+ *  88 888o8 88   888ooo8        888      888ooo888 888     888 888    888  888oooooo
+ *  88  888  88   888    oo      888      888   888 888o   o888 888    888         888
+ * o88o  8  o88o o888ooo8888    o888o    o888o o888o  88ooo88  o888ooo88   o88oooo888
+ *
+ */
+
+static void program_create(void *arg)
+{
+    mpts_program_t *program = arg;
+    module_data_t *mod = program->mod;
+
+    mod->program_list = realloc(mod->program_list
+                                , (mod->program_count + 1) * sizeof(mpts_program_t *));
+    mod->program_list[mod->program_count] = program;
+    ++mod->program_count;
+
+    // the program is configured by the next PAT, CAT and SDT,
+    // pids of other programs are not changed
+}
+
+static int method_program(module_data_t *mod)
+{
+    const uint16_t pnr = lua_tonumber(lua, 2);
+    asc_assert(pnr != 0, MSG("program number is required"));
+
+    mpts_program_t *program = program_find(mod, pnr);
+    if(!program)
+    {
+        program = calloc(1, sizeof(mpts_program_t));
+        program->mod = mod;
+        program->pnr = pnr;
+
+        program->pmt = mpegts_psi_init(MPEGTS_PACKET_PMT, MAX_PID);
+        program->custom_pat = mpegts_psi_init(MPEGTS_PACKET_PAT, 0);
+        program->custom_pmt = mpegts_psi_init(MPEGTS_PACKET_PMT, MAX_PID);
+        if(mod->config.sdt)
+            program->custom_sdt = mpegts_psi_init(MPEGTS_PACKET_SDT, 0x11);
+
+        program->stream.self = mod;
+        __module_stream_init(&program->stream);
+        program->stream.reactor = mod->__stream.reactor;
+
+        asc_reactor_call_wait(mod->__stream.reactor, program_create, program);
+    }
+
+    lua_pushlightuserdata(lua, &program->stream);
+    return 1;
+}
+
+/*
+ * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
+ *  8888o   888 o888   888o 888    88o 888    88   888         888    88
+ *  88 888o8 88 888     888 888    888 888    88   888         888ooo8
+ *  88  888  88 888o   o888 888    888 888    88   888      o  888    oo
+ * o88o  8  o88o  88ooo88  o888ooo88    888oo88   o888ooooo88 o888ooo8888
+ *
+ */
+
+static void module_init(module_data_t *mod)
+{
+    module_stream_init(mod, on_ts);
+    module_stream_demux_set(mod, NULL, NULL);
+
+    module_option_string("name", &mod->config.name);
+    asc_assert(mod->config.name != NULL, "[mpts_demux] option 'name' is required");
+
+    mod->route = calloc(MAX_PID, sizeof(mpts_route_t));
+
+    mod->pat = mpegts_psi_init(MPEGTS_PACKET_PAT, 0);
+    mod->cat = mpegts_psi_init(MPEGTS_PACKET_CAT, 1);
+    mod->stream[0] = MPEGTS_PACKET_PAT;
+    module_stream_demux_join_pid(mod, 0);
+    mod->stream[1] = MPEGTS_PACKET_CAT;
+    module_stream_demux_join_pid(mod, 1);
+
+    if(module_option_number("sdt", &mod->config.sdt) && mod->config.sdt)
+    {
+        mod->sdt = mpegts_psi_init(MPEGTS_PACKET_SDT, 0x11);
+        mod->stream[0x11] = MPEGTS_PACKET_SDT;
+        module_stream_demux_join_pid(mod, 0x11);
+    }
+
+    if(module_option_number("eit", &mod->config.eit) && mod->config.eit)
+    {
+        mod->stream[0x12] = MPEGTS_PACKET_EIT;
+        module_stream_demux_join_pid(mod, 0x12);
+    }
+}
+
+static void module_destroy(module_data_t *mod)
+{
+    module_stream_destroy(mod);
+
+    for(int i = 0; i < mod->program_count; ++i)
+    {
+        mpts_program_t *program = mod->program_list[i];
+        __module_stream_destroy(&program->stream);
+
+        mpegts_psi_destroy(program->pmt);
+        mpegts_psi_destroy(program->custom_pat);
+        mpegts_psi_destroy(program->custom_pmt);
+        if(program->custom_sdt)
+            mpegts_psi_destroy(program->custom_sdt);
+        free(program);
+    }
+    if(mod->program_list)
+        free(mod->program_list);
+
+    for(int pid = 0; pid < MAX_PID; ++pid)
+    {
+        if(mod->route[pid].list)
+            free(mod->route[pid].list);
+    }
+    free(mod->route);
+
+    mpegts_psi_destroy(mod->pat);
+    mpegts_psi_destroy(mod->cat);
+
+    if(mod->sdt)
+    {
+        mpegts_psi_destroy(mod->sdt);
+
+        if(mod->sdt_checksum_list)
+            free(mod->sdt_checksum_list);
+    }
+}
+
+MODULE_LUA_METHODS()
+{
+    { "program", method_program }
+};
+MODULE_LUA_REGISTER(mpts_demux)
@@ -31,6 +31,8 @@ mpegts_psi_t * mpegts_psi_init(mpegts_packet_type_t type, uint16_t pid)
     psi->buffer_size = 0;
     psi->buffer_skip = 0;
     psi->crc32 = 0;
+    psi->packets = NULL;
+    psi->packets_count = 0;
     return psi;
 }
 
@@ -39,6 +41,8 @@ void mpegts_psi_destroy(mpegts_psi_t *psi)
     if(!psi)
         return;
 
+    if(psi->packets)
+        free(psi->packets);
     free(psi);
 }
 
@@ -180,3 +184,63 @@ void mpegts_psi_demux(mpegts_psi_t *psi
         }
     }
 } /* mpegts_packet_demux */
+
+/* splits section to the TS packets once, mpegts_psi_send() only updates cc */
+void mpegts_psi_packetize(mpegts_psi_t *psi)
+{
+    const size_t buffer_size = psi->buffer_size;
+    psi->packets_count = 0;
+    if(!buffer_size)
+        return;
+
+    // 1 - pointer field
+    const size_t count = (buffer_size + 1 + TS_BODY_SIZE - 1) / TS_BODY_SIZE;
+    psi->packets = realloc(psi->packets, count * TS_PACKET_SIZE);
+
+    size_t ts_skip = TS_HEADER_SIZE + 1;
+    size_t ts_size = TS_BODY_SIZE - 1;
+    size_t buffer_skip = 0;
+
+    while(buffer_skip < buffer_size)
+    {
+        uint8_t *ts = &psi->packets[psi->packets_count * TS_PACKET_SIZE];
+        ts[0] = 0x47;
+        ts[1] = psi->pid >> 8;
+        ts[2] = psi->pid & 0xff;
+        ts[3] = 0x10; /* payload without adaptation field */
+
+        if(ts_skip == 5)
+        {
+            ts[1] |= 0x40; /* PUSI */
+            ts[4] = 0x00;
+        }
+
+        const size_t buffer_tail = buffer_size - buffer_skip;
+        if(buffer_tail < ts_size)
+        {
+            ts_size = buffer_tail;
+            const size_t ts_last_byte = ts_skip + ts_size;
+            memset(&ts[ts_last_byte], 0xFF, TS_PACKET_SIZE - ts_last_byte);
+        }
+
+        memcpy(&ts[ts_skip], &psi->buffer[buffer_skip], ts_size);
+        buffer_skip += ts_size;
+        ++psi->packets_count;
+
+        ts_skip = TS_HEADER_SIZE;
+        ts_size = TS_BODY_SIZE;
+    }
+}
+
+void mpegts_psi_send(mpegts_psi_t *psi
+                     , void (*callback)(void *, const uint8_t *)
+                     , void *arg)
+{
+    for(size_t i = 0; i < psi->packets_count; ++i)
+    {
+        uint8_t *ts = &psi->packets[i * TS_PACKET_SIZE];
+        ts[3] = 0x10 | psi->cc;
+        psi->cc = (psi->cc + 1) & 0x0F;
+        callback(arg, ts);
+    }
+}
@@ -24,16 +24,63 @@
  *
  * Module Options:
  *      upstream    - object, stream instance returned by module_instance:stream()
+ *      name        - string, name for the log messages
+ *      timeout     - number, hot-standby: input is lost if there are no packets
+ *                    for this time, in milliseconds. default: 100
+ *
+ * Module Methods:
+ *      set_upstream(stream)
+ *                  - attach to the new upstream
+ *      add_input(stream)
+ *                  - hot-standby: add input, priority is the order of the calls.
+ *                    all inputs are received, packets of the first alive input
+ *                    are sent. upstream and set_upstream are not used in this mode.
+ *                    all inputs should run in the same event loop (main loop or
+ *                    one reactor). inputs in a reactor should be added before
+ *                    the modules attached to the transmit
+ *      status()    - return table, hot-standby state:
+ *                    * input - number, active input. 0 - none
+ *                    * switch - number, switches count
  */
 
 #include <astra.h>
 
+/* lower priority input is active until the better one is alive for this time */
+#define TRANSMIT_RESTORE_TIME (1 * 1000 * 1000)
+
+typedef struct
+{
+    MODULE_STREAM_DATA();
+
+    module_data_t *mod;
+    int id;
+
+    int64_t last_time;
+    int64_t alive_since;
+} transmit_input_t;
+
 struct module_data_t
 {
     MODULE_LUA_DATA();
     MODULE_STREAM_DATA();
+
+    const char *name;
+    int64_t timeout; // us
+
+    // hot-standby
+    transmit_input_t **input_list;
+    int input_count;
+    transmit_input_t *active;
+    uint64_t switch_count;
+
+    uint8_t *pid_cc;    // last sent cc | 0x10 if the pid was sent
+    uint8_t *pid_delta; // cc correction after the switch
+    uint8_t *pid_wait;  // wait for the payload unit start after the switch
+    uint8_t custom_ts[TS_PACKET_SIZE];
 };
 
+#define MSG(_msg) "[transmit %s] " _msg, mod->name
+
 static int method_set_upstream(module_data_t *mod)
 {
     if(lua_type(lua, 2) == LUA_TLIGHTUSERDATA)
@@ -46,20 +93,213 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
     module_stream_send(mod, ts);
 }
 
+static void on_ts_buffer(module_data_t *mod, asc_buffer_t *buffer
+                         , const uint8_t *ts, size_t count)
+{
+    module_stream_send_buffer(mod, buffer, ts, count);
+}
+
+/*
+ * ooooo ooooo oooo   oooo oooooooooo ooooo  oooo ooooooooooo
+ *  888   888   8888o  88   888    888 888    88  88  888  88
+ *  888   888   88 888o88   888oooo88  888    88      888
+ *  888   888   88   8888   888        888    88      888
+ * o888o o888o o88o    88  o888o        888oo88      o888o
+ *
+ */
+
+static void input_switch(module_data_t *mod, transmit_input_t *input)
+{
+    if(mod->active)
+    {
+        asc_log_warning(MSG("switch from input #%d to #%d")
+                        , mod->active->id, input->id);
+        ++mod->switch_count;
+    }
+    else
+        asc_log_info(MSG("activate input #%d"), input->id);
+
+    mod->active = input;
+
+    // each pid starts from the beginning of the PES or section
+    memset(mod->pid_wait, 1, MAX_PID);
+}
+
+static void input_send(module_data_t *mod, const uint8_t *ts)
+{
+    const uint16_t pid = TS_PID(ts);
+
+    if(mod->pid_wait[pid])
+    {
+        const bool is_sent = (mod->pid_cc[pid] & 0x10);
+
+        if(TS_AF(ts) & 0x10)
+        {
+            if(!TS_PUSI(ts))
+                return;
+
+            mod->pid_wait[pid] = 0;
+            mod->pid_delta[pid] = (is_sent)
+                                ? ((mod->pid_cc[pid] + 1 - TS_CC(ts)) & 0x0F)
+                                : 0;
+        }
+        else
+        {
+            // no payload (adaptation field only, e.g. PCR pid).
+            // cc is not incremented, the packet is sent without waiting
+            mod->pid_delta[pid] = (is_sent)
+                                ? ((mod->pid_cc[pid] - TS_CC(ts)) & 0x0F)
+                                : 0;
+        }
+    }
+
+    const uint8_t delta = mod->pid_delta[pid];
+    const uint8_t cc = (TS_CC(ts) + delta) & 0x0F;
+    mod->pid_cc[pid] = 0x10 | cc;
+
+    if(!delta)
+    {
+        module_stream_send(mod, ts);
+        return;
+    }
+
+    memcpy(mod->custom_ts, ts, TS_PACKET_SIZE);
+    mod->custom_ts[3] = (ts[3] & 0xF0) | cc;
+    module_stream_send(mod, mod->custom_ts);
+}
+
+static void input_on_ts(transmit_input_t *input, const uint8_t *ts)
+{
+    module_data_t *mod = input->mod;
+
+    const int64_t now = asc_utime_now();
+    if(now - input->last_time > mod->timeout)
+        input->alive_since = now;
+    input->last_time = now;
+
+    transmit_input_t *active = mod->active;
+    if(input != active)
+    {
+        if(!active || now - active->last_time > mod->timeout)
+            input_switch(mod, input);
+        else if(input->id < active->id && now - input->alive_since > TRANSMIT_RESTORE_TIME)
+            input_switch(mod, input);
+        else
+            return;
+    }
+
+    input_send(mod, ts);
+}
+
+static int method_add_input(module_data_t *mod)
+{
+    if(lua_type(lua, 2) != LUA_TLIGHTUSERDATA)
+        return 0;
+
+    // input_on_ts() is called in the event loop of the input
+    module_stream_t *upstream = lua_touserdata(lua, 2);
+    if(mod->input_count > 0 && upstream->reactor != mod->__stream.reactor)
+    {
+        asc_log_error(MSG("input #%d is refused. all inputs should run in the same event loop")
+                      , mod->input_count + 1);
+        return 0;
+    }
+    if(!mod->input_count && upstream->reactor != mod->__stream.reactor)
+    {
+        if(!TAILQ_EMPTY(&mod->__stream.childs))
+        {
+            asc_log_error(MSG("input #1 is refused. input running in a reactor "
+                              "should be added before the modules attached to the transmit"));
+            return 0;
+        }
+        module_stream_reactor_set(mod, upstream->reactor);
+    }
+
+    if(!mod->input_count)
+    {
+        mod->pid_cc = calloc(MAX_PID, sizeof(uint8_t));
+        mod->pid_delta = calloc(MAX_PID, sizeof(uint8_t));
+        mod->pid_wait = calloc(MAX_PID, sizeof(uint8_t));
+    }
+
+    transmit_input_t *input = calloc(1, sizeof(transmit_input_t));
+    input->mod = mod;
+    input->id = mod->input_count + 1;
+
+    mod->input_list = realloc(mod->input_list
+                              , (mod->input_count + 1) * sizeof(transmit_input_t *));
+    mod->input_list[mod->input_count] = input;
+    ++mod->input_count;
+
+    // like module_stream_init()
+    input->__stream.self = (void *)input;
+    input->__stream.on_ts = (void (*)(module_data_t *, const uint8_t *))input_on_ts;
+    __module_stream_init(&input->__stream);
+    __module_stream_attach(upstream, &input->__stream);
+
+    return 0;
+}
+
+static int method_status(module_data_t *mod)
+{
+    lua_newtable(lua);
+
+    lua_pushnumber(lua, (mod->active) ? mod->active->id : 0);
+    lua_setfield(lua, -2, "input");
+    lua_pushnumber(lua, mod->switch_count);
+    lua_setfield(lua, -2, "switch");
+
+    return 1;
+}
+
+/*
+ * oooo     oooo  ooooooo  ooooooooo  ooooo  oooo ooooo       ooooooooooo
+ *  8888o   888 o888   888o 888    88o 888    88   888         888    88
+ *  88 888o8 88 888     888 888    888 888    88   888         888ooo8
+ *  88  888  88 888o   o888 888    888 888    88   888      o  888    oo
+ * o88o  8  o88o  88ooo88  o888ooo88    888oo88   o888ooooo88 o888ooo8888
+ *
+ */
+
 static void module_init(module_data_t *mod)
 {
     module_stream_init(mod, on_ts);
+    module_stream_buffer_set(mod, on_ts_buffer);
+
+    if(!module_option_string("name", &mod->name))
+        mod->name = "";
+
+    int timeout = 100;
+    module_option_number("timeout", &timeout);
+    mod->timeout = (int64_t)timeout * 1000;
 }
 
 static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
+
+    for(int i = 0; i < mod->input_count; ++i)
+    {
+        transmit_input_t *input = mod->input_list[i];
+        __module_stream_destroy(&input->__stream);
+        free(input);
+    }
+
+    if(mod->input_list)
+    {
+        free(mod->input_list);
+        free(mod->pid_cc);
+        free(mod->pid_delta);
+        free(mod->pid_wait);
+    }
 }
 
 MODULE_STREAM_METHODS()
 MODULE_LUA_METHODS()
 {
     { "set_upstream", method_set_upstream },
+    { "add_input", method_add_input },
+    { "status", method_status },
     MODULE_STREAM_METHODS_REF()
 };
 
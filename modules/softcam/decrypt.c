@@ -28,6 +28,8 @@
  *      biss        - string, BISS key, 16 chars length. example: biss = "1122330044556600"
  *      cam         - object, cam instance returned by cam_module_instance:cam()
  *      cas_data    - string, additional paramters for CAS
+ *      pool        - boolean, descramble clusters in the shared pool of threads.
+ *                    default: true. false - descramble in the stream thread
  */
 
 #include <astra.h>
@@ -40,6 +42,38 @@
 #include "libdvbcsa/dvbcsa/dvbcsa.h"
 #endif
 
+#ifndef _WIN32
+#   include <pthread.h>
+#   define DECRYPT_POOL 1
+#endif
+
+#define DECRYPT_JOBS 4 /* clusters in progress per instance */
+#define DECRYPT_WORKERS_MAX 32
+
+typedef enum
+{
+    DECRYPT_JOB_FREE = 0,   /* empty or filling */
+    DECRYPT_JOB_QUEUED,     /* full, waits for the previous cluster */
+    DECRYPT_JOB_BUSY,       /* in the pool */
+    DECRYPT_JOB_DONE,       /* descrambled, waits for delivery */
+} decrypt_job_status_t;
+
+typedef struct decrypt_job_t decrypt_job_t;
+struct decrypt_job_t
+{
+    module_data_t *mod;
+    uint8_t *buffer;
+    int status;
+
+    /* key changes in the stream order */
+    bool is_key_reset; // both keys, before the cluster
+    uint8_t key_reset[16];
+    int new_key_id; // one key, after the cluster
+    uint8_t new_key[16];
+
+    decrypt_job_t *next;
+};
+
 struct module_data_t
 {
     MODULE_LUA_DATA();
@@ -58,11 +92,14 @@ struct module_data_t
     int64_t ecm_pid_delay;
 
     /* Buffer */
-    uint8_t *buffer; // r_buffer + s_buffer
-    uint8_t *r_buffer;
-    uint8_t *s_buffer;
+    uint8_t *buffer; // DECRYPT_JOBS clusters
     size_t buffer_skip;
 
+    bool is_pool;
+    decrypt_job_t jobs[DECRYPT_JOBS];
+    size_t job_fill; // receives packets
+    size_t job_send; // oldest not delivered
+
     /* Descambling */
     bool is_keys;
     uint8_t **cluster;
@@ -83,6 +120,8 @@ struct module_data_t
 
     int new_key_id; // 0 - not, 1 - first key, 2 - second key
     uint8_t new_key[16];
+    bool is_key_reset;
+    uint8_t key_reset[16];
 
     /* Base */
     mpegts_psi_t *pat;
@@ -587,6 +626,253 @@ void libdvbcsa_decrypt_packets(module_data_t *mod)
 }
 #endif
 
+/*
+ * oooooooooo    ooooooo     ooooooo  ooooo
+ *  888    888 o888   888o o888   888o 888
+ *  888oooo88  888     888 888     888 888
+ *  888        888o   o888 888o   o888 888      o
+ * o888o         88ooo88     88ooo88  o888ooooo88
+ *
+ */
+
+/* key_id: 1 - even key, 2 - odd key. key points to the both keys */
+static void decrypt_key_set(module_data_t *mod, int key_id, const uint8_t *key)
+{
+    const uint8_t *cw = (key_id == 1) ? &key[0] : &key[8];
+#ifdef DVBCSA
+    if(mod->algo)
+    {
+        dvbcsa_bs_key_set(cw, (key_id == 1) ? mod->libdvbcsa_key_even
+                                            : mod->libdvbcsa_key_odd);
+        return;
+    }
+#endif
+#ifdef FFDECSA
+    if(key_id == 1)
+        set_even_control_word(mod->ffdecsa, cw);
+    else
+        set_odd_control_word(mod->ffdecsa, cw);
+#else
+    __uarg(cw);
+#endif
+}
+
+/* called in the pool. only one cluster of the instance is in progress */
+static void decrypt_job_run(decrypt_job_t *job)
+{
+    module_data_t *mod = job->mod;
+
+    if(job->is_key_reset)
+    {
+        decrypt_key_set(mod, 1, job->key_reset);
+        decrypt_key_set(mod, 2, job->key_reset);
+    }
+
+    // fill cluster
+    size_t i = 0, p = 0;
+    for(; i < mod->cluster_size_bytes; i += TS_PACKET_SIZE, p += 2)
+    {
+        mod->cluster[p  ] = &job->buffer[i];
+        mod->cluster[p+1] = &job->buffer[i+TS_PACKET_SIZE];
+    }
+    mod->cluster[p] = 0;
+
+    // decrypt
+#ifdef DVBCSA
+    if (mod->algo)
+    {
+        libdvbcsa_decrypt_packets(mod);
+    }
+    else
+    {
+#endif
+#ifdef FFDECSA
+        i = 0;
+        while(i < mod->cluster_size)
+            i += decrypt_packets(mod->ffdecsa, mod->cluster);
+#endif
+#ifdef DVBCSA
+    }
+#endif
+
+    // check new key
+    if(job->new_key_id)
+        decrypt_key_set(mod, job->new_key_id, job->new_key);
+}
+
+#ifdef DECRYPT_POOL
+
+typedef struct
+{
+    int refs;
+    bool is_stopped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // new job
+    pthread_cond_t done; // job is done
+
+    decrypt_job_t *queue_head;
+    decrypt_job_t *queue_tail;
+
+    int workers_count;
+    asc_thread_t *workers[DECRYPT_WORKERS_MAX];
+} decrypt_pool_t;
+
+static decrypt_pool_t decrypt_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void decrypt_pool_loop(void *arg)
+{
+    decrypt_pool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while(!pool->is_stopped)
+    {
+        decrypt_job_t *job = pool->queue_head;
+        if(!job)
+        {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+
+        pool->queue_head = job->next;
+        if(!pool->queue_head)
+            pool->queue_tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        decrypt_job_run(job);
+
+        pthread_mutex_lock(&pool->lock);
+        __atomic_store_n(&job->status, DECRYPT_JOB_DONE, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void decrypt_pool_attach(void)
+{
+    decrypt_pool_t *pool = &decrypt_pool;
+
+    ++pool->refs;
+    if(pool->workers_count > 0)
+        return;
+
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if(count < 1)
+        count = 1;
+    else if(count > DECRYPT_WORKERS_MAX)
+        count = DECRYPT_WORKERS_MAX;
+
+    pool->is_stopped = false;
+    for(int i = 0; i < count; ++i)
+        asc_thread_init(&pool->workers[i], decrypt_pool_loop, pool);
+    pool->workers_count = count;
+
+    asc_log_debug("[decrypt] %d descrambling threads started", pool->workers_count);
+}
+
+static void decrypt_pool_detach(void)
+{
+    decrypt_pool_t *pool = &decrypt_pool;
+
+    --pool->refs;
+    if(pool->refs > 0)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->is_stopped = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int i = 0; i < pool->workers_count; ++i)
+        asc_thread_destroy(&pool->workers[i]);
+    pool->workers_count = 0;
+}
+
+#endif /* DECRYPT_POOL */
+
+static void decrypt_job_submit(decrypt_job_t *job)
+{
+#ifdef DECRYPT_POOL
+    if(job->mod->is_pool)
+    {
+        decrypt_pool_t *pool = &decrypt_pool;
+
+        job->status = DECRYPT_JOB_BUSY;
+        job->next = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        if(pool->queue_tail)
+            pool->queue_tail->next = job;
+        else
+            pool->queue_head = job;
+        pool->queue_tail = job;
+        pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+#endif
+
+    decrypt_job_run(job);
+    job->status = DECRYPT_JOB_DONE;
+}
+
+static void decrypt_job_wait(decrypt_job_t *job)
+{
+#ifdef DECRYPT_POOL
+    decrypt_pool_t *pool = &decrypt_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while(job->status == DECRYPT_JOB_BUSY)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+#else
+    __uarg(job);
+#endif
+}
+
+/* sends descrambled clusters in the stream order */
+static void decrypt_deliver(module_data_t *mod)
+{
+    while(true)
+    {
+        decrypt_job_t *job = &mod->jobs[mod->job_send];
+        const int status = __atomic_load_n(&job->status, __ATOMIC_ACQUIRE);
+
+        if(status == DECRYPT_JOB_QUEUED)
+            decrypt_job_submit(job);
+        else if(status == DECRYPT_JOB_DONE)
+        {
+            module_stream_send_batch(mod, job->buffer, mod->cluster_size);
+            job->status = DECRYPT_JOB_FREE;
+            mod->job_send = (mod->job_send + 1) % DECRYPT_JOBS;
+        }
+        else
+            break;
+    }
+}
+
+/* keys are lost. delivers clusters in progress before the plain packets */
+static void decrypt_drain(module_data_t *mod)
+{
+    while(mod->job_send != mod->job_fill)
+    {
+        decrypt_job_wait(&mod->jobs[mod->job_send]);
+        decrypt_deliver(mod);
+    }
+
+    // half-filled cluster is sent as is
+    if(mod->buffer_skip > 0)
+    {
+        module_stream_send_batch(mod, mod->jobs[mod->job_fill].buffer
+                                 , mod->buffer_skip / TS_PACKET_SIZE);
+        mod->buffer_skip = 0;
+    }
+}
+
 /*
  * ooooooooooo  oooooooo8
  * 88  888  88 888
@@ -621,89 +907,46 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
             break;
     }
 
+    decrypt_deliver(mod);
+
     if(!mod->is_keys)
     {
+        decrypt_drain(mod);
         module_stream_send(mod, ts);
         return;
     }
 
-    memcpy(&mod->r_buffer[mod->buffer_skip], ts, TS_PACKET_SIZE);
-    if(mod->s_buffer)
-        module_stream_send(mod, &mod->s_buffer[mod->buffer_skip]);
+    decrypt_job_t *job = &mod->jobs[mod->job_fill];
+    memcpy(&job->buffer[mod->buffer_skip], ts, TS_PACKET_SIZE);
 
     mod->buffer_skip += TS_PACKET_SIZE;
     if(mod->buffer_skip < mod->cluster_size_bytes)
         return;
+    mod->buffer_skip = 0;
 
-    // fill cluster
-    size_t i = 0, p = 0;
-    mod->cluster[p] = 0;
-    for(; i < mod->cluster_size_bytes; i += TS_PACKET_SIZE, p += 2)
-    {
-        mod->cluster[p  ] = &mod->r_buffer[i];
-        mod->cluster[p+1] = &mod->r_buffer[i+TS_PACKET_SIZE];
-    }
-    mod->cluster[p] = 0;
-
-    // decrypt
-#ifdef DVBCSA
-    if (mod->algo)
+    job->is_key_reset = mod->is_key_reset;
+    if(mod->is_key_reset)
     {
-        libdvbcsa_decrypt_packets(mod);
+        memcpy(job->key_reset, mod->key_reset, 16);
+        mod->is_key_reset = false;
     }
-    else
-    {
-#endif
-#ifdef FFDECSA
-        i = 0;
-        while(i < mod->cluster_size)
-            i += decrypt_packets(mod->ffdecsa, mod->cluster);
-#endif
-#ifdef DVBCSA
-    }
-#endif
-
-    // check new key
+    job->new_key_id = mod->new_key_id;
     if(mod->new_key_id)
     {
-        if(mod->new_key_id == 1)
-        {
-#ifdef DVBCSA
-            if (mod->algo)
-                dvbcsa_bs_key_set(&mod->new_key[0], mod->libdvbcsa_key_even);
-#ifdef FFDECSA
-            else
-#endif
-#endif
-#ifdef FFDECSA
-                set_even_control_word(mod->ffdecsa, &mod->new_key[0]);
-#endif
-        }
-        else if(mod->new_key_id == 2)
-        {
-#ifdef DVBCSA
-            if (mod->algo)
-                dvbcsa_bs_key_set(&mod->new_key[8], mod->libdvbcsa_key_odd);
-#ifdef FFDECSA
-            else
-#endif
-#endif
-#ifdef FFDECSA
-                set_odd_control_word(mod->ffdecsa, &mod->new_key[8]);
-#endif
-        }
+        memcpy(job->new_key, mod->new_key, 16);
         mod->new_key_id = 0;
     }
 
-    // swap buffers
-    uint8_t *tmp = mod->r_buffer;
-    if(mod->s_buffer)
-        mod->r_buffer = mod->s_buffer;
-    else
-        mod->r_buffer = &mod->buffer[mod->cluster_size_bytes];
-    mod->s_buffer = tmp;
+    job->status = DECRYPT_JOB_QUEUED;
+    mod->job_fill = (mod->job_fill + 1) % DECRYPT_JOBS;
+    decrypt_deliver(mod);
 
-    mod->buffer_skip = 0;
+    // all clusters are in progress. wait for the oldest one
+    while(mod->jobs[mod->job_fill].status != DECRYPT_JOB_FREE)
+    {
+        decrypt_job_wait(&mod->jobs[mod->job_send]);
+        decrypt_deliver(mod);
+    }
 }
 
 /*
@@ -789,20 +1032,10 @@ static void on_response(module_data_t *mod, const uint8_t *data, const char *err
         }
         else
         {
+            // keys are used by the pool. applied before the next cluster
             mod->new_key_id = 0;
-#ifdef DVBCSA
-            if (mod->algo)
-            {
-                dvbcsa_bs_key_set(&data[3], mod->libdvbcsa_key_even);
-                dvbcsa_bs_key_set(&data[11], mod->libdvbcsa_key_odd);
-            }
-#ifdef FFDECSA
-            else
-#endif
-#endif
-#ifdef FFDECSA
-               set_control_words(mod->ffdecsa, &data[3], &data[11]);
-#endif
+            mod->is_key_reset = true;
+            memcpy(mod->key_reset, &data[3], 16);
             memcpy(mod->new_key, &data[3], 16);
             if(mod->is_keys)
                 asc_log_warning(MSG("Both keys changed"));
@@ -892,6 +1125,7 @@ static void on_response(module_data_t *mod, const uint8_t *data, const char *err
 
 static void module_init(module_data_t *mod)
 {
+    module_stream_main_loop_set(mod);
     module_stream_init(mod, on_ts);
 
     module_option_string("name", &mod->name);
@@ -934,10 +1168,22 @@ static void module_init(module_data_t *mod)
     }
 #endif
 
-    mod->buffer = malloc(mod->cluster_size_bytes * 2);
-    mod->r_buffer = mod->buffer; // s_buffer = NULL
+    mod->buffer = malloc(mod->cluster_size_bytes * DECRYPT_JOBS);
+    for(int i = 0; i < DECRYPT_JOBS; ++i)
+    {
+        mod->jobs[i].mod = mod;
+        mod->jobs[i].buffer = &mod->buffer[i * mod->cluster_size_bytes];
+    }
+
+#ifdef DECRYPT_POOL
+    int pool = 1;
+    module_option_number("pool", &pool);
+    mod->is_pool = (pool != 0);
+    if(mod->is_pool)
+        decrypt_pool_attach();
+#endif
 
-    uint8_t first_key[8] = { 0 };
+    uint8_t first_key[16] = { 0 };
     const char *string_value = NULL;
     const int biss_length = module_option_string("biss", &string_value);
     if(string_value)
@@ -947,27 +1193,15 @@ static void module_init(module_data_t *mod)
             asc_log_error(MSG("biss key must be 16 chars length"));
             astra_abort();
         }
-        str_to_hex(string_value, first_key, sizeof(first_key));
+        str_to_hex(string_value, first_key, 8);
         first_key[3] = (first_key[0] + first_key[1] + first_key[2]) & 0xFF;
         first_key[7] = (first_key[4] + first_key[5] + first_key[6]) & 0xFF;
+        memcpy(&first_key[8], first_key, 8);
         mod->is_keys = true;
         mod->caid = 0x2600;
     }
-#ifdef DVBCSA
-    if (mod->algo)
-    {
-        dvbcsa_bs_key_set(first_key, mod->libdvbcsa_key_even);
-        dvbcsa_bs_key_set(first_key, mod->libdvbcsa_key_odd);
-    }
-    else
-    {
-#endif
-#ifdef FFDECSA
-    set_control_words(mod->ffdecsa, first_key, first_key);
-#endif
-#ifdef DVBCSA
-    }
-#endif
+    decrypt_key_set(mod, 1, first_key);
+    decrypt_key_set(mod, 2, first_key);
 
     mod->__decrypt.self = mod;
     mod->__decrypt.on_cam_ready = on_cam_ready;
@@ -1012,6 +1246,14 @@ static void module_destroy(module_data_t *mod)
         module_decrypt_cas_destroy(mod);
     }
 
+    // the pool may use keys and buffers of the instance
+    for(int i = 0; i < DECRYPT_JOBS; ++i)
+        decrypt_job_wait(&mod->jobs[i]);
+#ifdef DECRYPT_POOL
+    if(mod->is_pool)
+        decrypt_pool_detach();
+#endif
+
 #ifdef DVBCSA
     dvbcsa_bs_key_free(mod->libdvbcsa_key_even);
     dvbcsa_bs_key_free(mod->libdvbcsa_key_odd);
@@ -0,0 +1,55 @@
+/*
+ * Astra Module: UDP (SMPTE 2022-1 FEC)
+ * http://cesbo.com/astra
+ *
+ * Copyright (C) 2012-2013, Andrey Dyldin <and@cesbo.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fec.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#   include <immintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+void fec_xor(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for(; i + 32 <= size; i += 32)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)&dst[i]);
+        const __m256i b = _mm256_loadu_si256((const __m256i *)&src[i]);
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_xor_si256(a, b));
+    }
+#endif
+#if defined(__SSE2__)
+    for(; i + 16 <= size; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i *)&dst[i]);
+        const __m128i b = _mm_loadu_si128((const __m128i *)&src[i]);
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_xor_si128(a, b));
+    }
+#elif defined(__ARM_NEON)
+    for(; i + 16 <= size; i += 16)
+        vst1q_u8(&dst[i], veorq_u8(vld1q_u8(&dst[i]), vld1q_u8(&src[i])));
+#endif
+
+    for(; i < size; ++i)
+        dst[i] ^= src[i];
+}
@@ -29,26 +29,153 @@
  *      socket_size - number, socket buffer size
  *      rtp         - boolean, use RTP instad RAW UDP
  *      renew       - number, renewing multicast subscription interval in seconds
+ *      reactor     - number, id of the event loop thread to receive and process the stream.
+ *                    0 - main loop [default]. stream tree attached to this input
+ *                    runs in the same thread. udp_output, channel, transmit
+ *                    and mpts_demux could be used in the tree. modules with
+ *                    Lua callbacks or main loop events (analyze, http_server,
+ *                    decrypt, ddci, file_output) are refused on attach
+ *      batch       - number, maximum number of datagrams received per wakeup. default: 32
+ *      fec         - boolean, SMPTE 2022-1 FEC. column FEC is received on port+2,
+ *                    row FEC on port+4. implies rtp
+ *      fec_columns - number, FEC matrix size (L). default: taken from the column FEC
+ *      fec_rows    - number, FEC matrix size (D). default: taken from the column FEC
+ *      reorder     - number, reorder window in datagrams. datagrams are delivered
+ *                    in the sequence order, missing datagram is waited until
+ *                    the number of the next datagrams is received. implies rtp
+ *      jitter      - number, jitter buffer depth in milliseconds. datagrams are
+ *                    delivered with the constant delay. implies rtp
+ *      bitrate     - number, maximum stream bitrate in Mbit/s to size the jitter
+ *                    buffer. if the buffer is full, datagrams are delivered
+ *                    ahead of time (rtp_overrun). default: 40
+ *
+ * Module Methods:
+ *      status()    - return table with receiving statistics:
+ *                    wakeups, datagrams, batch (average datagrams per wakeup)
+ *                    with rtp: rtp_lost (datagrams missing in the output),
+ *                    rtp_reordered, rtp_duplicate, rtp_overrun
+ *                    (datagrams delivered ahead of time)
+ *                    with fec: fec_packets, fec_recovered, fec_lost
  */
 
 #include <astra.h>
+#include "fec.h"
 
 #define UDP_BUFFER_SIZE 1460
+#define UDP_BATCH_SIZE 32
+#define UDP_BATCH_MAX 1024
+#define UDP_POOL_CACHE 4
 #define TS_PACKET_SIZE 188
 
+#define RTP_WINDOW 512
+#define RTP_WINDOW_JITTER 4096
+#define RTP_WINDOW_MAX 16384
+#define RTP_JITTER_MAX 1000
+#define RTP_JITTER_BITRATE 40
+#define RTP_JITTER_INTERVAL 5
+#define FEC_SLOTS 128
+#define FEC_DEFAULT_DELAY 210
+
 #define MSG(_msg) "[udp_input] " _msg
 
+typedef struct
+{
+    const uint8_t *payload; // next to the fixed RTP header
+    uint64_t time;
+    uint16_t size;
+    uint16_t skip; // CSRC and header extension
+    uint8_t flags; // first byte of the RTP header: version, P, X, CSRC count
+    uint16_t seq;
+    int slot; // storage slot, -1 for recovered datagram
+    bool is_set;
+} rtp_packet_t;
+
+typedef struct
+{
+    // datagrams are received directly into the storage ring and delivered
+    // in the sequence order. missing datagram is waited for the delay
+    // (in datagrams) or until the next datagram is out of the jitter buffer
+    uint32_t window;
+    int delay;
+    uint64_t jitter;
+
+    bool is_seq;
+    uint16_t next_seq;
+    uint16_t head_seq;
+
+    size_t storage_pos;
+    int *storage_seq;
+    uint8_t *storage;
+    rtp_packet_t *packet;
+} udp_rtp_t;
+
+typedef struct
+{
+    const uint8_t *payload;
+    uint16_t size;
+    uint16_t base;
+    uint16_t length_recovery;
+    uint8_t offset;
+    uint8_t na;
+    bool is_set;
+} fec_packet_t;
+
+typedef struct
+{
+    int columns;
+    int rows;
+
+    uint8_t *recovery;
+
+    size_t pos;
+    uint8_t storage[FEC_SLOTS * UDP_BUFFER_SIZE];
+    fec_packet_t packet[FEC_SLOTS];
+
+    uint64_t packets;
+    uint64_t recovered;
+    uint64_t lost;
+} udp_fec_t;
+
 struct module_data_t
 {
     MODULE_LUA_DATA();
     MODULE_STREAM_DATA();
 
+    const char *addr;
+    int port;
+    const char *localaddr;
+    int socket_size;
+    int renew;
+    int batch;
+
     int is_rtp;
+    int reorder;
 
     asc_socket_t *sock;
     asc_timer_t *timer_renew;
+    asc_timer_t *timer_jitter;
+
+    // sequence buffer for the reorder window, jitter buffer and FEC
+    udp_rtp_t *rtp;
+    udp_fec_t *fec;
+    asc_socket_t *fec_sock[2];
+
+    bool is_rtp_seq;
+    uint16_t rtp_seq;
+    uint8_t rtp_seq_map[RTP_WINDOW_MAX / 8]; // received sequence numbers
+    uint64_t rtp_lost;
+    uint64_t rtp_reordered;
+    uint64_t rtp_duplicate;
+    uint64_t rtp_overrun;
+
+    // datagrams are received into the reference-counted block.
+    // if childs keep the block, next datagrams go to the new one
+    asc_buffer_pool_t *pool;
+    asc_buffer_t *block;
+    size_t *buffer_len;
 
-    uint8_t buffer[UDP_BUFFER_SIZE];
+    uint64_t wakeups;
+    uint64_t datagrams;
 };
 
 void on_close(void *arg)
@@ -62,30 +189,538 @@ void on_close(void *arg)
         mod->sock = NULL;
     }
 
+    for(int i = 0; i < 2; ++i)
+    {
+        if(mod->fec_sock[i])
+        {
+            asc_socket_multicast_leave(mod->fec_sock[i]);
+            asc_socket_close(mod->fec_sock[i]);
+            mod->fec_sock[i] = NULL;
+        }
+    }
+
     if(mod->timer_renew)
     {
         asc_timer_destroy(mod->timer_renew);
         mod->timer_renew = NULL;
     }
+
+    if(mod->timer_jitter)
+    {
+        asc_timer_destroy(mod->timer_jitter);
+        mod->timer_jitter = NULL;
+    }
+}
+
+static int rtp_header_size(const uint8_t *buffer, size_t len)
+{
+    if(len < RTP_HEADER_SIZE || (buffer[0] & 0xC0) != 0x80)
+        return -1;
+
+    size_t skip = RTP_HEADER_SIZE + (buffer[0] & 0x0F) * 4;
+    if(buffer[0] & 0x10)
+    {
+        if(len < skip + 4)
+            return -1;
+        skip += 4 + ((buffer[skip + 2] << 8) | buffer[skip + 3]) * 4;
+    }
+
+    return (skip <= len) ? (int)skip : -1;
+}
+
+#define RTP_SEQ_BIT(_seq) (1 << ((_seq) & 7))
+#define RTP_SEQ_BYTE(_mod, _seq) (_mod)->rtp_seq_map[((_seq) % RTP_WINDOW_MAX) / 8]
+
+static inline void rtp_seq_set(module_data_t *mod, uint16_t seq)
+{
+    RTP_SEQ_BYTE(mod, seq) |= RTP_SEQ_BIT(seq);
+}
+
+/* loss, reorder and duplicate counters. seq - arrived datagram,
+ * is_fill - late datagram is delivered and not counted as lost */
+static void rtp_check_seq(module_data_t *mod, uint16_t seq, bool is_fill)
+{
+    const int16_t diff = seq - mod->rtp_seq;
+
+    // late datagrams are passed up to the full jitter buffer behind
+    if(!mod->is_rtp_seq || diff >= RTP_WINDOW_MAX || diff <= -RTP_WINDOW_MAX)
+    {
+        // first datagram or sender restarted
+        mod->is_rtp_seq = true;
+        mod->rtp_seq = seq;
+        memset(mod->rtp_seq_map, 0, sizeof(mod->rtp_seq_map));
+        rtp_seq_set(mod, seq);
+        return;
+    }
+
+    if(diff > 0)
+    {
+        mod->rtp_lost += diff - 1;
+        for(uint16_t i = mod->rtp_seq + 1; i != seq; ++i)
+            RTP_SEQ_BYTE(mod, i) &= ~RTP_SEQ_BIT(i);
+        rtp_seq_set(mod, seq);
+        mod->rtp_seq = seq;
+    }
+    else if(RTP_SEQ_BYTE(mod, seq) & RTP_SEQ_BIT(seq))
+        ++mod->rtp_duplicate;
+    else
+    {
+        rtp_seq_set(mod, seq);
+        ++mod->rtp_reordered;
+        // late datagram fills the gap
+        if(is_fill && mod->rtp_lost > 0)
+            --mod->rtp_lost;
+    }
+}
+
+static rtp_packet_t * rtp_get(udp_rtp_t *rtp, uint16_t seq)
+{
+    rtp_packet_t *packet = &rtp->packet[seq & (rtp->window - 1)];
+    if(!packet->is_set || packet->seq != seq)
+        return NULL;
+
+    // storage slot is overwritten with the newer datagram
+    if(packet->slot >= 0 && rtp->storage_seq[packet->slot] != seq)
+        return NULL;
+
+    return packet;
+}
+
+static void rtp_reset(module_data_t *mod, uint16_t seq)
+{
+    udp_rtp_t *rtp = mod->rtp;
+
+    for(uint32_t i = 0; i < rtp->window; ++i)
+        rtp->packet[i].is_set = false;
+
+    if(mod->fec)
+    {
+        for(int i = 0; i < FEC_SLOTS; ++i)
+            mod->fec->packet[i].is_set = false;
+    }
+
+    rtp->is_seq = true;
+    rtp->next_seq = seq;
+    rtp->head_seq = seq;
+}
+
+static void rtp_overrun(module_data_t *mod, uint16_t seq);
+
+static void rtp_push(module_data_t *mod, int slot, const uint8_t *buffer, size_t len)
+{
+    udp_rtp_t *rtp = mod->rtp;
+    rtp->storage_seq[slot] = -1;
+
+    const int skip = rtp_header_size(buffer, len);
+    if(skip < 0)
+        return;
+
+    const uint16_t seq = (buffer[2] << 8) | buffer[3];
+    if(!rtp->is_seq)
+        rtp_reset(mod, seq);
+
+    int16_t diff = seq - rtp->next_seq;
+    if(diff >= (int)rtp->window && diff < (int)(rtp->window + rtp->window / 2))
+    {
+        // datagram is out of the window
+        rtp_overrun(mod, seq - rtp->window + 1);
+        diff = seq - rtp->next_seq;
+    }
+
+    if(diff >= (int)rtp->window || diff <= -(int)rtp->window)
+        rtp_reset(mod, seq); // sender restarted
+    else if(diff < 0)
+    {
+        // already delivered or skipped. the gap stays in the output
+        rtp_check_seq(mod, seq, false);
+        return;
+    }
+
+    if(rtp_get(rtp, seq))
+    {
+        ++mod->rtp_duplicate;
+        return;
+    }
+    rtp_check_seq(mod, seq, true);
+
+    rtp->storage_seq[slot] = seq;
+    rtp_packet_t *packet = &rtp->packet[seq & (rtp->window - 1)];
+    packet->payload = &buffer[RTP_HEADER_SIZE];
+    packet->time = asc_utime_now();
+    packet->size = len - RTP_HEADER_SIZE;
+    packet->skip = skip - RTP_HEADER_SIZE;
+    packet->flags = buffer[0];
+    packet->seq = seq;
+    packet->slot = slot;
+    packet->is_set = true;
+
+    if((int16_t)(seq - rtp->head_seq) > 0)
+        rtp->head_seq = seq;
+}
+
+/* FEC */
+
+static void fec_set_matrix(module_data_t *mod, int columns, int rows)
+{
+    mod->fec->columns = columns;
+    mod->fec->rows = rows;
+
+    // column FEC of the matrix could be spread over the next matrix
+    const int delay = 2 * columns * rows + columns;
+    mod->rtp->delay = (mod->reorder > delay) ? mod->reorder : delay;
+
+    asc_log_info(MSG("%s:%d FEC matrix %dx%d"), mod->addr, mod->port, columns, rows);
+}
+
+/* restore the only missing datagram of the FEC group */
+static bool fec_restore(module_data_t *mod, const fec_packet_t *packet, uint16_t seq)
+{
+    udp_rtp_t *rtp = mod->rtp;
+    udp_fec_t *fec = mod->fec;
+
+    if((int16_t)(seq - rtp->next_seq) < 0)
+        return false;
+
+    const uint32_t slot = seq & (rtp->window - 1);
+    uint8_t *const payload = &fec->recovery[slot * UDP_BUFFER_SIZE];
+    memcpy(payload, packet->payload, packet->size);
+    uint16_t size = packet->length_recovery;
+    uint8_t flags = 0;
+
+    for(int i = 0; i < packet->na; ++i)
+    {
+        const uint16_t item_seq = packet->base + i * packet->offset;
+        if(item_seq == seq)
+            continue;
+
+        const rtp_packet_t *item = rtp_get(rtp, item_seq);
+        const size_t item_size = (item->size < packet->size) ? item->size : packet->size;
+        fec_xor(payload, item->payload, item_size);
+        size ^= item->size;
+        flags = item->flags;
+    }
+
+    if(size > packet->size)
+        return false;
+
+    // CSRC count and extension bit are not protected by FEC.
+    // the header layout is taken from the other datagram of the group
+    size_t skip = (flags & 0x0F) * 4;
+    if(flags & 0x10)
+    {
+        if(size < skip + 4)
+            return false;
+        skip += 4 + ((payload[skip + 2] << 8) | payload[skip + 3]) * 4;
+    }
+    if(skip >= size || payload[skip] != 0x47)
+        return false;
+
+    rtp_packet_t *item = &rtp->packet[slot];
+    item->payload = payload;
+    item->time = asc_utime_now();
+    item->size = size;
+    item->skip = skip;
+    item->flags = flags;
+    item->seq = seq;
+    item->slot = -1;
+    item->is_set = true;
+
+    ++fec->recovered;
+    return true;
+}
+
+static bool fec_recover_seq(module_data_t *mod, uint16_t seq, int depth);
+
+/* depth - number of the crossing groups to recover first, if group lost 2 datagrams */
+static bool fec_recover(module_data_t *mod, const fec_packet_t *packet, int depth)
+{
+    uint16_t missing[2] = { 0, 0 };
+    int count = 0;
+
+    for(int i = 0; i < packet->na && count <= 2; ++i)
+    {
+        const uint16_t item_seq = packet->base + i * packet->offset;
+        if(!rtp_get(mod->rtp, item_seq))
+        {
+            if(count < 2)
+                missing[count] = item_seq;
+            ++count;
+        }
+    }
+
+    if(count == 1)
+        return fec_restore(mod, packet, missing[0]);
+
+    if(count == 2 && depth > 0)
+    {
+        for(int i = 0; i < 2; ++i)
+        {
+            if(fec_recover_seq(mod, missing[i], depth - 1))
+                return fec_restore(mod, packet, missing[1 - i]);
+        }
+    }
+
+    return false;
+}
+
+static bool fec_recover_seq(module_data_t *mod, uint16_t seq, int depth)
+{
+    for(int i = 0; i < FEC_SLOTS; ++i)
+    {
+        const fec_packet_t *packet = &mod->fec->packet[i];
+        if(!packet->is_set)
+            continue;
+
+        const uint16_t diff = seq - packet->base;
+        if(diff % packet->offset != 0 || diff / packet->offset >= packet->na)
+            continue;
+
+        if(fec_recover(mod, packet, depth) && rtp_get(mod->rtp, seq))
+            return true;
+    }
+
+    return false;
+}
+
+/* delivery */
+
+/* check if the first datagram next to the gap is out of the jitter buffer */
+static bool rtp_is_gap_expired(udp_rtp_t *rtp, uint64_t now)
+{
+    for(uint16_t seq = rtp->next_seq + 1; seq != (uint16_t)(rtp->head_seq + 1); ++seq)
+    {
+        const rtp_packet_t *packet = rtp_get(rtp, seq);
+        if(packet)
+            return (now - packet->time >= rtp->jitter);
+    }
+
+    return false;
+}
+
+/* force - number of the next datagrams to deliver without waiting */
+static void rtp_flush(module_data_t *mod, int force)
+{
+    udp_rtp_t *rtp = mod->rtp;
+    const uint64_t now = asc_utime_now();
+
+    for(; rtp->is_seq; --force)
+    {
+        const bool is_force = (force > 0);
+        const rtp_packet_t *packet = rtp_get(rtp, rtp->next_seq);
+        if(!packet)
+        {
+            const int16_t ahead = rtp->head_seq - rtp->next_seq;
+            if(ahead <= 0)
+                break;
+
+            if(!is_force && ahead < rtp->delay
+               && !(rtp->jitter && rtp_is_gap_expired(rtp, now)))
+            {
+                break;
+            }
+
+            if(!mod->fec || !fec_recover_seq(mod, rtp->next_seq, 1))
+            {
+                if(mod->fec)
+                    ++mod->fec->lost;
+                ++rtp->next_seq;
+                continue;
+            }
+            packet = rtp_get(rtp, rtp->next_seq);
+        }
+        else if(!is_force && rtp->jitter && now - packet->time < rtp->jitter)
+            break;
+
+        const size_t count = (packet->size - packet->skip) / TS_PACKET_SIZE;
+        if(count > 0)
+            module_stream_send_batch(mod, &packet->payload[packet->skip], count);
+
+        ++rtp->next_seq;
+    }
+}
+
+/* buffer is full. deliver datagrams before seq ahead of time */
+static void rtp_overrun(module_data_t *mod, uint16_t seq)
+{
+    udp_rtp_t *rtp = mod->rtp;
+
+    if(!mod->rtp_overrun)
+    {
+        asc_log_warning(MSG("%s:%d buffer overrun. datagrams are delivered ahead of time")
+                        , mod->addr, mod->port);
+    }
+    mod->rtp_overrun += (int16_t)(seq - rtp->next_seq);
+
+    rtp_flush(mod, (int16_t)(seq - rtp->next_seq));
+    if((int16_t)(seq - rtp->next_seq) > 0)
+        rtp->next_seq = seq;
+}
+
+/* storage slots for the next receive keep datagrams waiting for delivery */
+static void rtp_check_overrun(module_data_t *mod, size_t pos, size_t count)
+{
+    udp_rtp_t *rtp = mod->rtp;
+
+    int force = 0;
+    for(size_t i = pos; i < pos + count; ++i)
+    {
+        const int seq = rtp->storage_seq[i];
+        if(seq < 0 || !rtp_get(rtp, seq))
+            continue;
+
+        const int16_t ahead = seq - rtp->next_seq;
+        if(ahead >= force)
+            force = ahead + 1;
+    }
+
+    if(force > 0)
+        rtp_overrun(mod, rtp->next_seq + force);
+}
+
+static void on_timer_jitter(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+    rtp_flush(mod, 0);
+}
+
+static void on_read_rtp(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+    udp_rtp_t *rtp = mod->rtp;
+
+    const size_t pos = rtp->storage_pos;
+    const size_t batch = (size_t)mod->batch;
+    const size_t count = (rtp->window - pos < batch) ? (rtp->window - pos) : batch;
+    uint8_t *const block = &rtp->storage[pos * UDP_BUFFER_SIZE];
+
+    rtp_check_overrun(mod, pos, count);
+
+    const ssize_t ret = asc_socket_recv_batch(mod->sock, block, UDP_BUFFER_SIZE
+                                              , count, mod->buffer_len);
+    if(ret <= 0)
+    {
+        if(ret == -1)
+            on_close(arg);
+        return;
+    }
+
+    ++mod->wakeups;
+    mod->datagrams += ret;
+
+    for(ssize_t i = 0; i < ret; ++i)
+        rtp_push(mod, pos + i, &block[i * UDP_BUFFER_SIZE], mod->buffer_len[i]);
+
+    rtp->storage_pos = (pos + ret) & (rtp->window - 1);
+    rtp_flush(mod, 0);
+}
+
+static void on_read_fec(module_data_t *mod, asc_socket_t *sock)
+{
+    udp_fec_t *fec = mod->fec;
+
+    fec_packet_t *const packet = &fec->packet[fec->pos];
+    uint8_t *const buffer = &fec->storage[fec->pos * UDP_BUFFER_SIZE];
+    packet->is_set = false;
+
+    size_t len = 0;
+    if(asc_socket_recv_batch(sock, buffer, UDP_BUFFER_SIZE, 1, &len) != 1)
+        return;
+
+    const int skip = rtp_header_size(buffer, len);
+    if(skip < 0 || len <= (size_t)skip + FEC_HEADER_SIZE)
+        return;
+
+    const uint8_t *const header = &buffer[skip];
+    const bool is_row = (header[12] & 0x40) != 0;
+    packet->base = (header[0] << 8) | header[1];
+    packet->length_recovery = (header[2] << 8) | header[3];
+    packet->offset = header[13];
+    packet->na = header[14];
+    if(packet->offset == 0 || packet->na == 0
+       || packet->offset * (packet->na - 1) >= (int)mod->rtp->window / 2)
+    {
+        return;
+    }
+    packet->payload = &header[FEC_HEADER_SIZE];
+    packet->size = len - skip - FEC_HEADER_SIZE;
+    packet->is_set = true;
+
+    ++fec->packets;
+    fec->pos = (fec->pos + 1) % FEC_SLOTS;
+
+    if(!is_row && !fec->columns)
+        fec_set_matrix(mod, packet->offset, packet->na);
+
+    if(mod->rtp->is_seq)
+    {
+        fec_recover(mod, packet, 0);
+        rtp_flush(mod, 0);
+    }
+}
+
+static void on_read_fec_column(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+    on_read_fec(mod, mod->fec_sock[0]);
+}
+
+static void on_read_fec_row(void *arg)
+{
+    module_data_t *mod = (module_data_t *)arg;
+    on_read_fec(mod, mod->fec_sock[1]);
 }
 
 void on_read(void *arg)
 {
     module_data_t *mod = (module_data_t *)arg;
 
-    ssize_t len = asc_socket_recv(mod->sock, mod->buffer, UDP_BUFFER_SIZE);
-    if(len <= 0)
+    if(asc_buffer_is_shared(mod->block))
     {
-        on_close(arg);
+        asc_buffer_unref(mod->block);
+        mod->block = asc_buffer_alloc(mod->pool);
+    }
+    uint8_t *const block = asc_buffer_data(mod->block);
+
+    const ssize_t ret = asc_socket_recv_batch(mod->sock, block, UDP_BUFFER_SIZE
+                                              , mod->batch, mod->buffer_len);
+    if(ret <= 0)
+    {
+        if(ret == -1)
+            on_close(arg);
         return;
     }
 
-    // 12 - RTP header size
-    ssize_t i = (mod->is_rtp) ? 12 : 0;
-    for(; i < len; i += TS_PACKET_SIZE)
-        module_stream_send(mod, &mod->buffer[i]);
-    if (i != len)
-        asc_log_warning(MSG("Lost bytes: %d, because UDP packet size is wrong"), len - i);
+    ++mod->wakeups;
+    mod->datagrams += ret;
+
+    for(ssize_t i = 0; i < ret; ++i)
+    {
+        const uint8_t *buffer = &block[i * UDP_BUFFER_SIZE];
+        size_t len = mod->buffer_len[i];
+        size_t skip = 0;
+
+        if(mod->is_rtp)
+        {
+            const int header_size = rtp_header_size(buffer, len);
+            if(header_size < 0)
+                continue;
+            skip = header_size;
+
+            // padding
+            if((buffer[0] & 0x20) && buffer[len - 1] <= len - skip)
+                len -= buffer[len - 1];
+
+            rtp_check_seq(mod, (buffer[2] << 8) | buffer[3], true);
+        }
+
+        const size_t count = (len - skip) / TS_PACKET_SIZE;
+        if(count > 0)
+            module_stream_send_buffer(mod, mod->block, &buffer[skip], count);
+
+        const size_t lost = len - skip - count * TS_PACKET_SIZE;
+        if(lost != 0)
+            asc_log_warning(MSG("Lost bytes: %d, because UDP packet size is wrong"), (int)lost);
+    }
 }
 
 void timer_renew_callback(void *arg)
@@ -94,56 +729,286 @@ void timer_renew_callback(void *arg)
     asc_socket_multicast_renew(mod->sock);
 }
 
+static void udp_input_open(void *arg)
+{
+    module_data_t *mod = arg;
+
+    mod->sock = asc_socket_open_udp4(mod);
+    asc_socket_set_reuseaddr(mod->sock, 1);
+#ifdef _WIN32
+    if(!asc_socket_bind(mod->sock, NULL, mod->port))
+#else
+    if(!asc_socket_bind(mod->sock, mod->addr, mod->port))
+#endif
+        return;
+
+    if(mod->socket_size > 0)
+        asc_socket_set_buffer(mod->sock, mod->socket_size, 0);
+
+    asc_socket_set_on_read(mod->sock, (mod->rtp) ? on_read_rtp : on_read);
+    asc_socket_set_on_close(mod->sock, on_close);
+
+    asc_socket_multicast_join(mod->sock, mod->addr, mod->localaddr);
+
+    if(mod->fec)
+    {
+        // column FEC on port+2, row FEC on port+4
+        static const socket_callback_t on_read_list[2] = { on_read_fec_column, on_read_fec_row };
+        for(int i = 0; i < 2; ++i)
+        {
+            asc_socket_t *sock = asc_socket_open_udp4(mod);
+            asc_socket_set_reuseaddr(sock, 1);
+#ifdef _WIN32
+            if(!asc_socket_bind(sock, NULL, mod->port + 2 * (i + 1)))
+#else
+            if(!asc_socket_bind(sock, mod->addr, mod->port + 2 * (i + 1)))
+#endif
+            {
+                asc_socket_close(sock);
+                continue;
+            }
+
+            if(mod->socket_size > 0)
+                asc_socket_set_buffer(sock, mod->socket_size, 0);
+
+            asc_socket_set_on_read(sock, on_read_list[i]);
+            asc_socket_multicast_join(sock, mod->addr, mod->localaddr);
+            mod->fec_sock[i] = sock;
+        }
+    }
+
+    if(mod->renew > 0)
+        mod->timer_renew = asc_timer_init(mod->renew * 1000, timer_renew_callback, mod);
+
+    if(mod->rtp && mod->rtp->jitter)
+        mod->timer_jitter = asc_timer_init(RTP_JITTER_INTERVAL, on_timer_jitter, mod);
+}
+
+typedef struct
+{
+    module_data_t *mod;
+
+    uint64_t wakeups;
+    uint64_t datagrams;
+    uint64_t rtp_lost;
+    uint64_t rtp_reordered;
+    uint64_t rtp_duplicate;
+    uint64_t rtp_overrun;
+    uint64_t fec_packets;
+    uint64_t fec_recovered;
+    uint64_t fec_lost;
+} udp_input_stat_t;
+
+/* counters are updated in the reactor thread */
+static void status_snapshot(void *arg)
+{
+    udp_input_stat_t *stat = arg;
+    module_data_t *mod = stat->mod;
+
+    stat->wakeups = mod->wakeups;
+    stat->datagrams = mod->datagrams;
+    stat->rtp_lost = mod->rtp_lost;
+    stat->rtp_reordered = mod->rtp_reordered;
+    stat->rtp_duplicate = mod->rtp_duplicate;
+    stat->rtp_overrun = mod->rtp_overrun;
+    if(mod->fec)
+    {
+        stat->fec_packets = mod->fec->packets;
+        stat->fec_recovered = mod->fec->recovered;
+        stat->fec_lost = mod->fec->lost;
+    }
+}
+
+static int method_status(module_data_t *mod)
+{
+    udp_input_stat_t stat = { .mod = mod };
+    asc_reactor_call_wait(mod->__stream.reactor, status_snapshot, &stat);
+
+    lua_newtable(lua);
+
+    lua_pushnumber(lua, stat.wakeups);
+    lua_setfield(lua, -2, "wakeups");
+    lua_pushnumber(lua, stat.datagrams);
+    lua_setfield(lua, -2, "datagrams");
+    lua_pushnumber(lua, (stat.wakeups) ? ((double)stat.datagrams / stat.wakeups) : 0);
+    lua_setfield(lua, -2, "batch");
+
+    if(mod->is_rtp)
+    {
+        lua_pushnumber(lua, stat.rtp_lost);
+        lua_setfield(lua, -2, "rtp_lost");
+        lua_pushnumber(lua, stat.rtp_reordered);
+        lua_setfield(lua, -2, "rtp_reordered");
+        lua_pushnumber(lua, stat.rtp_duplicate);
+        lua_setfield(lua, -2, "rtp_duplicate");
+        lua_pushnumber(lua, stat.rtp_overrun);
+        lua_setfield(lua, -2, "rtp_overrun");
+    }
+
+    if(mod->fec)
+    {
+        lua_pushnumber(lua, stat.fec_packets);
+        lua_setfield(lua, -2, "fec_packets");
+        lua_pushnumber(lua, stat.fec_recovered);
+        lua_setfield(lua, -2, "fec_recovered");
+        lua_pushnumber(lua, stat.fec_lost);
+        lua_setfield(lua, -2, "fec_lost");
+    }
+
+    return 1;
+}
+
 static void module_init(module_data_t *mod)
 {
     module_stream_init(mod, NULL);
 
-    const char *addr = NULL;
-    module_option_string("addr", &addr);
-    if(!addr)
+    module_option_string("addr", &mod->addr);
+    if(!mod->addr)
     {
         asc_log_error("[udp_input] option 'addr' is required");
         astra_abort();
     }
 
-    int port = 1234;
-    module_option_number("port", &port);
+    mod->port = 1234;
+    module_option_number("port", &mod->port);
 
-    mod->sock = asc_socket_open_udp4(mod);
-    asc_socket_set_reuseaddr(mod->sock, 1);
-#ifdef _WIN32
-    if(!asc_socket_bind(mod->sock, NULL, port))
-#else
-    if(!asc_socket_bind(mod->sock, addr, port))
-#endif
-        return;
+    module_option_string("localaddr", &mod->localaddr);
+    module_option_number("socket_size", &mod->socket_size);
+    module_option_number("renew", &mod->renew);
+    module_option_number("rtp", &mod->is_rtp);
 
-    int value;
-    if(module_option_number("socket_size", &value))
-        asc_socket_set_buffer(mod->sock, value, 0);
+    mod->batch = UDP_BATCH_SIZE;
+    module_option_number("batch", &mod->batch);
+    if(mod->batch < 1 || mod->batch > UDP_BATCH_MAX)
+    {
+        asc_log_error(MSG("option 'batch' must be in range 1-%d"), UDP_BATCH_MAX);
+        astra_abort();
+    }
+    mod->buffer_len = calloc(mod->batch, sizeof(size_t));
 
-    asc_socket_set_on_read(mod->sock, on_read);
-    asc_socket_set_on_close(mod->sock, on_close);
+    int fec = 0, columns = 0, rows = 0, jitter = 0, bitrate = RTP_JITTER_BITRATE;
+    module_option_number("fec", &fec);
+    module_option_number("reorder", &mod->reorder);
+    module_option_number("jitter", &jitter);
+    module_option_number("bitrate", &bitrate);
+    if(fec)
+    {
+        module_option_number("fec_columns", &columns);
+        module_option_number("fec_rows", &rows);
+        if(columns < 0 || rows < 0 || (columns > 0) != (rows > 0)
+           || columns * rows > FEC_MATRIX_MAX)
+        {
+            asc_log_error(MSG("options 'fec_columns' and 'fec_rows' are required together "
+                              "and the matrix size should be not more than %d packets")
+                          , FEC_MATRIX_MAX);
+            astra_abort();
+        }
+    }
+    if(mod->reorder < 0 || mod->reorder > RTP_WINDOW / 2)
+    {
+        asc_log_error(MSG("option 'reorder' must be in range 0-%d"), RTP_WINDOW / 2);
+        astra_abort();
+    }
+    if(jitter < 0 || jitter > RTP_JITTER_MAX)
+    {
+        asc_log_error(MSG("option 'jitter' must be in range 0-%d"), RTP_JITTER_MAX);
+        astra_abort();
+    }
+
+    // jitter buffer keeps the stream for the jitter time and the reorder delay
+    size_t window = RTP_WINDOW_JITTER;
+    if(jitter > 0)
+    {
+        if(bitrate <= 0)
+        {
+            asc_log_error(MSG("option 'bitrate' must be greater than 0"));
+            astra_abort();
+        }
 
-    const char *localaddr = NULL;
-    module_option_string("localaddr", &localaddr);
-    asc_socket_multicast_join(mod->sock, addr, localaddr);
+        // datagrams of 7 TS packets
+        const uint64_t rate = (uint64_t)bitrate * 1000000 / (8 * 7 * TS_PACKET_SIZE);
+        const uint64_t need = rate * jitter / 1000 + RTP_WINDOW_JITTER / 2;
+        while(window < need && window < RTP_WINDOW_MAX)
+            window *= 2;
 
-    if(module_option_number("renew", &value))
-        mod->timer_renew = asc_timer_init(value * 1000, timer_renew_callback, mod);
+        if(window < need)
+        {
+            asc_log_error(MSG("jitter buffer is limited to %d datagrams. "
+                              "reduce option 'jitter' or 'bitrate'"), RTP_WINDOW_MAX);
+            astra_abort();
+        }
+    }
+
+    if(fec || mod->reorder > 0 || jitter > 0)
+    {
+        mod->is_rtp = 1;
+
+        udp_rtp_t *rtp = calloc(1, sizeof(udp_rtp_t));
+        rtp->window = (jitter > 0) ? window : RTP_WINDOW;
+        rtp->delay = (mod->reorder > 0) ? mod->reorder : (int)rtp->window / 2;
+        rtp->jitter = jitter * 1000;
+        rtp->storage_seq = malloc(rtp->window * sizeof(int));
+        for(size_t i = 0; i < rtp->window; ++i)
+            rtp->storage_seq[i] = -1;
+        rtp->storage = malloc(rtp->window * UDP_BUFFER_SIZE);
+        rtp->packet = calloc(rtp->window, sizeof(rtp_packet_t));
+        mod->rtp = rtp;
+
+        if(fec)
+        {
+            mod->fec = calloc(1, sizeof(udp_fec_t));
+            mod->fec->recovery = malloc(rtp->window * UDP_BUFFER_SIZE);
+            if(columns > 0)
+                fec_set_matrix(mod, columns, rows);
+            else if(rtp->delay < FEC_DEFAULT_DELAY)
+                rtp->delay = FEC_DEFAULT_DELAY;
+        }
+    }
+    else
+    {
+        mod->pool = asc_buffer_pool_init(mod->batch * UDP_BUFFER_SIZE, UDP_POOL_CACHE);
+        mod->block = asc_buffer_alloc(mod->pool);
+    }
+
+    int reactor = 0;
+    if(module_option_number("reactor", &reactor) && reactor > 0)
+        module_stream_reactor_set(mod, asc_reactor_get(reactor));
+
+    asc_reactor_call_wait(mod->__stream.reactor, udp_input_open, mod);
 }
 
 static void module_destroy(module_data_t *mod)
 {
     module_stream_destroy(mod);
 
-    on_close(mod);
+    asc_reactor_call_wait(mod->__stream.reactor, on_close, mod);
+
+    if(mod->pool)
+    {
+        asc_buffer_unref(mod->block);
+        asc_buffer_pool_destroy(mod->pool);
+    }
+    free(mod->buffer_len);
+
+    if(mod->rtp)
+    {
+        free(mod->rtp->storage_seq);
+        free(mod->rtp->storage);
+        free(mod->rtp->packet);
+        free(mod->rtp);
+    }
+    if(mod->fec)
+    {
+        free(mod->fec->recovery);
+        free(mod->fec);
+    }
 }
 
 MODULE_STREAM_METHODS()
 
 MODULE_LUA_METHODS()
 {
-    MODULE_STREAM_METHODS_REF()
+    MODULE_STREAM_METHODS_REF(),
+    { "status", method_status }
 };
 MODULE_LUA_REGISTER(udp_input)
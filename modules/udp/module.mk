@@ -1,2 +1,2 @@
-SOURCES="input.c output.c"
+SOURCES="fec.c input.c output.c"
 MODULES="udp_input udp_output"
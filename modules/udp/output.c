@@ -32,15 +32,28 @@
  *      rtp         - boolean, use RTP instad RAW UDP
  *      sync        - number, if greater then 0, then use MPEG-TS syncing.
  *                            average value of the stream bitrate in megabit per second
+ *      fec_columns - number, SMPTE 2022-1 FEC matrix size (L), 1-20. implies rtp.
+ *                    column FEC is sent to port+2
+ *      fec_rows    - number, FEC matrix size (D), 1-20. L*D should be not more than 100
+ *      fec_row     - boolean, send row FEC to port+4. default: true
+ *      fec_drop    - number, test option: drop each N-th datagram after it is
+ *                    protected by FEC, to check the recovery on the receiver
  */
 
 #include <astra.h>
+#include "fec.h"
 
 #define MSG(_msg) "[udp_output %s:%d] " _msg, mod->addr, mod->port
 
 #define UDP_BUFFER_SIZE 1460
 #define UDP_BUFFER_CAPACITY ((UDP_BUFFER_SIZE / TS_PACKET_SIZE) * TS_PACKET_SIZE)
 
+/* datagrams are queued and sent once per loop iteration (see queue_flush_all) */
+#define UDP_QUEUE_SIZE 64
+
+#define RTP_PT_FEC 96
+#define FEC_PACKET_SIZE (RTP_HEADER_SIZE + FEC_HEADER_SIZE + UDP_BUFFER_CAPACITY)
+
 struct module_data_t
 {
     MODULE_LUA_DATA();
@@ -54,33 +67,218 @@ struct module_data_t
 
     asc_socket_t *sock;
 
+    uint8_t rtp_header[RTP_HEADER_SIZE];
+
     uint32_t buffer_skip;
-    uint8_t buffer[UDP_BUFFER_SIZE];
+
+    struct
+    {
+        int columns;
+        int rows;
+        int index; // datagram position in the matrix
+        uint16_t base; // sequence number of the first datagram in the matrix
+
+        // payloads of the media datagrams are XORed directly into the FEC packets
+        asc_socket_t *sock[2]; // column, row
+        uint16_t seq[2];
+        uint8_t *column;
+        uint8_t *row;
+
+        int drop;
+        int drop_index;
+    } fec;
+
+    struct
+    {
+        // copied datagrams. others refer to the upstream buffers
+        uint8_t *buffer;
+        size_t size;
+        struct iovec iov[UDP_QUEUE_SIZE];
+        asc_buffer_t *ref[UDP_QUEUE_SIZE];
+        size_t count;
+        size_t count_max;
+
+        bool is_pending;
+        module_data_t *next;
+    } queue;
 
 #ifndef _WIN32
     struct
     {
         asc_thread_t *thread;
 
-        uint8_t *buffer;
-        uint32_t buffer_size;
-        uint32_t buffer_count;
-        uint32_t buffer_read;
-        uint32_t buffer_write;
+        asc_ring_t *ring;
         uint32_t buffer_overflow;
     } sync;
     uint64_t pcr;
 #endif
 };
 
+/* outputs with queued datagrams. each event loop thread has own list */
+static __thread module_data_t *queue_pending = NULL;
+
+static void queue_flush(module_data_t *mod)
+{
+    const ssize_t ret = asc_socket_sendto_batch(mod->sock, mod->queue.iov, mod->queue.count);
+    if(ret == -1)
+        asc_log_warning(MSG("error on send [%s]"), asc_socket_error());
+    else if(ret != (ssize_t)mod->queue.count)
+        asc_log_warning(MSG("sent %d of %d datagrams"), (int)ret, (int)mod->queue.count);
+
+    for(size_t i = 0; i < mod->queue.count; ++i)
+    {
+        if(mod->queue.ref[i])
+        {
+            asc_buffer_unref(mod->queue.ref[i]);
+            mod->queue.ref[i] = NULL;
+        }
+    }
+
+    // keep the datagram in progress
+    if(mod->buffer_skip > 0)
+        memmove(mod->queue.buffer, &mod->queue.buffer[mod->queue.size], mod->buffer_skip);
+
+    mod->queue.size = 0;
+    mod->queue.count = 0;
+}
+
+static void queue_flush_all(void *arg)
+{
+    __uarg(arg);
+
+    while(queue_pending)
+    {
+        module_data_t *mod = queue_pending;
+        queue_pending = mod->queue.next;
+
+        mod->queue.next = NULL;
+        mod->queue.is_pending = false;
+        if(mod->queue.count > 0)
+            queue_flush(mod);
+    }
+}
+
+static void queue_remove(module_data_t *mod)
+{
+    module_data_t **i = &queue_pending;
+    while(*i && *i != mod)
+        i = &(*i)->queue.next;
+    if(*i)
+        *i = mod->queue.next;
+
+    mod->queue.next = NULL;
+    mod->queue.is_pending = false;
+}
+
+static void queue_push(module_data_t *mod, const uint8_t *data, size_t size)
+{
+    mod->queue.iov[mod->queue.count].iov_base = (void *)data;
+    mod->queue.iov[mod->queue.count].iov_len = size;
+    ++mod->queue.count;
+
+    if(mod->queue.count >= mod->queue.count_max)
+    {
+        queue_flush(mod);
+        return;
+    }
+
+    if(!mod->queue.is_pending)
+    {
+        if(!queue_pending)
+            asc_event_flush_attach(queue_flush_all, NULL);
+
+        mod->queue.is_pending = true;
+        mod->queue.next = queue_pending;
+        queue_pending = mod;
+    }
+}
+
+/* protect RTP datagram with the FEC packet. length, PT and timestamp are recovered too */
+static void fec_add(uint8_t *packet, const uint8_t *buffer, size_t size, bool is_first)
+{
+    uint8_t *const header = &packet[RTP_HEADER_SIZE];
+    uint8_t *const payload = &header[FEC_HEADER_SIZE];
+    const uint8_t *const data = &buffer[RTP_HEADER_SIZE];
+    size -= RTP_HEADER_SIZE;
+
+    if(is_first)
+    {
+        memset(header, 0, FEC_HEADER_SIZE);
+        memcpy(payload, data, size);
+        if(size < UDP_BUFFER_CAPACITY)
+            memset(&payload[size], 0, UDP_BUFFER_CAPACITY - size);
+    }
+    else
+        fec_xor(payload, data, size);
+
+    header[2] ^= (size >> 8) & 0xFF;
+    header[3] ^= (size     ) & 0xFF;
+    header[4] ^= buffer[1] & 0x7F;
+    header[8] ^= buffer[4];
+    header[9] ^= buffer[5];
+    header[10] ^= buffer[6];
+    header[11] ^= buffer[7];
+}
+
+static void fec_send(module_data_t *mod, int is_row, uint8_t *packet
+                     , uint16_t base, uint8_t offset, uint8_t na)
+{
+    const uint16_t seq = mod->fec.seq[is_row]++;
+
+    memset(packet, 0, RTP_HEADER_SIZE);
+    packet[0] = 0x80; // RTP version
+    packet[1] = RTP_PT_FEC;
+    packet[2] = (seq >> 8) & 0xFF;
+    packet[3] = (seq     ) & 0xFF;
+
+    uint8_t *const header = &packet[RTP_HEADER_SIZE];
+    header[0] = (base >> 8) & 0xFF;
+    header[1] = (base     ) & 0xFF;
+    header[4] |= 0x80; // E
+    header[12] = (is_row) ? 0x40 : 0x00; // D, type: XOR
+    header[13] = offset;
+    header[14] = na;
+
+    if(asc_socket_sendto(mod->fec.sock[is_row], packet, FEC_PACKET_SIZE) != FEC_PACKET_SIZE)
+        asc_log_warning(MSG("error on send FEC [%s]"), asc_socket_error());
+}
+
+static void fec_push(module_data_t *mod, const uint8_t *buffer, size_t size)
+{
+    const int column = mod->fec.index % mod->fec.columns;
+    const int row = mod->fec.index / mod->fec.columns;
+
+    if(mod->fec.index == 0)
+        mod->fec.base = (buffer[2] << 8) | buffer[3];
+
+    uint8_t *const packet = &mod->fec.column[column * FEC_PACKET_SIZE];
+    fec_add(packet, buffer, size, row == 0);
+    if(row == mod->fec.rows - 1)
+        fec_send(mod, 0, packet, mod->fec.base + column, mod->fec.columns, mod->fec.rows);
+
+    if(mod->fec.row)
+    {
+        fec_add(mod->fec.row, buffer, size, column == 0);
+        if(column == mod->fec.columns - 1)
+        {
+            fec_send(mod, 1, mod->fec.row, mod->fec.base + row * mod->fec.columns
+                     , 1, mod->fec.columns);
+        }
+    }
+
+    if(++mod->fec.index == mod->fec.columns * mod->fec.rows)
+        mod->fec.index = 0;
+}
+
 static void on_ts(module_data_t *mod, const uint8_t *ts)
 {
+    uint8_t *buffer = &mod->queue.buffer[mod->queue.size];
+
     if(mod->is_rtp && mod->buffer_skip == 0)
     {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        const uint64_t msec = ((tv.tv_sec % 1000000) * 1000) + (tv.tv_usec / 1000);
-        uint8_t *buffer = mod->buffer;
+        const uint64_t msec = asc_utime_now() / 1000;
+
+        memcpy(buffer, mod->rtp_header, sizeof(mod->rtp_header));
 
         buffer[2] = (mod->rtpseq >> 8) & 0xFF;
         buffer[3] = (mod->rtpseq     ) & 0xFF;
@@ -92,25 +290,56 @@ static void on_ts(module_data_t *mod, const uint8_t *ts)
 
         ++mod->rtpseq;
 
-        mod->buffer_skip += 12;
+        mod->buffer_skip += RTP_HEADER_SIZE;
     }
 
-    memcpy(&mod->buffer[mod->buffer_skip], ts, TS_PACKET_SIZE);
+    memcpy(&buffer[mod->buffer_skip], ts, TS_PACKET_SIZE);
     mod->buffer_skip += TS_PACKET_SIZE;
 
     if(mod->buffer_skip >= UDP_BUFFER_CAPACITY)
     {
-        if(asc_socket_sendto(mod->sock, &mod->buffer, mod->buffer_skip) == -1)
-            asc_log_warning(MSG("error on send [%s]"), asc_socket_error());
+        const size_t size = mod->buffer_skip;
         mod->buffer_skip = 0;
+        if(mod->fec.columns > 0)
+        {
+            fec_push(mod, buffer, size);
+            if(mod->fec.drop > 0 && ++mod->fec.drop_index == mod->fec.drop)
+            {
+                mod->fec.drop_index = 0;
+                return;
+            }
+        }
+        mod->queue.size += size;
+        queue_push(mod, buffer, size);
     }
 }
 
+/* full datagrams are queued by reference to the upstream buffer */
+static void on_ts_buffer(module_data_t *mod, asc_buffer_t *buffer
+                         , const uint8_t *ts, size_t count)
+{
+    static const size_t datagram_count = UDP_BUFFER_CAPACITY / TS_PACKET_SIZE;
+
+    if(buffer && !mod->is_rtp)
+    {
+        while(mod->buffer_skip == 0 && count >= datagram_count)
+        {
+            mod->queue.ref[mod->queue.count] = asc_buffer_ref(buffer);
+            queue_push(mod, ts, UDP_BUFFER_CAPACITY);
+            ts += UDP_BUFFER_CAPACITY;
+            count -= datagram_count;
+        }
+    }
+
+    for(; count > 0; --count, ts += TS_PACKET_SIZE)
+        on_ts(mod, ts);
+}
+
 #ifndef _WIN32
 
 static void sync_queue_push(module_data_t *mod, const uint8_t *ts)
 {
-    if(mod->sync.buffer_count >= mod->sync.buffer_size)
+    if(!asc_ring_push(mod->sync.ring, ts, 1))
     {
         ++mod->sync.buffer_overflow;
         return;
@@ -121,24 +350,12 @@ static void sync_queue_push(module_data_t *mod, const uint8_t *ts)
         asc_log_error(MSG("sync buffer overflow. dropped %d packets"), mod->sync.buffer_overflow);
         mod->sync.buffer_overflow = 0;
     }
-
-    memcpy(&mod->sync.buffer[mod->sync.buffer_write], ts, TS_PACKET_SIZE);
-    mod->sync.buffer_write += TS_PACKET_SIZE;
-    if(mod->sync.buffer_write >= mod->sync.buffer_size)
-        mod->sync.buffer_write = 0;
-
-    __sync_fetch_and_add(&mod->sync.buffer_count, TS_PACKET_SIZE);
 }
 
 static void sync_queue_pop(module_data_t *mod)
 {
-    on_ts(mod, &mod->sync.buffer[mod->sync.buffer_read]);
-
-    mod->sync.buffer_read += TS_PACKET_SIZE;
-    if(mod->sync.buffer_read >= mod->sync.buffer_size)
-        mod->sync.buffer_read = 0;
-
-    __sync_fetch_and_sub(&mod->sync.buffer_count, TS_PACKET_SIZE);
+    on_ts(mod, asc_ring_item(mod->sync.ring, 0));
+    asc_ring_release(mod->sync.ring, 1);
 }
 
 static inline int check_pcr(const uint8_t *ts)
@@ -162,14 +379,10 @@ static inline uint64_t calc_pcr(const uint8_t *ts)
 
 static int seek_pcr(module_data_t *mod, uint32_t *block_size)
 {
-    uint32_t count;
-    for(count = TS_PACKET_SIZE; count < mod->sync.buffer_count; count += TS_PACKET_SIZE)
+    const uint32_t total = asc_ring_count(mod->sync.ring);
+    for(uint32_t count = 1; count < total; ++count)
     {
-        uint32_t pos = mod->sync.buffer_read + count;
-        if(pos > mod->sync.buffer_size)
-            pos -= mod->sync.buffer_size;
-
-        if(check_pcr(&mod->sync.buffer[pos]))
+        if(check_pcr(asc_ring_item(mod->sync.ring, count)))
         {
             *block_size = count;
             return 1;
@@ -179,27 +392,16 @@ static int seek_pcr(module_data_t *mod, uint32_t *block_size)
     return 0;
 }
 
-static double timeval_diff(struct timeval *start, struct timeval *end)
-{
-    const int64_t s_us = start->tv_sec * 1000000 + start->tv_usec;
-    const int64_t e_us = end->tv_sec * 1000000 + end->tv_usec;
-    return (double)(e_us - s_us) / 1000.0; // ms
-}
-
 static void thread_loop(void *arg)
 {
     module_data_t *mod = arg;
 
-    // block sync
-    struct timeval time_sync[4];
-    struct timeval *time_sync_b = &time_sync[0]; // begin
-    struct timeval *time_sync_e = &time_sync[1]; // end
-    struct timeval *time_sync_bb = &time_sync[2];
-    struct timeval *time_sync_be = &time_sync[3];
+    // block sync. pacing needs the precise time
+    int64_t time_sync_b = 0; // begin
+    int64_t time_sync_bb = 0; // block begin
 
     double block_time_total, total_sync_diff;
-    uint32_t pos;
-    uint32_t block_size = 0;
+    uint32_t block_size = 0; // packets
 
     struct timespec ts_sync = { .tv_sec = 0, .tv_nsec = 0 };
     static const struct timespec ts = { .tv_sec = 0, .tv_nsec = 100000 };
@@ -209,9 +411,9 @@ static void thread_loop(void *arg)
         asc_log_info(MSG("buffering..."));
 
         // flush
-        mod->sync.buffer_count = 0;
+        asc_ring_flush(mod->sync.ring);
 
-        while(mod->sync.buffer_count < (mod->sync.buffer_size / 2))
+        while(asc_ring_count(mod->sync.ring) < (asc_ring_size(mod->sync.ring) / 2))
         {
             nanosleep(&ts, NULL);
             continue;
@@ -222,13 +424,10 @@ static void thread_loop(void *arg)
             asc_log_error(MSG("first PCR is not found"));
             continue;
         }
-        pos = mod->sync.buffer_read + block_size;
-        if(pos > mod->sync.buffer_size)
-            pos -= mod->sync.buffer_size;
-        mod->pcr = calc_pcr(&mod->sync.buffer[pos]);
-        mod->sync.buffer_read = pos;
+        asc_ring_release(mod->sync.ring, block_size);
+        mod->pcr = calc_pcr(asc_ring_item(mod->sync.ring, 0));
 
-        gettimeofday(time_sync_b, NULL);
+        time_sync_b = asc_utime();
         block_time_total = 0;
         total_sync_diff = 0.0;
 
@@ -239,12 +438,8 @@ static void thread_loop(void *arg)
                 asc_log_error(MSG("sync failed. Next PCR is not found. reload buffer"));
                 break;
             }
-            pos = mod->sync.buffer_read + block_size;
-            if(pos > mod->sync.buffer_size)
-                pos -= mod->sync.buffer_size;
-
             // get PCR
-            const uint64_t pcr = calc_pcr(&mod->sync.buffer[pos]);
+            const uint64_t pcr = calc_pcr(asc_ring_item(mod->sync.ring, block_size));
             const uint64_t delta_pcr = pcr - mod->pcr;
             mod->pcr = pcr;
             // get block time
@@ -255,9 +450,9 @@ static void thread_loop(void *arg)
             if(block_time < 0 || block_time > 200)
             {
                 asc_log_error(MSG("block time out of range: %.2f"), block_time);
-                mod->sync.buffer_read = pos;
+                asc_ring_release(mod->sync.ring, block_size);
 
-                gettimeofday(time_sync_b, NULL);
+                time_sync_b = asc_utime();
                 block_time_total = 0.0;
                 total_sync_diff = 0.0;
                 continue;
@@ -266,8 +461,7 @@ static void thread_loop(void *arg)
 
             // calculate the sync time value
             if((block_time + total_sync_diff) > 0)
-                ts_sync.tv_nsec = ((block_time + total_sync_diff) * 1000000)
-                                / (block_size / TS_PACKET_SIZE);
+                ts_sync.tv_nsec = ((block_time + total_sync_diff) * 1000000) / block_size;
             else
                 ts_sync.tv_nsec = 0;
             // store the sync time value for later usage
@@ -277,29 +471,25 @@ static void thread_loop(void *arg)
                 printf("ts_sync_nsec: %ld\n", ts_sync_nsec);
 #endif
             long calc_block_time_ns = 0;
-            gettimeofday(time_sync_bb, NULL);
+            time_sync_bb = asc_utime();
 
             while(block_size > 0)
             {
                 sync_queue_pop(mod);
-                block_size -= TS_PACKET_SIZE;
+                --block_size;
                 if(ts_sync.tv_nsec > 0)
                     nanosleep(&ts_sync, NULL);
 
                 // block syncing
                 calc_block_time_ns += ts_sync_nsec;
-                gettimeofday(time_sync_be, NULL);
-                const long real_block_time_ns
-                    = ((time_sync_be->tv_sec * 1000000 + time_sync_be->tv_usec)
-                       - (time_sync_bb->tv_sec * 1000000 + time_sync_bb->tv_usec))
-                    * 1000;
+                const long real_block_time_ns = (asc_utime() - time_sync_bb) * 1000;
 
                 ts_sync.tv_nsec = (real_block_time_ns > calc_block_time_ns) ? 0 : ts_sync_nsec;
             }
 
             // stream syncing
-            gettimeofday(time_sync_e, NULL);
-            total_sync_diff = block_time_total - timeval_diff(time_sync_b, time_sync_e);
+            const double time_sync_diff = (asc_utime() - time_sync_b) / 1000.0; // ms
+            total_sync_diff = block_time_total - time_sync_diff;
 #if 0
             printf("syncing value: %.2f\n", total_sync_diff);
 #endif
@@ -309,7 +499,7 @@ static void thread_loop(void *arg)
                 asc_log_warning(MSG("wrong syncing time: %.2fms. reset time values")
                                 , total_sync_diff);
 
-                gettimeofday(time_sync_b, NULL);
+                time_sync_b = asc_utime();
                 block_time_total = 0.0;
                 total_sync_diff = 0.0;
             }
@@ -318,6 +508,32 @@ static void thread_loop(void *arg)
 }
 #endif
 
+static asc_socket_t * output_socket_open(module_data_t *mod, int port)
+{
+    asc_socket_t *sock = asc_socket_open_udp4(mod);
+    asc_socket_set_reuseaddr(sock, 1);
+    if(!asc_socket_bind(sock, NULL, 0))
+        astra_abort();
+
+    int value;
+    if(module_option_number("socket_size", &value))
+        asc_socket_set_buffer(sock, 0, value);
+
+    const char *localaddr = NULL;
+    module_option_string("localaddr", &localaddr);
+    if(localaddr)
+        asc_socket_set_multicast_if(sock, localaddr);
+
+    value = 32;
+    module_option_number("ttl", &value);
+    asc_socket_set_multicast_ttl(sock, value);
+
+    asc_socket_multicast_join(sock, mod->addr, NULL);
+    asc_socket_set_sockaddr(sock, mod->addr, port);
+
+    return sock;
+}
+
 static void module_init(module_data_t *mod)
 {
     module_option_string("addr", &mod->addr);
@@ -327,6 +543,35 @@ static void module_init(module_data_t *mod)
     module_option_number("port", &mod->port);
 
     module_option_number("rtp", &mod->is_rtp);
+
+    module_option_number("fec_columns", &mod->fec.columns);
+    module_option_number("fec_rows", &mod->fec.rows);
+    if(mod->fec.columns > 0 || mod->fec.rows > 0)
+    {
+        if(   mod->fec.columns < 1 || mod->fec.columns > 20
+           || mod->fec.rows < 1 || mod->fec.rows > 20
+           || mod->fec.columns * mod->fec.rows > FEC_MATRIX_MAX)
+        {
+            asc_log_error(MSG("wrong FEC matrix %dx%d"), mod->fec.columns, mod->fec.rows);
+            astra_abort();
+        }
+
+        mod->is_rtp = 1;
+
+        mod->fec.column = malloc(mod->fec.columns * FEC_PACKET_SIZE);
+        mod->fec.sock[0] = output_socket_open(mod, mod->port + 2);
+
+        int is_row = 1;
+        module_option_number("fec_row", &is_row);
+        if(is_row)
+        {
+            mod->fec.row = malloc(FEC_PACKET_SIZE);
+            mod->fec.sock[1] = output_socket_open(mod, mod->port + 4);
+        }
+
+        if(module_option_number("fec_drop", &mod->fec.drop) && mod->fec.drop > 0)
+            asc_log_warning(MSG("fec_drop: every %d-th datagram is dropped"), mod->fec.drop);
+    }
     if(mod->is_rtp)
     {
         const uint32_t rtpssrc = (uint32_t)rand();
@@ -334,52 +579,43 @@ static void module_init(module_data_t *mod)
 #define RTP_PT_H261     31      /* RFC2032 */
 #define RTP_PT_MP2T     33      /* RFC2250 */
 
-        mod->buffer[0 ] = 0x80; // RTP version
-        mod->buffer[1 ] = RTP_PT_MP2T;
-        mod->buffer[8 ] = (rtpssrc >> 24) & 0xFF;
-        mod->buffer[9 ] = (rtpssrc >> 16) & 0xFF;
-        mod->buffer[10] = (rtpssrc >>  8) & 0xFF;
-        mod->buffer[11] = (rtpssrc      ) & 0xFF;
+        mod->rtp_header[0 ] = 0x80; // RTP version
+        mod->rtp_header[1 ] = RTP_PT_MP2T;
+        mod->rtp_header[8 ] = (rtpssrc >> 24) & 0xFF;
+        mod->rtp_header[9 ] = (rtpssrc >> 16) & 0xFF;
+        mod->rtp_header[10] = (rtpssrc >>  8) & 0xFF;
+        mod->rtp_header[11] = (rtpssrc      ) & 0xFF;
     }
 
-    mod->sock = asc_socket_open_udp4(mod);
-    asc_socket_set_reuseaddr(mod->sock, 1);
-    if(!asc_socket_bind(mod->sock, NULL, 0))
-        astra_abort();
-
-    int value;
-    if(module_option_number("socket_size", &value))
-        asc_socket_set_buffer(mod->sock, 0, value);
-
-    const char *localaddr = NULL;
-    module_option_string("localaddr", &localaddr);
-    if(localaddr)
-        asc_socket_set_multicast_if(mod->sock, localaddr);
-
-    value = 32;
-    module_option_number("ttl", &value);
-    asc_socket_set_multicast_ttl(mod->sock, value);
+    mod->queue.buffer = malloc(UDP_QUEUE_SIZE * UDP_BUFFER_SIZE);
+    mod->queue.count_max = UDP_QUEUE_SIZE;
 
-    asc_socket_multicast_join(mod->sock, mod->addr, NULL);
-    asc_socket_set_sockaddr(mod->sock, mod->addr, mod->port);
+    mod->sock = output_socket_open(mod, mod->port);
 
 #ifndef _WIN32
+    int value;
     if(module_option_number("sync", &value) && value > 0)
     {
         module_stream_init(mod, sync_queue_push);
 
+        // sync thread has no event loop to flush the queue
+        mod->queue.count_max = 1;
+
         // is a 1/5 of the storage for the one second of the stream
-        value = ((value * 200000 / 8) / TS_PACKET_SIZE) * TS_PACKET_SIZE;
+        value = (value * 200000 / 8) / TS_PACKET_SIZE;
 
-        mod->sync.buffer = malloc(value);
-        mod->sync.buffer_size = value;
+        mod->sync.ring = asc_ring_init(TS_PACKET_SIZE, value, false);
 
         asc_thread_init(&mod->sync.thread, thread_loop, mod);
     }
     else
+    {
         module_stream_init(mod, on_ts);
+        module_stream_buffer_set(mod, on_ts_buffer);
+    }
 #else
     module_stream_init(mod, on_ts);
+    module_stream_buffer_set(mod, on_ts_buffer);
 #endif
 }
 
@@ -388,14 +624,28 @@ static void module_destroy(module_data_t *mod)
     module_stream_destroy(mod);
 
 #ifndef _WIN32
-    if(mod->sync.buffer)
+    if(mod->sync.ring)
     {
         asc_thread_destroy(&mod->sync.thread);
-        free(mod->sync.buffer);
+        asc_ring_destroy(mod->sync.ring);
     }
 #endif
 
+    if(mod->queue.is_pending)
+        queue_remove(mod);
+    if(mod->queue.count > 0)
+        queue_flush(mod);
+    free(mod->queue.buffer);
+
     asc_socket_close(mod->sock);
+
+    for(int i = 0; i < 2; ++i)
+    {
+        if(mod->fec.sock[i])
+            asc_socket_close(mod->fec.sock[i]);
+    }
+    free(mod->fec.column);
+    free(mod->fec.row);
 }
 
 MODULE_STREAM_METHODS()
@@ -271,7 +271,16 @@ function start_analyze()
     instance.a = analyze({
         upstream = instance.i:stream(),
         name = "Test Channel",
-        callback = on_analyze
+        callback = function(data)
+            -- statistics is dumped by the timer
+            if not data.analyze then on_analyze(data) end
+        end
+    })
+    instance.t = timer({
+        interval = 1,
+        callback = function()
+            on_analyze(instance.a:stat())
+        end
     })
 end
 
@@ -709,7 +709,10 @@ function init_input(channel_data, input_id)
                                 log_analyze_error(channel_data, input_id, data)
                             end
                             input_data.on_air = data.on_air
-                            start_reserve(channel_data)
+                            -- in the hot-standby mode inputs are switched by transmit
+                            if not channel_data.config.hot_standby then
+                                start_reserve(channel_data)
+                            end
                         end
                     end
                 end
@@ -976,9 +979,22 @@ function make_channel(channel_conf)
     for input_id = 1, #channel_conf.input do
         channel_data.input[input_id] = { on_air = false, }
     end
-    init_input(channel_data, 1)
 
-    channel_data.transmit = transmit({ upstream = channel_data.input[1].tail:stream() })
+    if channel_conf.hot_standby and #channel_conf.input > 1 then
+        -- all inputs are running, transmit switches to the first alive input
+        channel_data.transmit = transmit({
+            name = channel_conf.name,
+            timeout = channel_conf.hot_standby_timeout,
+        })
+        for input_id = 1, #channel_conf.input do
+            init_input(channel_data, input_id)
+            channel_data.transmit:add_input(channel_data.input[input_id].tail:stream())
+        end
+    else
+        channel_conf.hot_standby = nil
+        init_input(channel_data, 1)
+        channel_data.transmit = transmit({ upstream = channel_data.input[1].tail:stream() })
+    end
     channel_data.tail = channel_data.transmit
 
     for output_id,_ in pairs(channel_conf.output) do
@@ -36,6 +36,54 @@ end
 
 client_list = {}
 localaddr = nil -- for -l option
+linger = 5 -- for -i option. seconds
+
+-- one udp_input per multicast group, shared by all clients of the group
+-- key: "addr:port", value: { input, clients, timer }
+group_list = {}
+
+function group_join(key, conf)
+    local group = group_list[key]
+    if not group then
+        log.debug("[xproxy.lua] open group " .. key)
+        group = { input = udp_input(conf), clients = 0 }
+        group_list[key] = group
+    elseif group.timer then
+        group.timer:close()
+        group.timer = nil
+    end
+    group.clients = group.clients + 1
+    return group
+end
+
+function group_close(key)
+    log.debug("[xproxy.lua] close group " .. key)
+    group_list[key] = nil
+    collectgarbage()
+end
+
+function group_leave(key)
+    local group = group_list[key]
+    if not group then return end
+
+    group.clients = group.clients - 1
+    if group.clients > 0 then return end
+
+    if linger <= 0 then
+        group_close(key)
+        return
+    end
+
+    group.timer = timer({
+        interval = linger,
+        callback = function(self)
+            self:close()
+            if group_list[key] == group and group.clients == 0 then
+                group_close(key)
+            end
+        end
+    })
+end
 
 function render_stat_html()
     local table_content = ""
@@ -128,7 +176,8 @@ function on_http_read(self, client, data)
             url = data.uri:sub(6), -- skip /udp/
         }
 
-        client_data.input = udp_input(udp_input_conf)
+        client_data.group = udp_input_conf.addr .. ":" .. udp_input_conf.port
+        local group = group_join(client_data.group, udp_input_conf)
         self:send(client, {
             code = 200,
             message = "OK",
@@ -136,14 +185,16 @@ function on_http_read(self, client, data)
                 server_header,
                 "Content-Type: application/octet-stream",
             },
-            upstream = client_data.input:stream()
+            upstream = group.input:stream()
         })
     elseif type(data) == 'nil' then
         -- close connection
         client_list[client_data] = nil
 
-        client_data.input = nil
-        collectgarbage()
+        if client_data.group then
+            group_leave(client_data.group)
+            client_data.group = nil
+        end
     end
 end
 
@@ -153,6 +204,7 @@ function usage()
           "    -a ADDR             local addres to listen\n" ..
           "    -p PORT             local port to listen\n" ..
           "    -l ADDR             source interface address\n" ..
+          "    -i SEC              keep the multicast group after the last client, default: 5\n" ..
           "    --debug             print debug messages"
           )
     astra.exit()
@@ -167,6 +219,7 @@ options = {
     ["-a"] = function(i) http_addr = argv[i + 1] return i + 2 end,
     ["-p"] = function(i) http_port = tonumber(argv[i + 1]) return i + 2 end,
     ["-l"] = function(i) localaddr = argv[i + 1] return i + 2 end,
+    ["-i"] = function(i) linger = tonumber(argv[i + 1]) return i + 2 end,
     ["--debug"] = function (i) log.set({ debug = true }) return i + 1 end,
 }
 